@@ -69,6 +69,11 @@ bool RHDatagram::waitPacketSent(uint16_t timeout)
     return _driver.waitPacketSent(timeout);
 }
 
+bool RHDatagram::packetSent()
+{
+    return _driver.packetSent();
+}
+
 bool RHDatagram::waitAvailableTimeout(uint16_t timeout)
 {
     return _driver.waitAvailableTimeout(timeout);
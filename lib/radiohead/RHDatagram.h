@@ -109,6 +109,10 @@ public:
     /// \return true if the radio completed transmission within the timeout period. False if it timed out.
     bool            waitPacketSent(uint16_t timeout);
 
+    /// Checks without blocking whether the transmitter is no longer transmitting.
+    /// \return true if no transmission is in progress
+    bool            packetSent();
+
     /// Starts the Driver receiver and blocks until a received message is available or a timeout
     /// \param[in] timeout Maximum time to wait in milliseconds.
     /// \return true if a message is available
@@ -9,6 +9,7 @@ RHGenericDriver::RHGenericDriver()
     :
     _mode(RHModeInitialising),
     _thisAddress(RH_BROADCAST_ADDRESS),
+    _promiscuous(false),
     _txHeaderTo(RH_BROADCAST_ADDRESS),
     _txHeaderFrom(RH_BROADCAST_ADDRESS),
     _txHeaderId(0),
@@ -16,6 +17,12 @@ RHGenericDriver::RHGenericDriver()
     _rxBad(0),
     _rxGood(0),
     _txGood(0),
+    _hwAck(false),
+    _lastTxAcked(true),
+    _lastTxRetries(0),
+    _txRetransmissions(0),
+    _txLost(0),
+    _txTimeouts(0),
     _cad_timeout(0)
 {
 }
@@ -68,6 +75,11 @@ bool RHGenericDriver::waitPacketSent(uint16_t timeout)
     return false;
 }
 
+bool RHGenericDriver::packetSent()
+{
+    return _mode != RHModeTx;
+}
+
 // Wait until no channel activity detected or timeout
 bool RHGenericDriver::waitCAD()
 {
@@ -206,6 +218,36 @@ uint16_t RHGenericDriver::txGood()
     return _txGood;
 }
 
+bool RHGenericDriver::hardwareAck()
+{
+    return _hwAck;
+}
+
+bool RHGenericDriver::lastTxAcked()
+{
+    return _lastTxAcked;
+}
+
+uint8_t RHGenericDriver::lastTxRetries()
+{
+    return _lastTxRetries;
+}
+
+uint16_t RHGenericDriver::txRetransmissions()
+{
+    return _txRetransmissions;
+}
+
+uint16_t RHGenericDriver::txLost()
+{
+    return _txLost;
+}
+
+uint16_t RHGenericDriver::txTimeouts()
+{
+    return _txTimeouts;
+}
+
 void RHGenericDriver::setCADTimeout(unsigned long cad_timeout)
 {
     _cad_timeout = cad_timeout;
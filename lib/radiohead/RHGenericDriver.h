@@ -115,6 +115,12 @@ public:
     /// \return true if the radio completed transmission within the timeout period. False if it timed out.
     virtual bool            waitPacketSent(uint16_t timeout);
 
+    /// Checks without blocking whether the transmitter is no longer transmitting.
+    /// Once it is not, does the same cleanup as waitPacketSent().
+    /// Use this to poll for the end of transmission from a timer or event loop.
+    /// \return true if no transmission is in progress
+    virtual bool            packetSent();
+
     /// Starts the receiver and blocks until a received message is available or a timeout
     /// \param[in] timeout Maximum time to wait in milliseconds.
     /// \return true if a message is available
@@ -247,6 +253,34 @@ public:
     /// \return The number of packets successfully transmitted
     virtual uint16_t       txGood();
 
+    /// Tells whether the driver acknowledges and retransmits messages in hardware.
+    /// If it does, the result of a transmission is known as soon as packetSent() or waitPacketSent()
+    /// returns, and RHReliableDatagram uses it instead of waiting for an acknowledgement message.
+    /// \return true if hardware acknowledgement is enabled
+    virtual bool           hardwareAck();
+
+    /// With hardware acknowledgement, tells whether the last transmitted message was acknowledged
+    /// by the receiver.
+    /// \return true if the last message was acknowledged. Always true without hardware acknowledgement.
+    virtual bool           lastTxAcked();
+
+    /// With hardware acknowledgement, returns the number of times the last transmitted message
+    /// was retransmitted by the hardware.
+    /// \return The number of retransmissions of the last message
+    virtual uint8_t        lastTxRetries();
+
+    /// Returns the count of hardware retransmissions since startup
+    /// \return The number of messages retransmitted by the hardware
+    virtual uint16_t       txRetransmissions();
+
+    /// Returns the count of messages that were not acknowledged after all hardware retransmissions
+    /// \return The number of messages lost
+    virtual uint16_t       txLost();
+
+    /// Returns the count of transmissions the hardware never reported as completed
+    /// \return The number of transmit timeouts
+    virtual uint16_t       txTimeouts();
+
 protected:
 
     /// The current transport operating mode
@@ -294,6 +328,24 @@ protected:
     /// Count of the number of bad messages (correct checksum etc) received
     volatile uint16_t   _txGood;
     
+    /// Whether messages are acknowledged and retransmitted in hardware
+    bool                _hwAck;
+
+    /// Whether the last transmitted message was acknowledged (hardware acknowledgement only)
+    bool                _lastTxAcked;
+
+    /// Hardware retransmissions of the last transmitted message
+    uint8_t             _lastTxRetries;
+
+    /// Count of hardware retransmissions
+    volatile uint16_t   _txRetransmissions;
+
+    /// Count of messages not acknowledged after all hardware retransmissions
+    volatile uint16_t   _txLost;
+
+    /// Count of transmissions that timed out
+    volatile uint16_t   _txTimeouts;
+
     /// Channel activity detected
     volatile bool       _cad;
 
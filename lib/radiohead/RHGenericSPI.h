@@ -89,6 +89,14 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     virtual uint8_t transfer(uint8_t data) = 0;
 
+    /// Transfer a block of octets to and from the SPI interface in one go
+    /// Subclasses that can hand a whole buffer to the SPI hardware should override this,
+    /// the base version calls transfer() for each octet.
+    /// \param[in] tx The octets to send. If NULL, zeros are sent
+    /// \param[out] rx Where to store the octets read. If NULL, they are discarded. May be the same as tx
+    /// \param[in] len Number of octets to transfer
+    virtual void transferN(const uint8_t* tx, uint8_t* rx, uint8_t len);
+
     /// SPI Configuration methods
     /// Enable SPI interrupts (if supported)
     /// This can be used in an SPI slave to indicate when an SPI message has been received
@@ -5,6 +5,9 @@
 // $Id: RHHardwareSPI.cpp,v 1.20 2018/02/11 23:57:18 mikem Exp mikem $
 
 #include <RHHardwareSPI.h>
+#if (RH_PLATFORM == RH_PLATFORM_ESP8266_MGOS)
+#include <mgos_spi.h>
+#endif
 
 // Declare a single default instance of the hardware SPI interface class
 RHHardwareSPI hardware_spi;
@@ -43,6 +46,31 @@ uint8_t RHHardwareSPI::transfer(uint8_t data)
     return SPI.transfer(data);
 }
 
+#if (RH_PLATFORM == RH_PLATFORM_ESP8266_MGOS)
+void RHHardwareSPI::transferN(const uint8_t* tx, uint8_t* rx, uint8_t len)
+{
+    static const int freqs[] = { 1000000, 2000000, 4000000, 8000000, 16000000 };
+    struct mgos_spi* spi = mgos_spi_get_global();
+    struct mgos_spi_txn txn;
+
+    // mgos SPI only shifts MSB first and wants both buffers
+    if (!spi || !tx || !rx || _bitOrder != BitOrderMSBFirst)
+    {
+	RHGenericSPI::transferN(tx, rx, len);
+	return;
+    }
+    memset(&txn, 0, sizeof(txn));
+    txn.cs = -1; // Slave select is driven by the caller
+    txn.mode = _dataMode;
+    txn.freq = freqs[_frequency];
+    txn.fd.tx_data = tx;
+    txn.fd.rx_data = rx;
+    txn.fd.len = len;
+    if (!mgos_spi_run_txn(spi, true, &txn))
+	memset(rx, 0, len);
+}
+#endif
+
 void RHHardwareSPI::attachInterrupt() 
 {
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO || RH_PLATFORM == RH_PLATFORM_NRF52)
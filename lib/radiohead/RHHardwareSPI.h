@@ -36,6 +36,15 @@ public:
     /// \return The octet read from SPI while the data octet was sent
     uint8_t transfer(uint8_t data);
 
+#if (RH_PLATFORM == RH_PLATFORM_ESP8266_MGOS)
+    /// Transfer a block of octets as a single Mongoose OS SPI transaction
+    /// instead of one transaction per octet.
+    /// \param[in] tx The octets to send. If NULL, zeros are sent
+    /// \param[out] rx Where to store the octets read. If NULL, they are discarded. May be the same as tx
+    /// \param[in] len Number of octets to transfer
+    void transferN(const uint8_t* tx, uint8_t* rx, uint8_t len);
+#endif
+
     // SPI Configuration methods
     /// Enable SPI interrupts
     /// This can be used in an SPI slave to indicate when an SPI message has been received
@@ -43,26 +43,24 @@ uint8_t RHNRFSPIDriver::spiCommand(uint8_t command)
 
 uint8_t RHNRFSPIDriver::spiRead(uint8_t reg)
 {
-    uint8_t val;
+    uint8_t buf[2] = { reg, 0 };
     ATOMIC_BLOCK_START;
     _spi.beginTransaction();
     digitalWrite(_slaveSelectPin, LOW);
-    _spi.transfer(reg); // Send the address, discard the status
-    val = _spi.transfer(0); // The written value is ignored, reg value is read
+    _spi.transferN(buf, buf, 2); // Send the address, then read the reg value
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
-    return val;
+    return buf[1];
 }
 
 uint8_t RHNRFSPIDriver::spiWrite(uint8_t reg, uint8_t val)
 {
-    uint8_t status = 0;
+    uint8_t buf[2] = { reg, val }; // Address, new value follows
     ATOMIC_BLOCK_START;
     _spi.beginTransaction();
     digitalWrite(_slaveSelectPin, LOW);
-    status = _spi.transfer(reg); // Send the address
-    _spi.transfer(val); // New value follows
+    _spi.transferN(buf, buf, 2);
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(__arm__) && defined(CORE_TEENSY)
     // Sigh: some devices, such as MRF89XA dont work properly on Teensy 3.1:
     // At 1MHz, the clock returns low _after_ slave select goes high, which prevents SPI
@@ -72,18 +70,32 @@ delayMicroseconds(5);
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
-    return status;
+    return buf[0];
 }
 
+// Bursts up to RH_NRF_SPI_BURST_MAX octets go out as a single transfer together
+// with the command, longer ones as command + block
 uint8_t RHNRFSPIDriver::spiBurstRead(uint8_t reg, uint8_t* dest, uint8_t len)
 {
+    uint8_t buf[RH_NRF_SPI_BURST_MAX + 1];
     uint8_t status = 0;
     ATOMIC_BLOCK_START;
     _spi.beginTransaction();
     digitalWrite(_slaveSelectPin, LOW);
-    status = _spi.transfer(reg); // Send the start address
-    while (len--)
-	*dest++ = _spi.transfer(0);
+    if (len <= RH_NRF_SPI_BURST_MAX)
+    {
+	buf[0] = reg; // The start address
+	memset(buf + 1, 0, len);
+	_spi.transferN(buf, buf, len + 1);
+	status = buf[0];
+	memcpy(dest, buf + 1, len);
+    }
+    else
+    {
+	status = _spi.transfer(reg); // Send the start address
+	memset(dest, 0, len);
+	_spi.transferN(dest, dest, len);
+    }
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
@@ -92,13 +104,29 @@ uint8_t RHNRFSPIDriver::spiBurstRead(uint8_t reg, uint8_t* dest, uint8_t len)
 
 uint8_t RHNRFSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len)
 {
+    uint8_t buf[RH_NRF_SPI_BURST_MAX + 1];
     uint8_t status = 0;
     ATOMIC_BLOCK_START;
     _spi.beginTransaction();
     digitalWrite(_slaveSelectPin, LOW);
-    status = _spi.transfer(reg); // Send the start address
-    while (len--)
-	_spi.transfer(*src++);
+    if (len <= RH_NRF_SPI_BURST_MAX)
+    {
+	buf[0] = reg; // The start address
+	memcpy(buf + 1, src, len);
+	_spi.transferN(buf, buf, len + 1);
+	status = buf[0];
+    }
+    else
+    {
+	status = _spi.transfer(reg); // Send the start address
+	while (len)
+	{
+	    uint8_t n = len < sizeof(buf) ? len : sizeof(buf);
+	    _spi.transferN(src, buf, n); // Status octets read back are discarded
+	    src += n;
+	    len -= n;
+	}
+    }
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
@@ -9,6 +9,12 @@
 #include <RHGenericDriver.h>
 #include <RHHardwareSPI.h>
 
+// Register and payload bursts up to this many octets are done in a single SPI
+// transfer together with the command octet. Covers nRF24 payloads and addresses.
+#ifndef RH_NRF_SPI_BURST_MAX
+ #define RH_NRF_SPI_BURST_MAX 32
+#endif
+
 class RHGenericSPI;
 
 /////////////////////////////////////////////////////////////////////
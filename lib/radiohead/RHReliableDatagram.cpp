@@ -23,6 +23,8 @@ RHReliableDatagram::RHReliableDatagram(RHGenericDriver& driver, uint8_t thisAddr
     _timeout = RH_DEFAULT_TIMEOUT;
     _retries = RH_DEFAULT_RETRIES;
     memset(_seenIds, 0, sizeof(_seenIds));
+    _asyncState = AsyncIdle;
+    _asyncCallback = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -44,6 +46,12 @@ uint8_t RHReliableDatagram::retries()
     return _retries;
 }
 
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::timeout()
+{
+    return _timeout;
+}
+
 ////////////////////////////////////////////////////////////////////
 bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 {
@@ -65,6 +73,14 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 
 	if (retries > 1)
 	    _retransmissions++;
+
+	// The radio has already waited for the ack and retransmitted
+	if (_driver.hardwareAck())
+	{
+	    if (_driver.lastTxAcked())
+		return true;
+	    continue;
+	}
 	unsigned long thisSendTime = millis(); // Timeout does not include original transmit time
 
 	// Compute a new timeout, random between _timeout and _timeout*2
@@ -93,6 +109,7 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 			return true;
 		    }
 		    else if (   !(flags & RH_FLAGS_ACK)
+				&& !_driver.hardwareAck()
 				&& (id == _seenIds[from]))
 		    {
 			// This is a request we have already received. ACK it again
@@ -111,6 +128,116 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
     return false;
 }
 
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoAsync(const uint8_t* buf, uint8_t len, uint8_t address, RHSendCallback callback, void* arg)
+{
+    if (_asyncState != AsyncIdle || len > sizeof(_asyncBuf))
+	return false;
+
+    memcpy(_asyncBuf, buf, len);
+    _asyncLen = len;
+    _asyncAddress = address;
+    _asyncId = ++_lastSequenceNumber;
+    _asyncTries = 0;
+    _asyncHwRetries = 0;
+    _asyncCallback = callback;
+    _asyncArg = arg;
+    asyncTransmit();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::pollAsync()
+{
+    int32_t timeLeft;
+
+    switch (_asyncState)
+    {
+    case AsyncIdle:
+	return 0;
+
+    case AsyncTx:
+	if (!packetSent())
+	{
+	    // Should never happen: TX never completed. Count it as a lost try.
+	    if ((int32_t)(millis() - _asyncDeadline) < 0)
+		return 1;
+	}
+	else
+	{
+	    // Never wait for ACKS to broadcasts
+	    if (_asyncAddress == RH_BROADCAST_ADDRESS)
+	    {
+		asyncDone(true);
+		return 0;
+	    }
+	    // The radio has already waited for the ack and retransmitted
+	    if (_driver.hardwareAck())
+	    {
+		_asyncHwRetries += _driver.lastTxRetries();
+		if (_driver.lastTxAcked())
+		{
+		    asyncDone(true);
+		    return 0;
+		}
+	    }
+	    // Timeout does not include original transmit time.
+	    // Random between _timeout and _timeout*2, as in sendtoWait().
+	    // With hardware acks, no ack message will come, so this is just a backoff.
+	    _asyncDeadline = millis() + _timeout + (_timeout * random(0, 256) / 256);
+	    _asyncState = AsyncWaitAck;
+	    available(); // Starts the receiver
+	    return _asyncDeadline - millis();
+	}
+	break;
+
+    case AsyncWaitAck:
+	timeLeft = _asyncDeadline - millis();
+	if (timeLeft > 0)
+	    return timeLeft;
+	break;
+    }
+
+    // Timeout exhausted, maybe retry
+    if (_asyncTries > _retries)
+    {
+	asyncDone(false);
+	return 0;
+    }
+    asyncTransmit();
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::asyncBusy()
+{
+    return _asyncState != AsyncIdle;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::asyncTransmit()
+{
+    setHeaderId(_asyncId);
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK); // Clear the ACK flag
+    if (_asyncTries++)
+	_retransmissions++;
+    // A failed send is a lost try, noticed when the deadline passes
+    sendto(_asyncBuf, _asyncLen, _asyncAddress);
+    // Longer than any possible message
+    _asyncDeadline = millis() + 100;
+    _asyncState = AsyncTx;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::asyncDone(bool acked)
+{
+    uint16_t retries = _asyncTries - 1 + _asyncHwRetries;
+
+    _asyncState = AsyncIdle;
+    if (_asyncCallback)
+	_asyncCallback(acked, retries > 255 ? 255 : retries, _asyncArg);
+}
+
 ////////////////////////////////////////////////////////////////////
 bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
 {  
@@ -121,11 +248,20 @@ bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from,
     // Get the message before its clobbered by the ACK (shared rx and tx buffer in some drivers
     if (available() && recvfrom(buf, len, &_from, &_to, &_id, &_flags))
     {
+	// Is it the ACK for the message in flight from sendtoAsync()?
+	if (   (_flags & RH_FLAGS_ACK)
+	    && _asyncState != AsyncIdle
+	    && _from == _asyncAddress
+	    && _to == _thisAddress
+	    && _id == _asyncId)
+	{
+	    asyncDone(true);
+	}
 	// Never ACK an ACK
 	if (!(_flags & RH_FLAGS_ACK))
 	{
 	    // Its a normal message not an ACK
-	    if (_to ==_thisAddress)
+	    if (_to ==_thisAddress && !_driver.hardwareAck())
 	    {
 	        // Its for this node and
 		// Its not a broadcast, so ACK it
@@ -20,6 +20,13 @@
 /// The default number of retries
 #define RH_DEFAULT_RETRIES 3
 
+/// Called when a message sent with sendtoAsync() has been acknowledged, or all retries
+/// have been exhausted.
+/// \param[in] acked true if an acknowledgement was received (or the message was a broadcast)
+/// \param[in] retries Number of retransmissions that were needed, including those done by the hardware
+/// \param[in] arg The argument given to sendtoAsync()
+typedef void (*RHSendCallback)(bool acked, uint8_t retries, void* arg);
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHReliableDatagram RHReliableDatagram.h <RHReliableDatagram.h>
 /// \brief RHDatagram subclass for sending addressed, acknowledged, retransmitted datagrams.
@@ -48,6 +55,10 @@
 /// - FLAGS with the RH_FLAGS_ACK bit set
 /// - 1 octet of payload containing ASCII '!' (since some drivers cannot handle 0 length payloads)
 ///
+/// If the driver acknowledges and retransmits in hardware (see RHGenericDriver::hardwareAck()),
+/// no ack messages are sent. The result of each transmission comes from the driver, and the
+/// retries and timeouts here only apply once the hardware has given up.
+///
 /// \par Media Access Strategy
 ///
 /// RHReliableDatagram and the underlying drivers always transmit as soon as
@@ -107,6 +118,11 @@ public:
     /// \return The currently configured maximum number of retries.
     uint8_t retries();
 
+    /// Returns the currently configured timeout.
+    /// Can be changed with setTimeout().
+    /// \return The currently configured timeout in milliseconds.
+    uint16_t timeout();
+
     /// Send the message (with retries) and waits for an ack. Returns true if an acknowledgement is received.
     /// Synchronous: any message other than the desired ACK received while waiting is discarded.
     /// Blocks until an ACK is received or all retries are exhausted (ie up to retries*timeout milliseconds).
@@ -119,6 +135,32 @@ public:
     /// \return true if the message was transmitted and an acknowledgement was received.
     bool sendtoWait(uint8_t* buf, uint8_t len, uint8_t address);
 
+    /// Starts sending the message (with retries) like sendtoWait(), but returns immediately.
+    /// The message is copied, so buf may be reused as soon as this returns.
+    /// The transmission, the wait for the ack and the retransmissions are done by pollAsync(),
+    /// and by recvfromAck() when the ack is received. When the ack has been received or the
+    /// retries are exhausted, callback is called.
+    /// Only one message can be in flight at a time.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to.
+    /// \param[in] callback Called with the result. May be NULL.
+    /// \param[in] arg Passed to callback
+    /// \return true if the transmission was started, false if a message is already in flight
+    /// or the message is too long
+    bool sendtoAsync(const uint8_t* buf, uint8_t len, uint8_t address, RHSendCallback callback, void* arg);
+
+    /// Advances the message started with sendtoAsync(): checks whether the transmission has finished,
+    /// starts waiting for the ack and retransmits when the ack timeout has expired.
+    /// Never blocks. Call this when the number of milliseconds it last returned has elapsed,
+    /// or sooner; calling it early does no harm.
+    /// Received acks must be collected with recvfromAck() meanwhile.
+    /// \return Milliseconds until pollAsync() should be called again, 0 if no message is in flight
+    uint16_t pollAsync();
+
+    /// \return true if a message sent with sendtoAsync() is still in flight
+    bool asyncBusy();
+
     /// If there is a valid message available for this node, send an acknowledgement to the SRC
     /// address (blocking until this is complete), then copy the message to buf and return true
     /// else return false. 
@@ -126,6 +168,7 @@ public:
     /// If from is not NULL, the SRC address is placed in *from.
     /// If to is not NULL, the DEST address is placed in *to.
     /// This is the preferred function for getting messages addressed to this node.
+    /// An ack for the message in flight from sendtoAsync() completes that message.
     /// If the message is not a broadcast, acknowledge to the sender before returning.
     /// You should be sure to call this function frequently enough to not miss any messages
     /// It is recommended that you call it in your main loop.
@@ -174,6 +217,20 @@ protected:
     bool haveNewMessage();
 
 private:
+    /// States of the message sent with sendtoAsync()
+    typedef enum
+    {
+	AsyncIdle = 0,  ///< No message in flight
+	AsyncTx,        ///< Transmitting
+	AsyncWaitAck,   ///< Waiting for the ack
+    } AsyncState;
+
+    /// Sends the next try of the async message
+    void asyncTransmit();
+
+    /// Finishes the async message and calls the callback
+    void asyncDone(bool acked);
+
     /// Count of retransmissions we have had to send
     uint32_t _retransmissions;
 
@@ -194,6 +251,21 @@ private:
     /// (this is generally due to lost ACKs, causing the sender to retransmit, even though we have already
     /// received that message)
     uint8_t _seenIds[256];
+
+    /// The message sent with sendtoAsync()
+    AsyncState          _asyncState;
+    uint8_t             _asyncBuf[RH_MAX_MESSAGE_LEN];
+    uint8_t             _asyncLen;
+    uint8_t             _asyncAddress;
+    uint8_t             _asyncId;
+    /// Number of transmissions so far
+    uint8_t             _asyncTries;
+    /// Retransmissions done by the hardware, with hardware acknowledgement
+    uint16_t            _asyncHwRetries;
+    /// millis() when the current state times out
+    unsigned long       _asyncDeadline;
+    RHSendCallback      _asyncCallback;
+    void*               _asyncArg;
 };
 
 /// @example rf22_reliable_datagram_client.pde
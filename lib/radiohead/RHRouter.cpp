@@ -0,0 +1,406 @@
+// RHRouter.cpp
+//
+// Multi-hop routing on top of RHReliableDatagram
+// Contributed by Juha Yrjölä and used with permission
+
+#include <RHRouter.h>
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHRouter::RHRouter(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHReliableDatagram(driver, thisAddress)
+{
+    _maxHops = RH_ROUTER_DEFAULT_MAX_HOPS;
+    _lastId = 0;
+    _lastRoutingId = 0;
+    _queueLen = 0;
+    _seenNext = 0;
+    _forwarded = 0;
+    _dropped = 0;
+    _discoveries = 0;
+    memset(_seenSource, RH_BROADCAST_ADDRESS, sizeof(_seenSource));
+    memset(_seenId, 0, sizeof(_seenId));
+    clearRoutingTable();
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+bool RHRouter::init()
+{
+    bool ret = RHReliableDatagram::init();
+    clearRoutingTable();
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::setMaxHops(uint8_t maxHops)
+{
+    _maxHops = maxHops;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoAsync(const uint8_t* buf, uint8_t len, uint8_t dest, RHSendCallback callback, void* arg)
+{
+    RoutedMessageHeader header;
+
+    if (   len + sizeof(header) > RH_ROUTER_MAX_FRAME_LEN
+	|| len + sizeof(header) > _driver.maxMessageLength())
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+    header.dest = dest;
+    header.source = _thisAddress;
+    header.hops = 0;
+    header.id = ++_lastId;
+    header.type = RH_ROUTER_MESSAGE_TYPE_DATA;
+    if (!enqueue(&header, buf, len, callback, arg))
+	return RH_ROUTER_ERROR_QUEUE_FULL;
+    sendNext();
+    return RH_ROUTER_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHRouter::poll()
+{
+    uint16_t wait;
+    uint8_t i = 0;
+
+    // Give up on messages that did not get a route in time
+    while (i < _queueLen)
+    {
+	QueueEntry* e = &_queue[i];
+	RoutedMessageHeader* h = (RoutedMessageHeader*)e->frame;
+	if (   e->waitRoute
+	    && (int32_t)(millis() - e->deadline) >= 0
+	    && !getRouteTo(h->dest))
+	{
+	    RHSendCallback callback = e->callback;
+	    void* arg = e->arg;
+	    if (h->source != _thisAddress)
+		_dropped++;
+	    dequeue(i);
+	    if (callback)
+		callback(false, 0, arg);
+	    continue;
+	}
+	i++;
+    }
+
+    wait = pollAsync();
+    if (!asyncBusy())
+    {
+	sendNext();
+	wait = pollAsync();
+    }
+    if (!wait && _queueLen)
+	wait = RH_ROUTER_POLL_INTERVAL;
+    return wait;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::queueFull()
+{
+    return _queueLen >= RH_ROUTER_QUEUE_LEN;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* hops)
+{
+    uint8_t from, frameLen = sizeof(_tmpFrame);
+    RoutedMessageHeader* h = (RoutedMessageHeader*)_tmpFrame;
+
+    if (!RHReliableDatagram::recvfromAck(_tmpFrame, &frameLen, &from))
+	return false;
+    if (frameLen < sizeof(RoutedMessageHeader))
+	return false;
+
+    // The neighbour is one hop away, and the source is reached through it
+    addRouteTo(from, from, 1);
+    addRouteTo(h->source, from, h->hops + 1);
+
+    switch (h->type)
+    {
+    case RH_ROUTER_MESSAGE_TYPE_DATA:
+	if (h->dest == _thisAddress || h->dest == RH_BROADCAST_ADDRESS)
+	{
+	    uint8_t msgLen = frameLen - sizeof(RoutedMessageHeader);
+	    if (buf && len)
+	    {
+		if (*len > msgLen)
+		    *len = msgLen;
+		memcpy(buf, _tmpFrame + sizeof(RoutedMessageHeader), *len);
+	    }
+	    if (source) *source = h->source;
+	    if (dest)   *dest =   h->dest;
+	    if (id)     *id =     h->id;
+	    if (hops)   *hops =   h->hops;
+	    return true;
+	}
+	forward(frameLen);
+	break;
+
+    case RH_ROUTER_MESSAGE_TYPE_ROUTE_REQUEST:
+	if (   frameLen < sizeof(RoutedMessageHeader) + 1
+	    || h->source == _thisAddress
+	    || seenRequest(h->source, h->id))
+	    break;
+	if (_tmpFrame[sizeof(RoutedMessageHeader)] == _thisAddress)
+	{
+	    // We are the one being looked for: reply along the reverse path just learned
+	    sendRouting(RH_ROUTER_MESSAGE_TYPE_ROUTE_REPLY, h->source, _thisAddress);
+	}
+	else if (h->hops + 1 < _maxHops)
+	{
+	    // Flood it on
+	    h->hops++;
+	    if (!enqueue(h, _tmpFrame + sizeof(RoutedMessageHeader), frameLen - sizeof(RoutedMessageHeader), NULL, NULL))
+		_dropped++;
+	}
+	break;
+
+    case RH_ROUTER_MESSAGE_TYPE_ROUTE_REPLY:
+	// The route to the source of the reply has been learned above
+	if (h->dest != _thisAddress)
+	    forward(frameLen);
+	break;
+
+    case RH_ROUTER_MESSAGE_TYPE_NO_ROUTE:
+	if (h->dest == _thisAddress)
+	{
+	    if (frameLen > sizeof(RoutedMessageHeader))
+		deleteRouteTo(_tmpFrame[sizeof(RoutedMessageHeader)]);
+	}
+	else
+	    forward(frameLen);
+	break;
+    }
+    // Anything queued is sent from poll()
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::addRouteTo(uint8_t dest, uint8_t nextHop, uint8_t hops)
+{
+    if (dest == _thisAddress || dest == RH_BROADCAST_ADDRESS)
+	return;
+    RoutingTableEntry* r = getRouteTo(dest);
+    if (r && r->nextHop != nextHop && hops > r->hops)
+	return; // Keep the shorter route
+    r = &_routes[dest];
+    r->nextHop = nextHop;
+    r->hops = hops;
+    r->updated = routeTime();
+}
+
+////////////////////////////////////////////////////////////////////
+RHRouter::RoutingTableEntry* RHRouter::getRouteTo(uint8_t dest)
+{
+    if (dest == RH_BROADCAST_ADDRESS)
+	return NULL;
+    RoutingTableEntry* r = &_routes[dest];
+    if (r->nextHop == RH_BROADCAST_ADDRESS)
+	return NULL;
+    if ((uint16_t)(routeTime() - r->updated) > RH_ROUTER_ROUTE_TIMEOUT)
+    {
+	r->nextHop = RH_BROADCAST_ADDRESS;
+	return NULL;
+    }
+    return r;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::deleteRouteTo(uint8_t dest)
+{
+    if (dest != RH_BROADCAST_ADDRESS)
+	_routes[dest].nextHop = RH_BROADCAST_ADDRESS;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::clearRoutingTable()
+{
+    for (uint16_t i = 0; i < RH_BROADCAST_ADDRESS; i++)
+	_routes[i].nextHop = RH_BROADCAST_ADDRESS;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHRouter::forwarded()
+{
+    return _forwarded;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHRouter::dropped()
+{
+    return _dropped;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHRouter::discoveries()
+{
+    return _discoveries;
+}
+
+////////////////////////////////////////////////////////////////////
+// Protected methods
+bool RHRouter::enqueue(const RoutedMessageHeader* header, const uint8_t* payload, uint8_t len, RHSendCallback callback, void* arg)
+{
+    if (_queueLen >= RH_ROUTER_QUEUE_LEN || len + sizeof(RoutedMessageHeader) > RH_ROUTER_MAX_FRAME_LEN)
+	return false;
+    QueueEntry* e = &_queue[_queueLen++];
+    memcpy(e->frame, header, sizeof(RoutedMessageHeader));
+    memcpy(e->frame + sizeof(RoutedMessageHeader), payload, len);
+    e->len = len + sizeof(RoutedMessageHeader);
+    e->waitRoute = false;
+    e->callback = callback;
+    e->arg = arg;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::sendRouting(uint8_t type, uint8_t dest, uint8_t target)
+{
+    RoutedMessageHeader header;
+
+    header.dest = dest;
+    header.source = _thisAddress;
+    header.hops = 0;
+    header.id = ++_lastRoutingId;
+    header.type = type;
+    enqueue(&header, &target, 1, NULL, NULL);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::forward(uint8_t len)
+{
+    RoutedMessageHeader* h = (RoutedMessageHeader*)_tmpFrame;
+
+    if (h->source == _thisAddress || h->hops + 1 >= _maxHops)
+    {
+	// Looping or too far
+	_dropped++;
+	return;
+    }
+    h->hops++;
+    if (!enqueue(h, _tmpFrame + sizeof(RoutedMessageHeader), len - sizeof(RoutedMessageHeader), NULL, NULL))
+    {
+	_dropped++;
+	return;
+    }
+    _forwarded++;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::sendNext()
+{
+    uint8_t i, j;
+
+    if (asyncBusy())
+	return;
+    for (i = 0; i < _queueLen; i++)
+    {
+	QueueEntry* e = &_queue[i];
+	RoutedMessageHeader* h = (RoutedMessageHeader*)e->frame;
+	uint8_t nextHop = RH_BROADCAST_ADDRESS;
+
+	if (h->type != RH_ROUTER_MESSAGE_TYPE_ROUTE_REQUEST && h->dest != RH_BROADCAST_ADDRESS)
+	{
+	    RoutingTableEntry* r = getRouteTo(h->dest);
+	    if (!r)
+	    {
+		if (e->waitRoute)
+		    continue;
+		e->waitRoute = true;
+		e->deadline = millis() + RH_ROUTER_DISCOVERY_TIMEOUT;
+		// One discovery per destination at a time
+		for (j = 0; j < _queueLen; j++)
+		    if (   j != i
+			&& _queue[j].waitRoute
+			&& ((RoutedMessageHeader*)_queue[j].frame)->dest == h->dest)
+			break;
+		if (j == _queueLen)
+		{
+		    sendRouting(RH_ROUTER_MESSAGE_TYPE_ROUTE_REQUEST, RH_BROADCAST_ADDRESS, h->dest);
+		    _discoveries++;
+		}
+		continue;
+	    }
+	    nextHop = r->nextHop;
+	}
+
+	_flightNextHop = nextHop;
+	_flightSource = h->source;
+	_flightDest = h->dest;
+	_flightType = h->type;
+	_flightCallback = e->callback;
+	_flightArg = e->arg;
+	if (!RHReliableDatagram::sendtoAsync(e->frame, e->len, nextHop, hopSent, this))
+	    return;
+	dequeue(i);
+	return;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::dequeue(uint8_t i)
+{
+    _queueLen--;
+    memmove(&_queue[i], &_queue[i + 1], (_queueLen - i) * sizeof(_queue[0]));
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::deleteRoutesVia(uint8_t nextHop)
+{
+    for (uint16_t i = 0; i < RH_BROADCAST_ADDRESS; i++)
+	if (_routes[i].nextHop == nextHop)
+	    _routes[i].nextHop = RH_BROADCAST_ADDRESS;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::seenRequest(uint8_t source, uint8_t id)
+{
+    for (uint8_t i = 0; i < RH_ROUTER_SEEN_LEN; i++)
+	if (_seenSource[i] == source && _seenId[i] == id)
+	    return true;
+    _seenSource[_seenNext] = source;
+    _seenId[_seenNext] = id;
+    _seenNext = (_seenNext + 1) % RH_ROUTER_SEEN_LEN;
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::hopDone(bool acked, uint8_t retries)
+{
+    if (_flightNextHop != RH_BROADCAST_ADDRESS)
+    {
+	if (acked)
+	{
+	    // The route works
+	    RoutingTableEntry* r = getRouteTo(_flightDest);
+	    if (r)
+		r->updated = routeTime();
+	}
+	else
+	{
+	    deleteRoutesVia(_flightNextHop);
+	    if (_flightSource != _thisAddress)
+	    {
+		_dropped++;
+		// Let the source look for another route
+		if (_flightType != RH_ROUTER_MESSAGE_TYPE_NO_ROUTE)
+		    sendRouting(RH_ROUTER_MESSAGE_TYPE_NO_ROUTE, _flightSource, _flightDest);
+	    }
+	}
+    }
+    if (_flightCallback)
+	_flightCallback(acked, retries, _flightArg);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::hopSent(bool acked, uint8_t retries, void* arg)
+{
+    ((RHRouter*)arg)->hopDone(acked, retries);
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHRouter::routeTime()
+{
+    return millis() / 1000;
+}
@@ -0,0 +1,264 @@
+// RHRouter.h
+//
+// Multi-hop routing on top of RHReliableDatagram
+// Contributed by Juha Yrjölä and used with permission
+
+#ifndef RHRouter_h
+#define RHRouter_h
+
+#include <RHReliableDatagram.h>
+
+// Largest routed frame (router header and payload) that can be queued.
+// Messages are further limited by the maxMessageLength() of the driver.
+#ifndef RH_ROUTER_MAX_FRAME_LEN
+ #define RH_ROUTER_MAX_FRAME_LEN 32
+#endif
+
+// Number of frames, own and forwarded, that can wait for the radio
+#ifndef RH_ROUTER_QUEUE_LEN
+ #define RH_ROUTER_QUEUE_LEN 4
+#endif
+
+// The default maximum number of hops a message may travel
+#define RH_ROUTER_DEFAULT_MAX_HOPS 4
+
+// Routes not used or refreshed for this many seconds are forgotten
+#ifndef RH_ROUTER_ROUTE_TIMEOUT
+ #define RH_ROUTER_ROUTE_TIMEOUT 300
+#endif
+
+// How long messages wait for route discovery, in milliseconds
+#ifndef RH_ROUTER_DISCOVERY_TIMEOUT
+ #define RH_ROUTER_DISCOVERY_TIMEOUT 1000
+#endif
+
+// Number of recent route requests remembered, so that each is rebroadcast once
+#define RH_ROUTER_SEEN_LEN 8
+
+// How often poll() wants to be called while messages wait for a route, in milliseconds
+#define RH_ROUTER_POLL_INTERVAL 10
+
+// Types of routed messages
+#define RH_ROUTER_MESSAGE_TYPE_DATA              0
+#define RH_ROUTER_MESSAGE_TYPE_ROUTE_REQUEST     1
+#define RH_ROUTER_MESSAGE_TYPE_ROUTE_REPLY       2
+#define RH_ROUTER_MESSAGE_TYPE_NO_ROUTE          3
+
+// Error codes
+#define RH_ROUTER_ERROR_NONE              0
+#define RH_ROUTER_ERROR_INVALID_LENGTH    1
+#define RH_ROUTER_ERROR_QUEUE_FULL        2
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHRouter RHRouter.h <RHRouter.h>
+/// \brief RHReliableDatagram subclass for sending addressed, reliable messages over multiple hops
+///
+/// Every message carries a router header with the final destination, the original source,
+/// the number of hops travelled so far, a sequence number of the source and the message type.
+/// Each hop is sent with RHReliableDatagram::sendtoAsync(), so every hop is acknowledged and
+/// retransmitted, and relaying never blocks: received messages for other nodes are put in a small
+/// queue and sent from poll(). Delivery is hop by hop: the callback of sendtoAsync() tells whether
+/// the first hop acknowledged the message, not whether it reached its destination.
+///
+/// \par Routing table
+///
+/// The routing table has an entry for every possible address, holding the next hop, the number of
+/// hops to the destination and when the route was last confirmed, so lookups take constant time.
+/// Routes are learned from all received traffic: the neighbour that relayed a message is one hop away,
+/// and its source is reached through that neighbour. Routes are refreshed whenever a message is
+/// received from the destination or a hop through them is acknowledged, and are forgotten after
+/// RH_ROUTER_ROUTE_TIMEOUT seconds without that, or as soon as the next hop stops acknowledging.
+///
+/// \par Route discovery
+///
+/// A message to a destination without a route waits in the queue while a route request is flooded
+/// with broadcasts; every node rebroadcasts each request once, up to the maximum hops. The destination
+/// answers with a route reply routed back along the reverse path, which every node on the way learns
+/// the route from. Messages still without a route after RH_ROUTER_DISCOVERY_TIMEOUT milliseconds fail.
+/// When a relay cannot deliver a message to its next hop, it tells the source with a no-route message,
+/// so that the source discovers a new route for the next message.
+///
+/// Broadcasts sent with sendtoAsync() only reach the neighbours of this node.
+class RHRouter : public RHReliableDatagram
+{
+public:
+    /// The header of every routed message, in front of the payload
+    typedef struct
+    {
+	uint8_t    dest;       ///< Final destination
+	uint8_t    source;     ///< Originator
+	uint8_t    hops;       ///< Hops travelled so far
+	uint8_t    id;         ///< Sequence number of the source
+	uint8_t    type;       ///< One of RH_ROUTER_MESSAGE_TYPE_*
+    } RoutedMessageHeader;
+
+    /// A route to a destination
+    typedef struct
+    {
+	uint8_t    nextHop;    ///< Neighbour to send to, RH_BROADCAST_ADDRESS if there is no route
+	uint8_t    hops;       ///< Hops to the destination
+	uint16_t   updated;    ///< Seconds (from millis()) when the route was last confirmed
+    } RoutingTableEntry;
+
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHRouter(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Initialises this instance and the radio module connected to it,
+    /// and clears the routing table.
+    /// \return true if initialisation succeeded.
+    bool init();
+
+    /// Sets the maximum number of hops a message may travel, and a route request may be flooded.
+    /// \param[in] maxHops The maximum number of hops
+    void setMaxHops(uint8_t maxHops);
+
+    /// Queues a message for the destination, through as many hops as needed.
+    /// Returns immediately; the message is sent by poll() once the radio is free and a route is known,
+    /// discovering a route first if needed. The message is copied.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] dest The address of the final destination
+    /// \param[in] callback Called when the first hop has acknowledged the message, or it failed. May be NULL.
+    /// \param[in] arg Passed to callback
+    /// \return RH_ROUTER_ERROR_NONE if the message was queued,
+    /// RH_ROUTER_ERROR_INVALID_LENGTH or RH_ROUTER_ERROR_QUEUE_FULL otherwise
+    uint8_t sendtoAsync(const uint8_t* buf, uint8_t len, uint8_t dest, RHSendCallback callback, void* arg);
+
+    /// Advances the sending: completes the hop in flight, starts the next queued message,
+    /// fails messages whose route discovery has timed out. Never blocks.
+    /// Call this when the number of milliseconds it last returned has elapsed, or sooner,
+    /// and after receiving messages with recvfromAck().
+    /// \return Milliseconds until poll() should be called again, 0 if nothing is queued or in flight
+    uint16_t poll();
+
+    /// Tells whether a message can be queued with sendtoAsync()
+    /// \return true if the queue is full
+    bool queueFull();
+
+    /// Receives a message for this node. Messages for other nodes are queued for forwarding,
+    /// and routing messages are handled, with false returned for both.
+    /// The acknowledgement to the previous hop is sent as by RHReliableDatagram::recvfromAck().
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Available space in buf. Set to the actual number of octets copied.
+    /// \param[in] source If present and not NULL, the referenced uint8_t will be set to the originator
+    /// \param[in] dest If present and not NULL, the referenced uint8_t will be set to the destination
+    /// (this node or RH_BROADCAST_ADDRESS)
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the sequence number of the source
+    /// \param[in] hops If present and not NULL, the referenced uint8_t will be set to the hops travelled
+    /// \return true if a message for this node was copied to buf
+    bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* hops = NULL);
+
+    /// Adds or replaces the route to a destination. An existing route is only replaced by one
+    /// through the same next hop, or one with no more hops.
+    /// \param[in] dest The destination
+    /// \param[in] nextHop The neighbour to send messages for dest to
+    /// \param[in] hops Number of hops to dest
+    void addRouteTo(uint8_t dest, uint8_t nextHop, uint8_t hops);
+
+    /// Finds the route to a destination
+    /// \param[in] dest The destination
+    /// \return The route, or NULL if there is none or it has timed out
+    RoutingTableEntry* getRouteTo(uint8_t dest);
+
+    /// Forgets the route to a destination
+    /// \param[in] dest The destination
+    void deleteRouteTo(uint8_t dest);
+
+    /// Forgets all routes
+    void clearRoutingTable();
+
+    /// \return Number of messages relayed for other nodes
+    uint32_t forwarded();
+
+    /// \return Number of messages dropped: queue full, too many hops, no route or not acknowledged
+    /// by the next hop
+    uint32_t dropped();
+
+    /// \return Number of route discoveries started by this node
+    uint32_t discoveries();
+
+protected:
+    /// A frame waiting for the radio
+    typedef struct
+    {
+	uint8_t          len;          ///< Header and payload
+	bool             waitRoute;    ///< Route discovery started for the destination
+	unsigned long    deadline;     ///< millis() when route discovery times out
+	RHSendCallback   callback;
+	void*            arg;
+	uint8_t          frame[RH_ROUTER_MAX_FRAME_LEN];
+    } QueueEntry;
+
+    /// Appends a frame to the queue
+    /// \return false if the queue is full
+    bool enqueue(const RoutedMessageHeader* header, const uint8_t* payload, uint8_t len, RHSendCallback callback, void* arg);
+
+    /// Queues a routing message originated by this node, with a one octet payload
+    void sendRouting(uint8_t type, uint8_t dest, uint8_t target);
+
+    /// Relays a received frame towards its destination
+    void forward(uint8_t len);
+
+    /// Starts sending the first frame that has a route, and route discovery for those that do not
+    void sendNext();
+
+    /// Removes entry i from the queue
+    void dequeue(uint8_t i);
+
+    /// Forgets all routes through the neighbour
+    void deleteRoutesVia(uint8_t nextHop);
+
+    /// Remembers a route request, returning true if it has been seen before
+    bool seenRequest(uint8_t source, uint8_t id);
+
+    /// Called by RHReliableDatagram when the hop in flight has been acknowledged or failed
+    void hopDone(bool acked, uint8_t retries);
+
+    /// The RHSendCallback for hops
+    static void hopSent(bool acked, uint8_t retries, void* arg);
+
+    /// Current time for the routing table, in seconds
+    static uint16_t routeTime();
+
+    /// Maximum hops, see setMaxHops()
+    uint8_t             _maxHops;
+
+    /// Sequence number of the last data message originated here. Without gaps from
+    /// the routing messages, so that receivers can count lost data messages.
+    uint8_t             _lastId;
+
+    /// Sequence number of the last routing message originated here
+    uint8_t             _lastRoutingId;
+
+    /// The routing table, indexed by destination
+    RoutingTableEntry   _routes[RH_BROADCAST_ADDRESS];
+
+    /// Frames waiting for the radio, oldest first
+    QueueEntry          _queue[RH_ROUTER_QUEUE_LEN];
+    uint8_t             _queueLen;
+
+    /// The frame being sent by RHReliableDatagram
+    uint8_t             _flightNextHop;
+    uint8_t             _flightSource;
+    uint8_t             _flightDest;
+    uint8_t             _flightType;
+    RHSendCallback      _flightCallback;
+    void*               _flightArg;
+
+    /// Recent route requests, see seenRequest()
+    uint8_t             _seenSource[RH_ROUTER_SEEN_LEN];
+    uint8_t             _seenId[RH_ROUTER_SEEN_LEN];
+    uint8_t             _seenNext;
+
+    /// Received frame
+    uint8_t             _tmpFrame[RH_ROUTER_MAX_FRAME_LEN];
+
+    /// Counters
+    uint32_t            _forwarded;
+    uint32_t            _dropped;
+    uint32_t            _discoveries;
+};
+
+#endif
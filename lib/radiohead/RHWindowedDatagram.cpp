@@ -0,0 +1,417 @@
+// RHWindowedDatagram.cpp
+//
+// Pipelined reliable datagrams with a sliding window and selective acknowledgements
+// Contributed by Juha Yrjölä and used with permission
+
+#include <RHWindowedDatagram.h>
+
+// Sequence numbers wrap: compare them by their signed distance
+static int8_t seqDiff(uint8_t a, uint8_t b)
+{
+    return (int8_t)(a - b);
+}
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHWindowedDatagram::RHWindowedDatagram(RHGenericDriver& driver, uint8_t thisAddress)
+    : RHDatagram(driver, thisAddress)
+{
+    _window = 8;
+    _timeout = RH_WINDOWED_DEFAULT_TIMEOUT;
+    _retries = RH_DEFAULT_RETRIES;
+    _epoch = 0;
+    memset(_txSeq, 0, sizeof(_txSeq));
+    memset(_tx, 0, sizeof(_tx));
+    _txHead = 0;
+    _txCount = 0;
+    _waiting = false;
+    memset(_rx, 0, sizeof(_rx));
+    _rxNext = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+////////////////////////////////////////////////////////////////////
+// Public methods
+bool RHWindowedDatagram::init()
+{
+    bool ret = RHDatagram::init();
+    _epoch = random(0, 256);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::setWindow(uint8_t window)
+{
+    if (window < 1)
+	window = 1;
+    if (window > RH_WINDOWED_MAX_WINDOW)
+	window = RH_WINDOWED_MAX_WINDOW;
+    _window = window;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::setTimeout(uint16_t timeout)
+{
+    _timeout = timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::setRetries(uint8_t retries)
+{
+    _retries = retries;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHWindowedDatagram::maxMessageLength()
+{
+    uint8_t len = _driver.maxMessageLength();
+
+    if (len > RH_WINDOWED_MAX_FRAME_LEN)
+	len = RH_WINDOWED_MAX_FRAME_LEN;
+    return len - RH_WINDOWED_HEADER_LEN;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHWindowedDatagram::sendtoWindow(const uint8_t* buf, uint8_t len, uint8_t address, RHSendCallback callback, void* arg)
+{
+    if (   !windowFree()
+	|| len > maxMessageLength()
+	|| address == RH_BROADCAST_ADDRESS)
+	return false;
+
+    TxSlot* slot = txSlot(_txCount++);
+    slot->state = TxQueued;
+    slot->dest = address;
+    slot->seq = _txSeq[address]++;
+    slot->tries = 0;
+    slot->len = len;
+    memcpy(slot->buf, buf, len);
+    slot->callback = callback;
+    slot->arg = arg;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHWindowedDatagram::windowFree()
+{
+    return _txCount < _window ? _window - _txCount : 0;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHWindowedDatagram::poll()
+{
+    bool probe = false;
+    TxSlot* last = NULL;
+    uint8_t dest, i;
+
+    if (_waiting)
+    {
+	int32_t timeLeft = _deadline - millis();
+	if (timeLeft > 0)
+	    return timeLeft;
+	// No answer: ask again with the oldest message
+	_waiting = false;
+	probe = true;
+    }
+
+    reclaim();
+    if (!_txCount)
+	return 0;
+    // One destination at a time, the one of the oldest message
+    dest = txSlot(0)->dest;
+    // An answer that came too late leaves nothing queued: ask again
+    for (i = 0; i < _txCount && !probe; i++)
+    {
+	if (txSlot(i)->state == TxQueued && txSlot(i)->dest == dest)
+	    break;
+    }
+    if (i == _txCount)
+	probe = true;
+
+    for (i = 0; i < _txCount; i++)
+    {
+	TxSlot* slot = txSlot(i);
+	if (slot->state == TxFree || slot->dest != dest)
+	    continue;
+	if (probe || slot->state == TxQueued)
+	{
+	    if (slot->tries > _retries)
+	    {
+		finish(slot, false);
+		continue;
+	    }
+	    // Every frame is sent before the next one, so that only the last one asks
+	    if (last)
+		transmit(last, false);
+	    last = slot;
+	    if (probe)
+		break;
+	}
+    }
+    if (!last)
+    {
+	// Everything to dest failed
+	reclaim();
+	return _txCount ? 1 : 0;
+    }
+    transmit(last, true);
+
+    _waiting = true;
+    _waitDest = dest;
+    // Random between _timeout and _timeout*2, as in RHReliableDatagram
+    _deadline = millis() + _timeout + (_timeout * random(0, 256) / 256);
+    return _deadline - millis();
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHWindowedDatagram::recvfromWindow(uint8_t* buf, uint8_t* len, uint8_t* from)
+{
+    uint8_t frame[RH_WINDOWED_MAX_FRAME_LEN];
+    uint8_t frameLen, _from, _to, _id, _flags, i;
+
+    while (available())
+    {
+	frameLen = sizeof(frame);
+	if (!recvfrom(frame, &frameLen, &_from, &_to, &_id, &_flags))
+	    continue;
+	if (!(_flags & RH_FLAGS_WINDOW) || _to != _thisAddress)
+	    continue;
+	if (_flags & RH_FLAGS_ACK)
+	    handleAck(_from, _id, frame, frameLen);
+	else
+	    handleData(_from, _id, _flags, frame, frameLen);
+    }
+
+    // The next message of each sender in turn
+    for (i = 0; i < RH_WINDOWED_RX_SENDERS; i++)
+    {
+	RxSender* s = &_rx[(_rxNext + i) % RH_WINDOWED_RX_SENDERS];
+	uint8_t index = s->next % RH_WINDOWED_MAX_WINDOW;
+
+	if (!s->used)
+	    continue;
+	rxSkip(s);
+	if (!(s->held & (1UL << index)))
+	    continue;
+	if (*len > s->len[index])
+	    *len = s->len[index];
+	memcpy(buf, s->buf[index], *len);
+	if (from)
+	    *from = s->from;
+	s->held &= ~(1UL << index);
+	s->next++;
+	_rxNext = (_rxNext + i + 1) % RH_WINDOWED_RX_SENDERS;
+	return true;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+const RHWindowedDatagram::Stats& RHWindowedDatagram::stats()
+{
+    return _stats;
+}
+
+////////////////////////////////////////////////////////////////////
+// Sending
+RHWindowedDatagram::TxSlot* RHWindowedDatagram::txSlot(uint8_t index)
+{
+    return &_tx[(_txHead + index) % RH_WINDOWED_MAX_WINDOW];
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHWindowedDatagram::txBase(uint8_t dest)
+{
+    for (uint8_t i = 0; i < _txCount; i++)
+    {
+	TxSlot* slot = txSlot(i);
+	if (slot->state != TxFree && slot->dest == dest)
+	    return slot->seq;
+    }
+    return _txSeq[dest];
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::transmit(TxSlot* slot, bool ackRequest)
+{
+    uint8_t frame[RH_WINDOWED_MAX_FRAME_LEN];
+
+    frame[0] = _epoch;
+    frame[1] = txBase(slot->dest);
+    memcpy(frame + RH_WINDOWED_HEADER_LEN, slot->buf, slot->len);
+    setHeaderId(slot->seq);
+    setHeaderFlags(RH_FLAGS_WINDOW | (ackRequest ? RH_FLAGS_WINDOW_ACKREQ : 0),
+		   RH_FLAGS_ACK | (ackRequest ? 0 : RH_FLAGS_WINDOW_ACKREQ));
+    if (slot->tries++)
+	_stats.retransmissions++;
+    _stats.txFrames++;
+    // A failed send is a lost try, noticed when the answer does not come
+    sendto(frame, slot->len + RH_WINDOWED_HEADER_LEN, slot->dest);
+    waitPacketSent();
+    slot->state = TxSent;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::finish(TxSlot* slot, bool acked)
+{
+    uint8_t retries = slot->tries ? slot->tries - 1 : 0;
+
+    slot->state = TxFree;
+    if (!acked)
+	_stats.failed++;
+    if (slot->callback)
+	slot->callback(acked, retries, slot->arg);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::reclaim()
+{
+    while (_txCount && txSlot(0)->state == TxFree)
+    {
+	_txHead = (_txHead + 1) % RH_WINDOWED_MAX_WINDOW;
+	_txCount--;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::handleAck(uint8_t from, uint8_t next, const uint8_t* payload, uint8_t len)
+{
+    uint32_t bitmap;
+    uint8_t i;
+
+    if (len < 5 || payload[0] != _epoch)
+	return; // Answers a previous run of this node
+    bitmap = ((uint32_t)payload[1] << 24) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 8) | payload[4];
+
+    for (i = 0; i < _txCount; i++)
+    {
+	TxSlot* slot = txSlot(i);
+	if (slot->state == TxFree || slot->dest != from)
+	    continue;
+	int8_t d = seqDiff(slot->seq, next);
+	if (d < 0 || (d > 0 && d <= 32 && (bitmap & (1UL << (d - 1)))))
+	    finish(slot, true);
+	else if (_waiting && from == _waitDest && slot->state == TxSent)
+	    slot->state = TxQueued; // Lost: in the next burst
+    }
+    if (_waiting && from == _waitDest)
+	_waiting = false;
+    reclaim();
+}
+
+////////////////////////////////////////////////////////////////////
+// Receiving
+RHWindowedDatagram::RxSender* RHWindowedDatagram::rxSender(uint8_t from, uint8_t epoch, uint8_t base)
+{
+    RxSender* s = NULL;
+    uint8_t i;
+
+    for (i = 0; i < RH_WINDOWED_RX_SENDERS; i++)
+    {
+	if (_rx[i].used && _rx[i].from == from)
+	{
+	    s = &_rx[i];
+	    break;
+	}
+    }
+    if (s && s->epoch == epoch)
+	return s;
+    if (s)
+    {
+	// The sender has restarted: what it sent before will not be completed
+	_stats.rxRestarts++;
+    }
+    else
+    {
+	// The sender heard from longest ago that has nothing to hand over
+	for (i = 0; i < RH_WINDOWED_RX_SENDERS; i++)
+	{
+	    RxSender* t = &_rx[i];
+	    if (t->used && t->held)
+		continue;
+	    if (!s || !t->used || (s->used && (long)(t->lastRx - s->lastRx) < 0))
+		s = t;
+	}
+	if (!s)
+	    return NULL;
+    }
+    s->used = true;
+    s->from = from;
+    s->epoch = epoch;
+    s->next = base;
+    s->skipTo = base;
+    s->held = 0;
+    return s;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::rxSkip(RxSender* s)
+{
+    while (seqDiff(s->skipTo, s->next) > 0 && !(s->held & (1UL << (s->next % RH_WINDOWED_MAX_WINDOW))))
+	s->next++;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::handleData(uint8_t from, uint8_t seq, uint8_t flags, const uint8_t* frame, uint8_t len)
+{
+    if (len < RH_WINDOWED_HEADER_LEN)
+	return;
+    RxSender* s = rxSender(from, frame[0], frame[1]);
+    if (!s)
+    {
+	// Not acknowledged: the sender tries again later
+	_stats.rxNoRoom++;
+	return;
+    }
+    s->lastRx = millis();
+    // The sender has given up on the messages before its oldest one
+    if (seqDiff(frame[1], s->skipTo) > 0)
+	s->skipTo = frame[1];
+    rxSkip(s);
+
+    int8_t d = seqDiff(seq, s->next);
+    uint8_t index = seq % RH_WINDOWED_MAX_WINDOW;
+    if (d < 0 || (d < RH_WINDOWED_MAX_WINDOW && (s->held & (1UL << index))))
+	_stats.rxDuplicates++;
+    else if (d >= RH_WINDOWED_MAX_WINDOW)
+	_stats.rxOutOfWindow++;
+    else
+    {
+	s->len[index] = len - RH_WINDOWED_HEADER_LEN;
+	memcpy(s->buf[index], frame + RH_WINDOWED_HEADER_LEN, s->len[index]);
+	s->held |= 1UL << index;
+    }
+    if (flags & RH_FLAGS_WINDOW_ACKREQ)
+	acknowledge(s);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHWindowedDatagram::acknowledge(RxSender* s)
+{
+    uint8_t payload[5];
+    uint32_t bitmap = 0;
+    uint8_t next = s->next, i;
+
+    // Everything before next has been received, or given up on
+    while (   seqDiff(next, s->next) < RH_WINDOWED_MAX_WINDOW
+	   && (   (s->held & (1UL << (next % RH_WINDOWED_MAX_WINDOW)))
+	       || seqDiff(s->skipTo, next) > 0))
+	next++;
+    for (i = 0; i < 32; i++)
+    {
+	uint8_t seq = next + 1 + i;
+	if (   seqDiff(seq, s->next) < RH_WINDOWED_MAX_WINDOW
+	    && (s->held & (1UL << (seq % RH_WINDOWED_MAX_WINDOW))))
+	    bitmap |= 1UL << i;
+    }
+    payload[0] = s->epoch;
+    payload[1] = bitmap >> 24;
+    payload[2] = bitmap >> 16;
+    payload[3] = bitmap >> 8;
+    payload[4] = bitmap;
+    setHeaderId(next);
+    setHeaderFlags(RH_FLAGS_WINDOW | RH_FLAGS_ACK, RH_FLAGS_WINDOW_ACKREQ);
+    sendto(payload, sizeof(payload), s->from);
+    waitPacketSent();
+    _stats.acksSent++;
+}
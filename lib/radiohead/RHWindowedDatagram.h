@@ -0,0 +1,232 @@
+// RHWindowedDatagram.h
+//
+// Pipelined reliable datagrams with a sliding window and selective acknowledgements
+// Contributed by Juha Yrjölä and used with permission
+
+#ifndef RHWindowedDatagram_h
+#define RHWindowedDatagram_h
+
+#include <RHReliableDatagram.h>
+
+// Largest frame (window header and payload). Messages are further limited
+// by the maxMessageLength() of the driver.
+#ifndef RH_WINDOWED_MAX_FRAME_LEN
+ #define RH_WINDOWED_MAX_FRAME_LEN 32
+#endif
+
+// Most frames in flight, and most frames each receiver holds for reordering.
+// At most 32, the width of the selective acknowledgement bitmap.
+#ifndef RH_WINDOWED_MAX_WINDOW
+ #define RH_WINDOWED_MAX_WINDOW 16
+#endif
+
+// Number of senders whose frames can be reordered at the same time
+#ifndef RH_WINDOWED_RX_SENDERS
+ #define RH_WINDOWED_RX_SENDERS 4
+#endif
+
+// The default wait for a selective acknowledgement, in milliseconds
+#define RH_WINDOWED_DEFAULT_TIMEOUT 50
+
+// The header in front of the payload of every data frame
+#define RH_WINDOWED_HEADER_LEN 2
+
+// Flags of the windowed frames, in the bits reserved for RadioHead.
+// Acknowledgements also have RH_FLAGS_ACK.
+#define RH_FLAGS_WINDOW        0x40
+#define RH_FLAGS_WINDOW_ACKREQ 0x20
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHWindowedDatagram RHWindowedDatagram.h <RHWindowedDatagram.h>
+/// \brief RHDatagram subclass for sending many reliable datagrams back to back
+///
+/// RHReliableDatagram sends one message and waits for its ack before sending the next, so a
+/// transfer of many messages spends most of its time waiting. RHWindowedDatagram keeps up to a
+/// window of messages in flight and acknowledges them together, which is selective repeat ARQ:
+///
+/// - Messages are numbered per destination. sendtoWindow() queues a message if the window has room,
+///   and poll() sends all the queued messages to a destination back to back, as a burst. The last
+///   frame of the burst asks for an acknowledgement.
+/// - The receiver answers with the next number it expects and a bitmap of the messages it holds
+///   after that one. The sender completes the acknowledged messages and sends the missing ones
+///   again in the next burst, together with new messages. Without an answer in the timeout
+///   (random between the timeout and twice the timeout), the oldest message asks again.
+/// - Each message is sent at most retries + 1 times. Then it fails, and the sender moves on.
+/// - The receiver keeps a duplicate window per sender: messages before the next expected one and
+///   messages already held are dropped. It holds up to RH_WINDOWED_MAX_WINDOW messages after the
+///   next expected one, and hands them to the application in order with recvfromWindow(). Messages
+///   the sender has given up on are skipped: every frame carries the oldest number the sender
+///   still sends.
+/// - Every frame carries a random epoch of the sender, which changes when it restarts, so that the
+///   receiver starts over instead of taking the new messages for old ones.
+///
+/// Frames have RH_FLAGS_WINDOW, and a 2 octet header in front of the payload: the epoch and the
+/// oldest number. Acknowledgements have the next expected number in the ID header, and the
+/// epoch and a 32 bit bitmap (bit 0 for the next number after the ID) as the payload.
+///
+/// Messages not sent by an RHWindowedDatagram are ignored, so all nodes on the network that talk to
+/// each other must use it. Broadcasts are not supported.
+///
+/// Nothing blocks except the sending of each frame. Call recvfromWindow() often, as it also takes in
+/// the acknowledgements, and poll() after it and when the time it last returned has elapsed.
+class RHWindowedDatagram : public RHDatagram
+{
+public:
+    /// Counters of a manager
+    typedef struct
+    {
+	uint32_t   txFrames;         ///< Data frames sent, retransmissions included
+	uint32_t   retransmissions;
+	uint32_t   failed;           ///< Messages given up on
+	uint32_t   acksSent;
+	uint32_t   rxDuplicates;     ///< Messages received again
+	uint32_t   rxOutOfWindow;    ///< Dropped as too far ahead, the application is behind
+	uint32_t   rxNoRoom;         ///< Dropped from a sender with no room to reorder its messages
+	uint32_t   rxRestarts;       ///< Senders that restarted
+    } Stats;
+
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHWindowedDatagram(RHGenericDriver& driver, uint8_t thisAddress = 0);
+
+    /// Initialises this instance and the radio module connected to it, and picks a new epoch.
+    /// \return true if initialisation succeeded.
+    bool init();
+
+    /// Sets the number of messages that may be in flight
+    /// \param[in] window 1 to RH_WINDOWED_MAX_WINDOW. Defaults to 8.
+    void setWindow(uint8_t window);
+
+    /// Sets the wait for an acknowledgement after each burst. Defaults to RH_WINDOWED_DEFAULT_TIMEOUT.
+    /// \param[in] timeout Milliseconds
+    void setTimeout(uint16_t timeout);
+
+    /// Sets the number of retransmissions of each message. Defaults to RH_DEFAULT_RETRIES.
+    void setRetries(uint8_t retries);
+
+    /// \return The longest message that can be sent
+    uint8_t maxMessageLength();
+
+    /// Queues a message. Returns immediately; poll() sends it. The message is copied.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to, not RH_BROADCAST_ADDRESS
+    /// \param[in] callback Called when the message has been acknowledged, or failed. May be NULL.
+    /// \param[in] arg Passed to callback
+    /// \return false if the window is full or the message is too long
+    bool sendtoWindow(const uint8_t* buf, uint8_t len, uint8_t address, RHSendCallback callback, void* arg);
+
+    /// \return The number of messages that can be queued with sendtoWindow() now
+    uint8_t windowFree();
+
+    /// Advances the sending: sends the next burst when the last one has been answered, and
+    /// asks again when the answer has not come in time.
+    /// \return Milliseconds until poll() should be called again, 0 if nothing is in flight
+    uint16_t poll();
+
+    /// Takes in the received frames: stores the messages, answers the frames that ask for an
+    /// acknowledgement and completes the messages acknowledged. Then copies the next message
+    /// of any sender, in the order each sender sent them.
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Available space in buf. Set to the actual number of octets copied.
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the SRC address
+    /// \return true if a message was copied to buf
+    bool recvfromWindow(uint8_t* buf, uint8_t* len, uint8_t* from = NULL);
+
+    /// \return The counters of this manager
+    const Stats& stats();
+
+protected:
+    /// States of a message in the send window
+    typedef enum
+    {
+	TxFree = 0,     ///< Done, or never used
+	TxQueued,       ///< To be sent in the next burst
+	TxSent          ///< Sent, waiting for the acknowledgement
+    } TxState;
+
+    /// A message in the send window
+    typedef struct
+    {
+	uint8_t         state;
+	uint8_t         dest;
+	uint8_t         seq;
+	uint8_t         tries;
+	uint8_t         len;
+	uint8_t         buf[RH_WINDOWED_MAX_FRAME_LEN - RH_WINDOWED_HEADER_LEN];
+	RHSendCallback  callback;
+	void*           arg;
+    } TxSlot;
+
+    /// Messages received from one sender
+    typedef struct
+    {
+	bool            used;
+	uint8_t         from;
+	uint8_t         epoch;
+	uint8_t         next;         ///< Next number to hand to the application
+	uint8_t         skipTo;       ///< Messages before this one will not come
+	uint32_t        held;         ///< Bit (n % RH_WINDOWED_MAX_WINDOW) for each message n held
+	unsigned long   lastRx;       ///< millis()
+	uint8_t         len[RH_WINDOWED_MAX_WINDOW];
+	uint8_t         buf[RH_WINDOWED_MAX_WINDOW][RH_WINDOWED_MAX_FRAME_LEN - RH_WINDOWED_HEADER_LEN];
+    } RxSender;
+
+    /// \return The slot of the index-th message in the send window, the oldest first
+    TxSlot* txSlot(uint8_t index);
+
+    /// \return The number the oldest message to dest still in flight has, or the next number
+    uint8_t txBase(uint8_t dest);
+
+    /// Sends a data frame of a message in the send window
+    void transmit(TxSlot* slot, bool ackRequest);
+
+    /// Finishes a message and calls its callback
+    void finish(TxSlot* slot, bool acked);
+
+    /// Frees the finished messages at the start of the send window
+    void reclaim();
+
+    /// Completes the messages acknowledged by a received acknowledgement
+    void handleAck(uint8_t from, uint8_t next, const uint8_t* payload, uint8_t len);
+
+    /// Stores a received data frame, and answers it if it asks for an acknowledgement
+    void handleData(uint8_t from, uint8_t seq, uint8_t flags, const uint8_t* frame, uint8_t len);
+
+    /// \return The reordering state for the sender, starting over if it has restarted,
+    /// or NULL if there is no room for another sender
+    RxSender* rxSender(uint8_t from, uint8_t epoch, uint8_t base);
+
+    /// Moves past the messages the sender has given up on
+    void rxSkip(RxSender* s);
+
+    /// Sends an acknowledgement of everything held from a sender
+    void acknowledge(RxSender* s);
+
+private:
+    uint8_t        _window;
+    uint16_t       _timeout;
+    uint8_t        _retries;
+    uint8_t        _epoch;
+
+    /// Next number of the messages to each destination
+    uint8_t        _txSeq[256];
+
+    /// The send window, a ring of _txCount messages from _txHead
+    TxSlot         _tx[RH_WINDOWED_MAX_WINDOW];
+    uint8_t        _txHead;
+    uint8_t        _txCount;
+
+    /// Waiting for the answer to the last burst, from _waitDest, until _deadline
+    bool           _waiting;
+    uint8_t        _waitDest;
+    unsigned long  _deadline;
+
+    RxSender       _rx[RH_WINDOWED_RX_SENDERS];
+    uint8_t        _rxNext;      ///< Sender to hand a message from first, for fairness
+
+    Stats          _stats;
+};
+
+#endif
@@ -8,17 +8,31 @@
 RH_NRF24::RH_NRF24(uint8_t chipEnablePin, uint8_t slaveSelectPin, RHGenericSPI& spi)
     :
     RHNRFSPIDriver(slaveSelectPin, spi),
-    _rxBufValid(0)
+    _rxBufValid(0),
+    _rxDrain(false),
+    _rxHead(0),
+    _rxCount(0),
+    _rxPipe(0),
+    _rxTime(0),
+    _rxRpd(-1),
+    _rpdStale(false),
+    _rxFifoFull(0),
+    _rxMaxDrained(0)
 {
     _configuration = RH_NRF24_EN_CRC | RH_NRF24_CRCO; // Default: 2 byte CRC enabled
     _chipEnablePin = chipEnablePin;
+    memset(_networkAddress, 0xe7, sizeof(_networkAddress)); // The chip default
+    _networkAddressLen = sizeof(_networkAddress);
 }
 
 bool RH_NRF24::init()
 {
+#if (RH_PLATFORM != RH_PLATFORM_ESP8266_MGOS)
     // Teensy with nRF24 is unreliable at 8MHz:
     // so is Arduino with RF73
+    // On Mongoose OS the frequency the SPI interface was constructed with is used
     _spi.setFrequency(RHGenericSPI::Frequency1MHz);
+#endif
     if (!RHNRFSPIDriver::init())
 	return false;
 
@@ -32,8 +46,10 @@ bool RH_NRF24::init()
     spiWriteRegister(RH_NRF24_REG_1C_DYNPD, RH_NRF24_DPL_ALL);
     // Enable dynamic payload length, disable payload-with-ack, enable noack
     spiWriteRegister(RH_NRF24_REG_1D_FEATURE, RH_NRF24_EN_DPL | RH_NRF24_EN_DYN_ACK);
-    // Disable auto ack
+    // Disable auto ack, until setAutoAck()
     spiWriteRegister(RH_NRF24_REG_01_EN_AA, 0);
+    spiWriteRegister(RH_NRF24_REG_04_SETUP_RETR, 0);
+    _hwAck = false;
     // Test if there is actually a device connected and responding
     // CAUTION: RFM73 and version 2.0 silicon may require ACTIVATE
     if (spiReadRegister(RH_NRF24_REG_1D_FEATURE) != (RH_NRF24_EN_DPL | RH_NRF24_EN_DYN_ACK))
@@ -119,9 +135,115 @@ bool RH_NRF24::setNetworkAddress(uint8_t* address, uint8_t len)
     spiWriteRegister(RH_NRF24_REG_03_SETUP_AW, len-2);	// Mapping [3..5] = [1..3]
     spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, len);
     spiBurstWriteRegister(RH_NRF24_REG_10_TX_ADDR, address, len);
+    memcpy(_networkAddress, address, len);
+    _networkAddressLen = len;
+    return true;
+}
+
+bool RH_NRF24::setAutoAck(bool enable, uint8_t retries, uint16_t delay)
+{
+    if (!enable)
+    {
+	_hwAck = false;
+	spiWriteRegister(RH_NRF24_REG_1D_FEATURE, RH_NRF24_EN_DPL | RH_NRF24_EN_DYN_ACK);
+	spiWriteRegister(RH_NRF24_REG_01_EN_AA, 0);
+	spiWriteRegister(RH_NRF24_REG_04_SETUP_RETR, 0);
+	spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, RH_NRF24_ERX_P0 | RH_NRF24_ERX_P1);
+	return setNetworkAddress(_networkAddress, _networkAddressLen);
+    }
+    if (retries > 15 || delay < 250 || delay > 4000)
+	return false;
+
+    _hwAck = true;
+    // Also allow messages with the acknowledgements
+    spiWriteRegister(RH_NRF24_REG_1D_FEATURE, RH_NRF24_EN_DPL | RH_NRF24_EN_DYN_ACK | RH_NRF24_EN_ACK_PAY);
+    spiWriteRegister(RH_NRF24_REG_04_SETUP_RETR, (((delay / 250) - 1) << 4) | retries);
+    setThisAddress(_thisAddress);
+    // Pipes 2-5 share all but the least significant byte with pipe 1
+    spiWriteRegister(RH_NRF24_REG_0C_RX_ADDR_P2, RH_BROADCAST_ADDRESS);
+    spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, RH_NRF24_ERX_P1 | RH_NRF24_ERX_P2);
+    spiWriteRegister(RH_NRF24_REG_01_EN_AA, RH_NRF24_ENAA_P0 | RH_NRF24_ENAA_P1);
+    return true;
+}
+
+void RH_NRF24::setThisAddress(uint8_t thisAddress)
+{
+    RHGenericDriver::setThisAddress(thisAddress);
+    if (_hwAck)
+    {
+	uint8_t address[5];
+	pipeAddress(thisAddress, address);
+	spiBurstWriteRegister(RH_NRF24_REG_0B_RX_ADDR_P1, address, _networkAddressLen);
+    }
+}
+
+bool RH_NRF24::setAckPayload(uint8_t to, uint8_t id, const uint8_t* data, uint8_t len)
+{
+    uint8_t buf[RH_NRF24_MAX_PAYLOAD_LEN];
+
+    if (!_hwAck || len > RH_NRF24_MAX_MESSAGE_LEN || _mode == RHModeTx)
+	return false;
+    if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_TX_FULL)
+	return false;
+
+    buf[0] = to;
+    buf[1] = _txHeaderFrom;
+    buf[2] = id;
+    buf[3] = 0;
+    memcpy(buf+RH_NRF24_HEADER_LEN, data, len);
+    // Everything addressed to us arrives on pipe 1
+    spiBurstWrite(RH_NRF24_COMMAND_W_ACK_PAYLOAD(1), buf, len + RH_NRF24_HEADER_LEN);
+    return true;
+}
+
+bool RH_NRF24::ackPayloadPending()
+{
+    return !(spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_TX_EMPTY);
+}
+
+void RH_NRF24::clearAckPayloads()
+{
+    flushTx();
+}
+
+bool RH_NRF24::recvAckPayload(uint8_t* buf, uint8_t* len)
+{
+    uint8_t rx[RH_NRF24_MAX_PAYLOAD_LEN];
+
+    // Acknowledgements arrive on pipe 0. RX_P_NO is 7 if the RX FIFO is empty.
+    if (!_hwAck || (statusRead() & RH_NRF24_RX_P_NO) != 0)
+	return false;
+    uint8_t rxLen = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
+    if (rxLen > RH_NRF24_MAX_PAYLOAD_LEN)
+    {
+	flushRx();
+	return false;
+    }
+    spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
+    spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, rx, rxLen);
+    if (rxLen < RH_NRF24_HEADER_LEN || rx[0] != _thisAddress)
+	return false;
+
+    _rxHeaderTo    = rx[0];
+    _rxHeaderFrom  = rx[1];
+    _rxHeaderId    = rx[2];
+    _rxHeaderFlags = rx[3];
+    _rxGood++;
+    if (buf && len)
+    {
+	if (*len > rxLen - RH_NRF24_HEADER_LEN)
+	    *len = rxLen - RH_NRF24_HEADER_LEN;
+	memcpy(buf, rx+RH_NRF24_HEADER_LEN, *len);
+    }
     return true;
 }
 
+void RH_NRF24::pipeAddress(uint8_t node, uint8_t* address)
+{
+    memcpy(address, _networkAddress, _networkAddressLen);
+    address[0] = node;
+}
+
 bool RH_NRF24::setRF(DataRate data_rate, TransmitPower power)
 {
     uint8_t value = (power << 1) & RH_NRF24_PWR;
@@ -136,15 +258,23 @@ bool RH_NRF24::setRF(DataRate data_rate, TransmitPower power)
     value |= RH_NRF24_LNA_HCURR;
     
     spiWriteRegister(RH_NRF24_REG_06_RF_SETUP, value);
-    // If we were using auto-ack, we would have to set the appropriate timeout in reg 4 here
-    // see NRF24::setRF()
+    // With auto-ack, the retransmit delay given to setAutoAck() must suit the data rate
     return true;
 }
 
+void RH_NRF24::leaveRx()
+{
+    // Leaving RX resets RPD. Payloads still in the RX FIFO lose theirs.
+    if (_mode == RHModeRx && _rxDrain &&
+	!(spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY))
+	_rpdStale = true;
+}
+
 void RH_NRF24::setModeIdle()
 {
     if (_mode != RHModeIdle)
     {
+	leaveRx();
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration);
 	digitalWrite(_chipEnablePin, LOW);
 	_mode = RHModeIdle;
@@ -155,6 +285,7 @@ bool RH_NRF24::sleep()
 {
     if (_mode != RHModeSleep)
     {
+	leaveRx();
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, 0); // Power Down mode
 	digitalWrite(_chipEnablePin, LOW);
 	_mode = RHModeSleep;
@@ -167,6 +298,10 @@ void RH_NRF24::setModeRx()
 {
     if (_mode != RHModeRx)
     {
+	// Pipe 0 only receives acknowledgements while transmitting. Left enabled,
+	// it would acknowledge messages to the last node we sent to.
+	if (_hwAck)
+	    spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, RH_NRF24_ERX_P1 | RH_NRF24_ERX_P2);
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration | RH_NRF24_PWR_UP | RH_NRF24_PRIM_RX);
 	digitalWrite(_chipEnablePin, HIGH);
 	_mode = RHModeRx;
@@ -177,6 +312,7 @@ void RH_NRF24::setModeTx()
 {
     if (_mode != RHModeTx)
     {
+	leaveRx();
 	// Its the CE rising edge that puts us into TX mode
 	// CE staying high makes us go to standby-II when the packet is sent
 	digitalWrite(_chipEnablePin, LOW);
@@ -207,7 +343,24 @@ bool RH_NRF24::send(const uint8_t* data, uint8_t len)
         flushTx();
         return false;
     }
-    spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK, _buf, len + RH_NRF24_HEADER_LEN);
+    uint8_t command = RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK;
+    if (_hwAck)
+    {
+	// Send to the pipe of the destination, and listen for the
+	// acknowledgement on the same address on pipe 0
+	uint8_t address[5];
+	pipeAddress(_txHeaderTo, address);
+	spiBurstWriteRegister(RH_NRF24_REG_10_TX_ADDR, address, _networkAddressLen);
+	if (_txHeaderTo != RH_BROADCAST_ADDRESS)
+	{
+	    spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, _networkAddressLen);
+	    spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, RH_NRF24_ERX_P0 | RH_NRF24_ERX_P1 | RH_NRF24_ERX_P2);
+	    command = RH_NRF24_COMMAND_W_TX_PAYLOAD;
+	}
+    }
+    _lastTxAcked = false;
+    _lastTxRetries = 0;
+    spiBurstWrite(command, _buf, len + RH_NRF24_HEADER_LEN);
     if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_TX_EMPTY) {
         printf("NRF24: TX didn't succeed\n");
         return false;
@@ -226,8 +379,7 @@ bool RH_NRF24::waitPacketSent()
 	return false;
 
     // Wait for either the Data Sent or Max ReTries flag, signalling the 
-    // end of transmission
-    // We dont actually use auto-ack, so prob dont expect to see RH_NRF24_MAX_RT
+    // end of transmission. RH_NRF24_MAX_RT is only seen with auto-ack.
     uint8_t status;
     uint32_t start = millis();
     while (!((status = statusRead()) & (RH_NRF24_TX_DS | RH_NRF24_MAX_RT)))
@@ -237,15 +389,43 @@ bool RH_NRF24::waitPacketSent()
 	YIELD;
     }
 
+    if (!(status & (RH_NRF24_TX_DS | RH_NRF24_MAX_RT)))
+	_txTimeouts++;
+    txDone(status);
+    // Return true if data sent, false if MAX_RT
+    return status & RH_NRF24_TX_DS;
+}
+
+bool RH_NRF24::packetSent()
+{
+    if (_mode != RHModeTx)
+	return true;
+
+    uint8_t status = statusRead();
+    if (!(status & (RH_NRF24_TX_DS | RH_NRF24_MAX_RT)))
+	return false;
+    txDone(status);
+    return true;
+}
+
+void RH_NRF24::txDone(uint8_t status)
+{
+    // With auto-ack, TX_DS means the message was acknowledged
+    _lastTxAcked = status & RH_NRF24_TX_DS;
+    if (_hwAck)
+    {
+	_lastTxRetries = spiReadRegister(RH_NRF24_REG_08_OBSERVE_TX) & RH_NRF24_ARC_CNT;
+	_txRetransmissions += _lastTxRetries;
+	// Counted here, since PLOS_CNT stops at 15
+	if (status & RH_NRF24_MAX_RT)
+	    _txLost++;
+    }
+
     // Must clear RH_NRF24_MAX_RT if it is set, else no further comm
     if (status & RH_NRF24_MAX_RT)
     	flushTx();
     setModeIdle();
     spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_TX_DS | RH_NRF24_MAX_RT);
-    if (!(status & RH_NRF24_TX_DS))
-        printf("NRF24 status: %02x %02x %02x\n", status, statusRead(), RH_NRF24_TX_DS);
-    // Return true if data sent, false if MAX_RT
-    return status & RH_NRF24_TX_DS;
 }
 
 bool RH_NRF24::isSending()
@@ -313,6 +493,14 @@ bool RH_NRF24::available()
 	if (_mode == RHModeTx)
 	    return false;
 	setModeRx();
+	if (_rxDrain)
+	{
+	    // Keep the receiver on, the FIFO gets drained on every call
+	    drainRx();
+	    while (!_rxBufValid && popRx())
+		validateRxBuf();
+	    return _rxBufValid;
+	}
 	if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY)
 	    return false;
 	// Manual says that messages > 32 octets should be discarded
@@ -343,6 +531,103 @@ void RH_NRF24::clearRxBuf()
     _bufLen = 0;
 }
 
+void RH_NRF24::setRxDrain(bool enable)
+{
+    _rxDrain = enable;
+    _rxHead = _rxCount = 0;
+}
+
+uint8_t RH_NRF24::drainRx()
+{
+    uint8_t n = 0;
+    RxSlot* slot = NULL;
+    bool empty = false;
+
+    if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_FULL)
+	_rxFifoFull++;
+    while (_rxCount < RH_NRF24_RX_RING_LEN)
+    {
+	// RX_P_NO is 7 once the RX FIFO is empty
+	uint8_t pipe = (statusRead() & RH_NRF24_RX_P_NO) >> 1;
+	if (pipe > 5)
+	{
+	    empty = true;
+	    break;
+	}
+	// Manual says that messages > 32 octets should be discarded
+	uint8_t len = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
+	if (len > RH_NRF24_MAX_PAYLOAD_LEN)
+	{
+	    flushRx();
+	    spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
+	    break;
+	}
+	slot = &_rxRing[(_rxHead + _rxCount) % RH_NRF24_RX_RING_LEN];
+	spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, slot->buf, len);
+	slot->len = len;
+	slot->pipe = pipe;
+	slot->time = millis();
+	slot->rpd = -1;
+	_rxCount++;
+	n++;
+	// Clear RX_DR only after reading the payload, then look at the FIFO again,
+	// so that a message arriving now raises a new interrupt
+	spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
+    }
+    // RPD holds for the last payload received, the newest one drained if
+    // the RX FIFO is now empty, unless the receiver has been off since it
+    // arrived. Sending a hardware ACK turns it off after every payload.
+    if (empty)
+    {
+	if (slot && !_hwAck && !_rpdStale)
+	    slot->rpd = (spiReadRegister(RH_NRF24_REG_09_RPD) & RH_NRF24_RPD) ? 1 : 0;
+	_rpdStale = false;
+    }
+    if (n > _rxMaxDrained)
+	_rxMaxDrained = n;
+    return n;
+}
+
+bool RH_NRF24::popRx()
+{
+    if (!_rxCount)
+	return false;
+    RxSlot* slot = &_rxRing[_rxHead];
+    memcpy(_buf, slot->buf, slot->len);
+    _bufLen = slot->len;
+    _rxPipe = slot->pipe;
+    _rxTime = slot->time;
+    _rxRpd = slot->rpd;
+    _rxHead = (_rxHead + 1) % RH_NRF24_RX_RING_LEN;
+    _rxCount--;
+    return true;
+}
+
+uint8_t RH_NRF24::lastRxPipe()
+{
+    return _rxPipe;
+}
+
+unsigned long RH_NRF24::lastRxTime()
+{
+    return _rxTime;
+}
+
+int8_t RH_NRF24::lastRxRpd()
+{
+    return _rxRpd;
+}
+
+uint16_t RH_NRF24::rxFifoFull()
+{
+    return _rxFifoFull;
+}
+
+uint8_t RH_NRF24::rxMaxDrained()
+{
+    return _rxMaxDrained;
+}
+
 bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
@@ -358,6 +643,48 @@ bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_NRF24::setSnifferPipes(const uint8_t* nodes, uint8_t n)
+{
+    uint8_t address[5];
+    uint8_t i;
+
+    if (n > 6)
+	return false;
+    // Never acknowledge: the frames are for someone else
+    setAutoAck(false);
+    if (!n)
+	return true;
+    pipeAddress(nodes[0], address);
+    spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, _networkAddressLen);
+    if (n > 1)
+    {
+	pipeAddress(nodes[1], address);
+	spiBurstWriteRegister(RH_NRF24_REG_0B_RX_ADDR_P1, address, _networkAddressLen);
+    }
+    // Pipes 2-5 share all but the least significant byte with pipe 1
+    for (i = 2; i < n; i++)
+	spiWriteRegister(RH_NRF24_REG_0C_RX_ADDR_P2 + i - 2, nodes[i]);
+    spiWriteRegister(RH_NRF24_REG_02_EN_RXADDR, (1 << n) - 1);
+    return true;
+}
+
+bool RH_NRF24::recvRaw(uint8_t* buf, uint8_t* len)
+{
+    if (!_rxDrain || _mode == RHModeTx)
+	return false;
+    // The RX FIFO is emptied on every call, so that it does not fill up
+    // while the frames in the ring are handled
+    setModeRx();
+    drainRx();
+    if (!popRx())
+	return false;
+    if (*len > _bufLen)
+	*len = _bufLen;
+    memcpy(buf, _buf, *len);
+    clearRxBuf();
+    return true;
+}
+
 uint8_t RH_NRF24::maxMessageLength()
 {
     return RH_NRF24_MAX_MESSAGE_LEN;
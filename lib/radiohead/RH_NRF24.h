@@ -22,6 +22,12 @@
 // the supported message lengths in the nRF24
 #define RH_NRF24_MAX_MESSAGE_LEN (RH_NRF24_MAX_PAYLOAD_LEN-RH_NRF24_HEADER_LEN)
 
+// Number of received payloads that can be held in software with setRxDrain().
+// At least the 3 of the nRF24 RX FIFO.
+#ifndef RH_NRF24_RX_RING_LEN
+ #define RH_NRF24_RX_RING_LEN 6
+#endif
+
 // SPI Command names
 #define RH_NRF24_COMMAND_R_REGISTER                        0x00
 #define RH_NRF24_COMMAND_W_REGISTER                        0x20
@@ -464,7 +470,8 @@ public:
     /// - Initialise the SPI output pins
     /// - Initialise the SPI interface library to 8MHz (Hint, if you want to lower
     /// the SPI frequency (perhaps where you have other SPI shields, low voltages etc), 
-    /// call SPI.setClockDivider() after init()).
+    /// call SPI.setClockDivider() after init()). On Mongoose OS the frequency given
+    /// to the RHHardwareSPI constructor is kept, the nRF24 is specified up to 10MHz.
     /// -Flush the receiver and transmitter buffers
     /// - Set the radio to receive with powerUpRx();
     /// \return  true if everything was successful
@@ -524,6 +531,116 @@ public:
     /// \return true on success, false if len is not in the range 3-5 inclusive.
     bool setNetworkAddress(uint8_t* address, uint8_t len);
 
+    /// Enables or disables Enhanced ShockBurst auto-acknowledgement and auto-retransmission.
+    /// When enabled, the receiving nRF24 acknowledges every message addressed to it within microseconds,
+    /// and the transmitting one retransmits it until it is acknowledged or retries is exhausted,
+    /// with no software timeouts involved. The result is available from lastTxAcked() as soon as
+    /// packetSent() or waitPacketSent() returns, and RHReliableDatagram no longer sends ACK messages.
+    /// Every node then has its own pipe address: the network address with the least significant byte
+    /// replaced by the RadioHead node address. Pipe 1 listens on the address of this node, pipe 2 on the
+    /// broadcast address, and pipe 0 is used for the acknowledgements while transmitting.
+    /// All nodes in the network must use the same setting.
+    /// Call this after init(), setNetworkAddress() and setThisAddress().
+    /// \param[in] enable true to enable hardware acknowledgement
+    /// \param[in] retries Number of retransmissions, 0 to 15
+    /// \param[in] delay Time to wait for the acknowledgement before retransmitting, in microseconds
+    /// (250 to 4000, in steps of 250). Must be at least 500 at 250kbps, and longer if the receiver
+    /// sends acknowledgements with payload.
+    /// \return true on success, false if the parameters are out of range
+    bool setAutoAck(bool enable, uint8_t retries = 5, uint16_t delay = 500);
+
+    /// Sets the address of this node. With auto-acknowledgement enabled, also sets the address
+    /// of pipe 1.
+    /// \param[in] thisAddress The address of this node.
+    virtual void setThisAddress(uint8_t thisAddress);
+
+    /// Queues a message to be sent with the acknowledgement of the next message received on pipe 1,
+    /// ie the next message addressed to this node. Costs no extra air time, and the receiving node
+    /// does not need to be listening. Requires auto-acknowledgement (see setAutoAck()).
+    /// The message gets the usual headers, so the node receiving the acknowledgement can tell
+    /// whether it was meant for it: the acknowledgement goes to whichever node sends next.
+    /// Up to 3 messages can be queued. Must not be called while transmitting.
+    /// \param[in] to The node the message is for
+    /// \param[in] id The ID header
+    /// \param[in] data The message
+    /// \param[in] len Number of octets in the message. At most RH_NRF24_MAX_MESSAGE_LEN.
+    /// \return true if the message was queued, false if the queue is full, auto-acknowledgement
+    /// is not enabled or the message is too long
+    bool setAckPayload(uint8_t to, uint8_t id, const uint8_t* data, uint8_t len);
+
+    /// Tells whether messages queued with setAckPayload() are still waiting to be sent.
+    /// \return true if the TX FIFO is not empty
+    bool ackPayloadPending();
+
+    /// Discards the messages queued with setAckPayload()
+    void clearAckPayloads();
+
+    /// Reads a message received with the acknowledgement of the last message sent,
+    /// after packetSent() or waitPacketSent() has returned. Only messages addressed to this node
+    /// are returned. The headers are available from headerFrom() etc. as for recv().
+    /// \param[in] buf Location to copy the message
+    /// \param[in,out] len Available space in buf. Set to the actual number of octets copied.
+    /// \return true if a message was copied to buf
+    bool recvAckPayload(uint8_t* buf, uint8_t* len);
+
+    /// Enables or disables draining the RX FIFO. When enabled, every call to available() moves all
+    /// payloads waiting in the 3-deep nRF24 RX FIFO into a software ring of RH_NRF24_RX_RING_LEN
+    /// payloads, clearing RX_DR after each one, and messages are then returned from the ring.
+    /// A burst of messages from several nodes no longer overflows the FIFO while the application
+    /// handles the first one, and the receiver stays on between messages.
+    /// \param[in] enable true to drain the RX FIFO
+    void setRxDrain(bool enable);
+
+    /// Moves all payloads waiting in the RX FIFO into the software ring, as far as there is room.
+    /// Called by available() when setRxDrain() is enabled.
+    /// \return Number of payloads moved
+    uint8_t drainRx();
+
+    /// The pipe the last message returned by available() / recv() was received on.
+    /// Only with setRxDrain().
+    /// \return The pipe number, 0 to 5
+    uint8_t lastRxPipe();
+
+    /// The time the last message returned by available() / recv() was moved out of the RX FIFO.
+    /// Only with setRxDrain().
+    /// \return millis() when drained
+    unsigned long lastRxTime();
+
+    /// The Received Power Detector (above -64 dBm) for the last message returned by available() / recv(),
+    /// as sampled by drainRx(). RPD only holds for the newest payload in the RX FIFO, and only until
+    /// the receiver is turned off, so it is unknown for the older payloads of a drain, for the ones
+    /// that waited while the radio was sending, and for all payloads with hardware acknowledgements.
+    /// Only with setRxDrain().
+    /// \return 1 if RPD was set, 0 if not, -1 if unknown
+    int8_t lastRxRpd();
+
+    /// Number of times drainRx() found the RX FIFO full, ie messages may have been lost
+    /// \return The count
+    uint16_t rxFifoFull();
+
+    /// Most payloads moved out of the RX FIFO by a single drainRx()
+    /// \return The count
+    uint8_t rxMaxDrained();
+
+    /// Sets the receiver up for sniffing the traffic of other nodes: hardware acknowledgements
+    /// are disabled, so that nothing is ever acknowledged, and the pipes listen on the addresses
+    /// other nodes send to. Without addresses, they listen on the network address, which all
+    /// nodes send to without hardware acknowledgements. With hardware acknowledgements, every
+    /// node has an address of its own (see setAutoAck()), and up to 6 of them can be listened on.
+    /// Use setPromiscuous() too, and recvRaw() to read the frames.
+    /// \param[in] nodes The addresses of the nodes whose frames to receive
+    /// \param[in] n Number of addresses, 0 to 6
+    /// \return false if n is out of range
+    bool setSnifferPipes(const uint8_t* nodes, uint8_t n);
+
+    /// Takes the next received frame as it was on the air, the 4 headers included, without
+    /// looking at the headers. Frames too short for the headers are returned too.
+    /// Only with setRxDrain(). lastRxPipe() tells the pipe it was received on.
+    /// \param[in] buf Location to copy the frame
+    /// \param[in,out] len Available space in buf. Set to the actual number of octets copied.
+    /// \return true if a frame was copied
+    bool recvRaw(uint8_t* buf, uint8_t* len);
+
     /// Sets the data rate and transmitter power to use. Note that the nRF24 and the RFM73 have different
     /// available power levels, and for convenience, 2 different sets of values are available in the 
     /// RH_NRF24::TransmitPower enum. The ones with the RFM73 only have meaning on the RFM73 and compatible
@@ -559,6 +676,12 @@ public:
     /// \return true on success, false if the chip is not in transmit mode or other transmit failure
     virtual bool waitPacketSent();
 
+    /// Checks without blocking whether the current message (if any)
+    /// has been transmitted. Once it has, returns the radio to idle mode
+    /// and clears the TX_DS and MAX_RT flags, like waitPacketSent().
+    /// \return true if no transmission is in progress
+    virtual bool packetSent();
+
     /// Indicates if the chip is in transmit mode and 
     /// there is a packet currently being transmitted
     /// \return true if the chip is in transmit mode and there is a transmission in progress
@@ -613,6 +736,20 @@ protected:
     /// Clear our local receive buffer
     void clearRxBuf();
 
+    /// Moves the oldest payload in the software ring to the receive buffer
+    /// \return false if the ring is empty
+    bool popRx();
+
+    /// Notes whether the payloads left in the RX FIFO lose their RPD as the receiver is turned off
+    void leaveRx();
+
+    /// Computes the pipe address of the given node for Enhanced ShockBurst
+    void pipeAddress(uint8_t node, uint8_t* address);
+
+    /// Finishes a transmission: updates the acknowledgement status and counters,
+    /// returns to idle mode and clears the TX_DS and MAX_RT flags
+    void txDone(uint8_t status);
+
 private:
     /// This idle mode chip configuration
     uint8_t             _configuration;
@@ -628,6 +765,42 @@ private:
 
     /// True when there is a valid message in the buffer
     bool                _rxBufValid;
+
+    /// A payload moved out of the RX FIFO by drainRx()
+    typedef struct
+    {
+	uint8_t          len;
+	uint8_t          pipe;
+	int8_t           rpd;
+	unsigned long    time;
+	uint8_t          buf[RH_NRF24_MAX_PAYLOAD_LEN];
+    } RxSlot;
+
+    /// True when the RX FIFO is drained into _rxRing, see setRxDrain()
+    bool                _rxDrain;
+
+    /// Payloads drained from the RX FIFO, oldest at _rxHead
+    RxSlot              _rxRing[RH_NRF24_RX_RING_LEN];
+    uint8_t             _rxHead;
+    uint8_t             _rxCount;
+
+    /// Pipe, drain time and RPD of the message in _buf
+    uint8_t             _rxPipe;
+    unsigned long       _rxTime;
+    int8_t              _rxRpd;
+
+    /// The receiver was turned off with payloads in the RX FIFO, their RPD is lost
+    bool                _rpdStale;
+
+    /// Counters for rxFifoFull() and rxMaxDrained()
+    uint16_t            _rxFifoFull;
+    uint8_t             _rxMaxDrained;
+
+    /// The network address, least significant byte first
+    uint8_t             _networkAddress[5];
+
+    /// Number of octets in the network address
+    uint8_t             _networkAddressLen;
 };
 
 /// @example nrf24_client.pde
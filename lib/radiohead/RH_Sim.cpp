@@ -0,0 +1,403 @@
+// RH_Sim.cpp
+//
+// Simulated radio driver and shared medium, for testing RadioHead on the host
+// Contributed by Juha Yrjölä and used with permission
+
+#include <RH_Sim.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+////////////////////////////////////////////////////////////////////
+// RHSimMedium
+RHSimMedium::RHSimMedium(uint16_t maxNodes, uint32_t bitRate)
+    : _maxNodes(maxNodes),
+      _nodes(0),
+      _bitRate(bitRate),
+      _latency(0),
+      _collisions(true),
+      _seed(1),
+      _airLen(0)
+{
+    _node = new RH_Sim*[maxNodes];
+    _loss = new float[(uint32_t)maxNodes * maxNodes];
+    // A few frames per node: its own, and acks queued behind it
+    _airMax = maxNodes * 4 + 16;
+    _air = new Transmission[_airMax];
+    memset(&_stats, 0, sizeof(_stats));
+    setLoss(0.0);
+}
+
+RHSimMedium::~RHSimMedium()
+{
+    delete[] _node;
+    delete[] _loss;
+    delete[] _air;
+}
+
+void RHSimMedium::setLoss(float loss)
+{
+    for (uint32_t i = 0; i < (uint32_t)_maxNodes * _maxNodes; i++)
+	_loss[i] = loss;
+}
+
+void RHSimMedium::setLinkLoss(uint16_t from, uint16_t to, float loss)
+{
+    if (from < _maxNodes && to < _maxNodes)
+	_loss[(uint32_t)from * _maxNodes + to] = loss;
+}
+
+float RHSimMedium::linkLoss(uint16_t from, uint16_t to)
+{
+    if (from >= _maxNodes || to >= _maxNodes)
+	return 1.0;
+    return _loss[(uint32_t)from * _maxNodes + to];
+}
+
+void RHSimMedium::setLatency(uint32_t us)
+{
+    _latency = us;
+}
+
+void RHSimMedium::setCollisions(bool enable)
+{
+    _collisions = enable;
+}
+
+void RHSimMedium::setSeed(uint32_t seed)
+{
+    _seed = seed ? seed : 1;
+}
+
+uint32_t RHSimMedium::airTime(uint8_t len)
+{
+    uint32_t bits = RH_SIM_FRAME_OVERHEAD_BITS + len * 8;
+
+    return (bits * 1000000 + _bitRate - 1) / _bitRate;
+}
+
+void RHSimMedium::advanceTo(uint64_t us)
+{
+    uint16_t i;
+
+    simSetMicros(us);
+    us = simMicros();
+
+    // Deliver the frames that have ended, in the order they ended
+    while (true)
+    {
+	Transmission* next = NULL;
+	for (i = 0; i < _airLen; i++)
+	{
+	    Transmission* t = &_air[i];
+	    if (!t->done && t->end <= us && (!next || t->end < next->end))
+		next = t;
+	}
+	if (!next)
+	    break;
+	deliver(next);
+	next->done = true;
+    }
+
+    // Forget the frames that can no longer collide with any frame on the medium
+    uint32_t maxAir = airTime(RH_SIM_MAX_PAYLOAD_LEN);
+    uint16_t kept = 0;
+    for (i = 0; i < _airLen; i++)
+    {
+	if (_air[i].done && _air[i].end + maxAir <= us)
+	    continue;
+	if (kept != i)
+	    _air[kept] = _air[i];
+	kept++;
+    }
+    _airLen = kept;
+}
+
+bool RHSimMedium::busy(uint16_t node)
+{
+    uint64_t now = simMicros();
+
+    for (uint16_t i = 0; i < _airLen; i++)
+    {
+	const Transmission* t = &_air[i];
+	if (t->start <= now && now < t->end && t->sender != node && linkLoss(t->sender, node) < 1.0)
+	    return true;
+    }
+    return false;
+}
+
+const RHSimMedium::Stats& RHSimMedium::stats()
+{
+    return _stats;
+}
+
+uint16_t RHSimMedium::nodes()
+{
+    return _nodes;
+}
+
+int RHSimMedium::attach(RH_Sim* node)
+{
+    if (_nodes >= _maxNodes)
+	return -1;
+    _node[_nodes] = node;
+    return _nodes++;
+}
+
+uint64_t RHSimMedium::transmit(uint16_t sender, const uint8_t* frame, uint8_t len)
+{
+    uint64_t start = simMicros();
+    uint16_t i;
+
+    // One frame at a time from each node
+    for (i = 0; i < _airLen; i++)
+    {
+	if (_air[i].sender == sender && _air[i].end > start)
+	    start = _air[i].end;
+    }
+
+    if (_airLen == _airMax)
+    {
+	// More frames queued than expected: make room
+	Transmission* air = new Transmission[_airMax * 2];
+	memcpy(air, _air, _airLen * sizeof(*_air));
+	delete[] _air;
+	_air = air;
+	_airMax *= 2;
+    }
+    Transmission* t = &_air[_airLen++];
+    t->sender = sender;
+    t->start = start;
+    t->end = start + airTime(len);
+    t->done = false;
+    t->len = len;
+    memcpy(t->frame, frame, len);
+    _stats.transmitted++;
+    return t->end;
+}
+
+void RHSimMedium::deliver(const Transmission* t)
+{
+    for (uint16_t node = 0; node < _nodes; node++)
+    {
+	if (node == t->sender)
+	    continue;
+	float loss = linkLoss(t->sender, node);
+	if (loss >= 1.0 || !_node[node]->accepts(t->frame[0]))
+	    continue;
+	if (!clear(t, node))
+	    continue;
+	if (chance(loss))
+	{
+	    _stats.lost++;
+	    continue;
+	}
+	if (!_node[node]->receive(t->frame, t->len, t->end + _latency))
+	{
+	    _stats.overflowed++;
+	    continue;
+	}
+	_stats.delivered++;
+    }
+}
+
+bool RHSimMedium::clear(const Transmission* t, uint16_t node)
+{
+    for (uint16_t i = 0; i < _airLen; i++)
+    {
+	const Transmission* u = &_air[i];
+	if (u == t || u->start >= t->end || u->end <= t->start)
+	    continue;
+	if (u->sender == node)
+	{
+	    _stats.missed++;
+	    return false;
+	}
+	if (_collisions && linkLoss(u->sender, node) < 1.0)
+	{
+	    _stats.collided++;
+	    return false;
+	}
+    }
+    return true;
+}
+
+bool RHSimMedium::chance(float p)
+{
+    if (p <= 0.0)
+	return false;
+    // xorshift32
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return (_seed >> 8) < p * (1 << 24);
+}
+
+////////////////////////////////////////////////////////////////////
+// RH_Sim
+RH_Sim::RH_Sim(RHSimMedium& medium)
+    : _medium(medium),
+      _index(-1),
+      _txEnd(0),
+      _rxHead(0),
+      _rxCount(0),
+      _rxOverflows(0),
+      _bufLen(0),
+      _rxBufValid(false)
+{
+}
+
+bool RH_Sim::init()
+{
+    if (!RHGenericDriver::init())
+	return false;
+    if (_index < 0)
+	_index = _medium.attach(this);
+    if (_index < 0)
+	return false;
+    setMode(RHModeRx);
+    return true;
+}
+
+uint16_t RH_Sim::index()
+{
+    return _index;
+}
+
+bool RH_Sim::available()
+{
+    uint64_t now = simMicros();
+
+    while (!_rxBufValid && _rxCount && _rxFifo[_rxHead].ready <= now)
+    {
+	RxSlot* slot = &_rxFifo[_rxHead];
+	memcpy(_buf, slot->buf, slot->len);
+	_bufLen = slot->len;
+	_rxHead = (_rxHead + 1) % RH_SIM_RX_FIFO_LEN;
+	_rxCount--;
+	validateRxBuf();
+    }
+    return _rxBufValid;
+}
+
+bool RH_Sim::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (buf && len)
+    {
+	// Skip the 4 headers that are at the beginning of the rxBuf
+	if (*len > _bufLen - RH_SIM_HEADER_LEN)
+	    *len = _bufLen - RH_SIM_HEADER_LEN;
+	memcpy(buf, _buf + RH_SIM_HEADER_LEN, *len);
+    }
+    clearRxBuf(); // This message accepted and cleared
+    return true;
+}
+
+bool RH_Sim::send(const uint8_t* data, uint8_t len)
+{
+    uint8_t frame[RH_SIM_MAX_PAYLOAD_LEN];
+
+    if (_index < 0 || len > RH_SIM_MAX_MESSAGE_LEN)
+	return false;
+    frame[0] = _txHeaderTo;
+    frame[1] = _txHeaderFrom;
+    frame[2] = _txHeaderId;
+    frame[3] = _txHeaderFlags;
+    memcpy(frame + RH_SIM_HEADER_LEN, data, len);
+    _txEnd = _medium.transmit(_index, frame, len + RH_SIM_HEADER_LEN);
+    setMode(RHModeTx);
+    _txGood++;
+    return true;
+}
+
+uint8_t RH_Sim::maxMessageLength()
+{
+    return RH_SIM_MAX_MESSAGE_LEN;
+}
+
+bool RH_Sim::waitPacketSent()
+{
+    return true;
+}
+
+bool RH_Sim::waitPacketSent(uint16_t timeout)
+{
+    return true;
+}
+
+bool RH_Sim::packetSent()
+{
+    if (_mode == RHModeTx && simMicros() >= _txEnd)
+	setMode(RHModeRx);
+    return _mode != RHModeTx;
+}
+
+void RH_Sim::waitAvailable()
+{
+}
+
+bool RH_Sim::waitAvailableTimeout(uint16_t timeout)
+{
+    return available();
+}
+
+bool RH_Sim::isChannelActive()
+{
+    return _index >= 0 && _medium.busy(_index);
+}
+
+uint32_t RH_Sim::rxOverflows()
+{
+    return _rxOverflows;
+}
+
+bool RH_Sim::accepts(uint8_t to)
+{
+    return _promiscuous || to == _thisAddress || to == RH_BROADCAST_ADDRESS;
+}
+
+bool RH_Sim::receive(const uint8_t* frame, uint8_t len, uint64_t ready)
+{
+    if (_rxCount == RH_SIM_RX_FIFO_LEN)
+    {
+	_rxOverflows++;
+	return false;
+    }
+    RxSlot* slot = &_rxFifo[(_rxHead + _rxCount) % RH_SIM_RX_FIFO_LEN];
+    slot->ready = ready;
+    slot->len = len;
+    memcpy(slot->buf, frame, len);
+    _rxCount++;
+    return true;
+}
+
+// Check whether the latest received message is for this node
+void RH_Sim::validateRxBuf()
+{
+    if (_bufLen < RH_SIM_HEADER_LEN)
+    {
+	_rxBad++;
+	return; // Too short to be a real message
+    }
+    // Extract the 4 headers
+    _rxHeaderTo    = _buf[0];
+    _rxHeaderFrom  = _buf[1];
+    _rxHeaderId    = _buf[2];
+    _rxHeaderFlags = _buf[3];
+    if (_promiscuous ||
+	_rxHeaderTo == _thisAddress ||
+	_rxHeaderTo == RH_BROADCAST_ADDRESS)
+    {
+	_rxGood++;
+	_rxBufValid = true;
+    }
+}
+
+void RH_Sim::clearRxBuf()
+{
+    _rxBufValid = false;
+    _bufLen = 0;
+}
+
+#endif
@@ -0,0 +1,296 @@
+// RH_Sim.h
+//
+// Simulated radio driver and shared medium, for testing RadioHead on the host
+// Contributed by Juha Yrjölä and used with permission
+
+#ifndef RH_Sim_h
+#define RH_Sim_h
+
+#include <RHGenericDriver.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+// Largest frame on the medium, headers included. The same as the nRF24.
+#define RH_SIM_MAX_PAYLOAD_LEN 32
+
+// The length of the headers we add.
+// The headers are inside the payload
+#define RH_SIM_HEADER_LEN 4
+
+// This is the maximum message length that can be supported by this driver.
+#ifndef RH_SIM_MAX_MESSAGE_LEN
+ #define RH_SIM_MAX_MESSAGE_LEN (RH_SIM_MAX_PAYLOAD_LEN - RH_SIM_HEADER_LEN)
+#endif
+
+// Received frames each node can hold before it drops them, like the 3-deep nRF24 RX FIFO
+#ifndef RH_SIM_RX_FIFO_LEN
+ #define RH_SIM_RX_FIFO_LEN 3
+#endif
+
+// Bits around the payload of every frame: the preamble, 5 octet address,
+// 9 bit packet control field and 2 octet CRC of nRF24 Enhanced ShockBurst
+#define RH_SIM_FRAME_OVERHEAD_BITS (8 + 40 + 9 + 16)
+
+// The default bit rate of the medium, in bits per second
+#define RH_SIM_DEFAULT_BIT_RATE 2000000
+
+class RH_Sim;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimMedium RH_Sim.h <RH_Sim.h>
+/// \brief The shared radio channel of a set of RH_Sim drivers, all in one process
+///
+/// Every frame occupies the medium for its air time, computed from its length and the bit rate.
+/// When it ends, it is offered to every node that hears the sender and accepts its TO header.
+/// A node does not get it if:
+/// - the link loses it, with the loss probability of the link from the sender to the node
+/// - it overlaps another frame the node hears (a collision, which destroys both, as
+///   there is no capture effect)
+/// - the node was transmitting itself at any time during the frame (radios are half duplex)
+/// - the RX FIFO of the node is full
+///
+/// Each link has its own loss probability, the default one unless set with setLinkLoss().
+/// A loss of 1 means the node is out of range: it neither receives from the sender nor
+/// notices collisions with it, so hidden nodes can be modelled.
+/// Received frames become available to the node after the configured latency.
+///
+/// There is no real time: the medium runs on the simulated clock of RHutil/simulator.h,
+/// which advanceTo() moves forward, delivering the frames that have ended by then.
+/// Run every node (poll its manager) between calls to advanceTo(). The blocking calls of
+/// the managers, such as sendtoWait(), never see time pass and cannot be used;
+/// use sendtoAsync() and pollAsync().
+class RHSimMedium
+{
+public:
+    /// Counters of the medium
+    typedef struct
+    {
+	uint32_t transmitted;   ///< Frames sent
+	uint32_t delivered;     ///< Frames put in an RX FIFO
+	uint32_t lost;          ///< Frames lost by the link
+	uint32_t collided;      ///< Frames destroyed by another frame
+	uint32_t missed;        ///< Frames not received because the node was transmitting
+	uint32_t overflowed;    ///< Frames dropped because the RX FIFO was full
+    } Stats;
+
+    /// Constructor.
+    /// \param[in] maxNodes The number of RH_Sim drivers that can be attached
+    /// \param[in] bitRate Bits per second of the medium
+    RHSimMedium(uint16_t maxNodes, uint32_t bitRate = RH_SIM_DEFAULT_BIT_RATE);
+    ~RHSimMedium();
+
+    /// Sets the loss probability of every link, including those set with setLinkLoss()
+    /// \param[in] loss Probability that a frame is lost, 0 to 1
+    void setLoss(float loss);
+
+    /// Sets the loss probability from one node to another. Links may be asymmetric,
+    /// call this for both directions for a symmetric one.
+    /// \param[in] from Index of the sending node, as returned by RH_Sim::index()
+    /// \param[in] to Index of the receiving node
+    /// \param[in] loss Probability that a frame is lost, 0 to 1. 1 puts the nodes out of range.
+    void setLinkLoss(uint16_t from, uint16_t to, float loss);
+
+    /// \return The loss probability of the link from one node to another
+    float linkLoss(uint16_t from, uint16_t to);
+
+    /// Sets the delay from the end of a frame until it is available to the receiver,
+    /// for the processing and the interrupt of a real radio. Defaults to 0.
+    /// \param[in] us Delay in microseconds
+    void setLatency(uint32_t us);
+
+    /// Enables or disables collisions. With collisions disabled, overlapping frames
+    /// are all received. Enabled by default.
+    void setCollisions(bool enable);
+
+    /// Seeds the random number generator for the link losses, for repeatable runs
+    void setSeed(uint32_t seed);
+
+    /// \return Air time of a frame, in microseconds
+    /// \param[in] len Length of the frame, headers included
+    uint32_t airTime(uint8_t len);
+
+    /// Moves the simulated clock forward to the given time, delivering the frames
+    /// that have ended by then.
+    /// \param[in] us Simulated time, in microseconds. Earlier times are ignored.
+    void advanceTo(uint64_t us);
+
+    /// Tells whether a node hears a frame on the medium now. This is like a carrier sense,
+    /// or the Received Power Detector of the nRF24.
+    /// \param[in] node Index of the node
+    bool busy(uint16_t node);
+
+    /// \return The counters of the medium
+    const Stats& stats();
+
+    /// \return Number of nodes attached
+    uint16_t nodes();
+
+protected:
+    friend class RH_Sim;
+
+    /// A frame on the medium
+    typedef struct
+    {
+	uint16_t   sender;
+	uint64_t   start;
+	uint64_t   end;
+	bool       done;          ///< Offered to the receivers
+	uint8_t    len;
+	uint8_t    frame[RH_SIM_MAX_PAYLOAD_LEN];
+    } Transmission;
+
+    /// Adds a node to the medium
+    /// \return Its index, or -1 if the medium is full
+    int attach(RH_Sim* node);
+
+    /// Puts a frame on the medium, after any frame the sender is still sending
+    /// \return The simulated time when the frame ends
+    uint64_t transmit(uint16_t sender, const uint8_t* frame, uint8_t len);
+
+    /// Offers a frame that has ended to the receivers
+    void deliver(const Transmission* t);
+
+    /// \return true if frame t reaches node without a collision or the node transmitting
+    bool clear(const Transmission* t, uint16_t node);
+
+    /// \return true with the given probability
+    bool chance(float p);
+
+private:
+    uint16_t       _maxNodes;
+    uint16_t       _nodes;
+    uint32_t       _bitRate;
+    uint32_t       _latency;
+    bool           _collisions;
+    uint32_t       _seed;
+    RH_Sim**       _node;
+    float*         _loss;          ///< [from * _maxNodes + to]
+
+    /// Frames on the medium, and those that ended less than the longest air time ago,
+    /// which may still collide with frames that are on
+    Transmission*  _air;
+    uint16_t       _airMax;
+    uint16_t       _airLen;
+
+    Stats          _stats;
+};
+
+/////////////////////////////////////////////////////////////////////
+/// \class RH_Sim RH_Sim.h <RH_Sim.h>
+/// \brief Driver to send and receive unaddressed, unreliable datagrams over an RHSimMedium
+///
+/// Behaves like RH_NRF24 with software acks: frames of up to RH_SIM_MAX_PAYLOAD_LEN octets
+/// with the 4 RadioHead headers inside, received by the node they are addressed to
+/// (and by all nodes for broadcasts, or promiscuous nodes), and RH_SIM_RX_FIFO_LEN
+/// frames of RX FIFO. Only available for RH_PLATFORM_UNIX.
+///
+/// send() returns immediately, and the frame is on the medium for its air time.
+/// packetSent() tells when it has ended. As the simulated time cannot pass inside a call,
+/// waitPacketSent() does not wait: a frame sent next starts after the one on the medium.
+class RH_Sim : public RHGenericDriver
+{
+public:
+    /// Constructor.
+    /// \param[in] medium The medium to send and receive on
+    RH_Sim(RHSimMedium& medium);
+
+    /// Attaches to the medium
+    /// \return false if the medium has no room for another node
+    bool init();
+
+    /// \return The index of this node on the medium, valid after init()
+    uint16_t index();
+
+    /// Tests whether a new message is available and in the RX FIFO for long enough
+    /// \return true if a new, complete, error-free uncollected message is available to be retrieved by recv()
+    bool available();
+
+    /// Turns the receiver on if it not already on.
+    /// If there is a valid message available, copy it to buf and return true
+    /// else return false.
+    /// If a message is copied, *len is set to the length (Caution, 0 length messages are permitted).
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Puts the message on the medium. Any frame still being sent by this node is sent first.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message length was valid and it was put on the medium
+    bool send(const uint8_t* data, uint8_t len);
+
+    /// Returns the maximum message length available in this Driver.
+    /// \return The maximum legal message length
+    uint8_t maxMessageLength();
+
+    /// Returns at once, see the class description.
+    /// \return true
+    bool waitPacketSent();
+
+    /// Returns at once, see the class description.
+    /// \return true
+    bool waitPacketSent(uint16_t timeout);
+
+    /// \return true if the frames sent by this node have ended
+    bool packetSent();
+
+    /// Returns at once, as the simulated time cannot pass.
+    void waitAvailable();
+
+    /// Returns at once, as the simulated time cannot pass.
+    /// \return true if a message is available
+    bool waitAvailableTimeout(uint16_t timeout);
+
+    /// \return true if this node hears a frame on the medium now
+    bool isChannelActive();
+
+    /// \return Number of frames dropped because the RX FIFO was full
+    uint32_t rxOverflows();
+
+protected:
+    friend class RHSimMedium;
+
+    /// Tells whether this node receives frames with the given TO header
+    bool accepts(uint8_t to);
+
+    /// Puts a received frame in the RX FIFO
+    /// \param[in] ready Simulated time when the frame becomes available
+    /// \return false if the FIFO is full
+    bool receive(const uint8_t* frame, uint8_t len, uint64_t ready);
+
+    /// Examine the receive buffer to determine whether the message is for this node
+    void validateRxBuf();
+
+    /// Clear our local receive buffer
+    void clearRxBuf();
+
+private:
+    /// A received frame
+    typedef struct
+    {
+	uint64_t   ready;
+	uint8_t    len;
+	uint8_t    buf[RH_SIM_MAX_PAYLOAD_LEN];
+    } RxSlot;
+
+    RHSimMedium&    _medium;
+    int             _index;
+
+    /// Simulated time when the last frame sent by this node ends
+    uint64_t        _txEnd;
+
+    RxSlot          _rxFifo[RH_SIM_RX_FIFO_LEN];
+    uint8_t         _rxHead;
+    uint8_t         _rxCount;
+    uint32_t        _rxOverflows;
+
+    /// The message being received
+    uint8_t         _buf[RH_SIM_MAX_PAYLOAD_LEN];
+    uint8_t         _bufLen;
+    bool            _rxBufValid;
+};
+
+#endif
+
+#endif
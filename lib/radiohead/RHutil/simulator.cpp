@@ -0,0 +1,101 @@
+// simulator.cpp
+// Platform functions for RH_PLATFORM_UNIX, see simulator.h
+// Only linked into host builds: the firmware does not build RHutil/
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+static uint64_t _simMicros = 0;
+
+SerialSimulator Serial;
+
+unsigned long millis()
+{
+    return (unsigned long)(_simMicros / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)_simMicros;
+}
+
+void delay(unsigned long ms)
+{
+    _simMicros += (uint64_t)ms * 1000;
+}
+
+uint64_t simMicros()
+{
+    return _simMicros;
+}
+
+void simSetMicros(uint64_t us)
+{
+    if (us > _simMicros)
+	_simMicros = us;
+}
+
+long random(long to)
+{
+    return to > 0 ? random() % to : 0;
+}
+
+long random(long from, long to)
+{
+    return to > from ? from + random() % (to - from) : from;
+}
+
+void randomSeed(unsigned long seed)
+{
+    srandom(seed);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+}
+
+int digitalRead(uint8_t pin)
+{
+    return LOW;
+}
+
+////////////////////////////////////////////////////////////////////
+void SerialSimulator::begin(int baud)
+{
+}
+
+size_t SerialSimulator::println(const char* s)
+{
+    return printf("%s\n", s);
+}
+
+size_t SerialSimulator::print(const char* s)
+{
+    return printf("%s", s);
+}
+
+size_t SerialSimulator::print(unsigned int n, int base)
+{
+    if (base == HEX)
+	return printf("%x", n);
+    if (base == OCT)
+	return printf("%o", n);
+    return printf("%u", n);
+}
+
+size_t SerialSimulator::println(unsigned int n, int base)
+{
+    return print(n, base) + print('\n');
+}
+
+size_t SerialSimulator::print(char ch)
+{
+    return printf("%c", ch);
+}
+
+#endif
@@ -0,0 +1,70 @@
+// simulator.h
+// Lets RadioHead run on Linux and OSX, for the simulated driver RH_Sim
+// Included by RadioHead.h when RH_PLATFORM is RH_PLATFORM_UNIX
+//
+// There is no real time on the simulated medium: millis() and micros() read a
+// simulated clock, which is moved forward by whoever runs the simulation,
+// normally through RHSimMedium::advanceTo().
+
+#ifndef simulator_h
+#define simulator_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define memcpy_P memcpy
+
+/// Milliseconds of simulated time
+extern unsigned long millis();
+
+/// Microseconds of simulated time
+extern unsigned long micros();
+
+/// Moves the simulated clock forward. Nothing else happens meanwhile:
+/// frames on the simulated medium are only delivered by RHSimMedium::advanceTo()
+extern void delay(unsigned long ms);
+
+/// \return The simulated clock in microseconds, without wrapping
+extern uint64_t simMicros();
+
+/// Sets the simulated clock. It never goes backwards.
+extern void simSetMicros(uint64_t us);
+
+extern long random(long to);
+extern long random(long from, long to);
+extern void randomSeed(unsigned long seed);
+
+// There are no pins
+extern void pinMode(uint8_t pin, uint8_t mode);
+extern void digitalWrite(uint8_t pin, uint8_t val);
+extern int digitalRead(uint8_t pin);
+
+/// Serial port that prints to stdout
+class SerialSimulator
+{
+public:
+    void begin(int baud);
+    size_t println(const char* s);
+    size_t print(const char* s);
+    size_t print(unsigned int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t print(char ch);
+};
+
+extern SerialSimulator Serial;
+
+#endif
@@ -1103,7 +1103,10 @@ these examples and explanations and extend them to suit your needs.
 #define RH_PLATFORM_ESP32_MGOS       16
 #define RH_PLATFORM_ESP8266_MGOS     17
 
-#define RH_PLATFORM RH_PLATFORM_ESP8266_MGOS
+// Host builds (the simulator, tools/) override this with -DRH_PLATFORM=RH_PLATFORM_UNIX
+#ifndef RH_PLATFORM
+ #define RH_PLATFORM RH_PLATFORM_ESP8266_MGOS
+#endif
 
 ////////////////////////////////////////////////////
 // Select platform automatically, if possible
@@ -2,28 +2,42 @@
 #define _BITSET_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+// Bits are kept in 32-bit words, bit idx at bit (idx % 32) of word
+// (idx / 32). Bit fields are read and appended least significant bit
+// first, so a field of up to 32 bits costs one or two word operations.
 struct bitset {
     uint16_t max_bits;
     uint16_t n_bits;
-    uint8_t data[];
+    uint32_t data[];
 };
 
+#define BITSET_WORD_BITS        32
+#define BITSET_WORDS(bits)      (((bits) + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS)
+// Size of a buffer for bitset_init() that holds the given number of bits
+#define BITSET_BUF_SIZE(bits)   (sizeof(struct bitset) + BITSET_WORDS(bits) * sizeof(uint32_t))
+
+static inline uint32_t bitset_low_mask(int n)
+{
+    return n >= BITSET_WORD_BITS ? 0xffffffff : ((uint32_t) 1 << n) - 1;
+}
+
 static inline void bitset_set(struct bitset *bitset, int idx)
 {
-    assert(idx <= bitset->max_bits);
-    bitset->data[idx >> 3] |= 1 << (idx & 0x07);
+    assert(idx < bitset->max_bits);
+    bitset->data[idx >> 5] |= (uint32_t) 1 << (idx & 0x1f);
     if (bitset->n_bits < idx + 1)
         bitset->n_bits = idx + 1;
 }
 
 static inline void bitset_unset(struct bitset *bitset, int idx)
 {
-    assert(idx <= bitset->max_bits);
-    bitset->data[idx >> 3] &= ~(1 << (idx & 0x07));
+    assert(idx < bitset->max_bits);
+    bitset->data[idx >> 5] &= ~((uint32_t) 1 << (idx & 0x1f));
     if (bitset->n_bits < idx + 1)
         bitset->n_bits = idx + 1;
 }
@@ -36,40 +50,76 @@ static inline void bitset_append(struct bitset *bitset, bool value)
         bitset_unset(bitset, bitset->n_bits);
 }
 
+// Appends the n lowest bits of value, least significant bit first
+static inline void bitset_append_bits(struct bitset *bitset, uint32_t value, int n)
+{
+    int idx = bitset->n_bits, word = idx >> 5, shift = idx & 0x1f;
+
+    assert(n <= BITSET_WORD_BITS && idx + n <= bitset->max_bits);
+    if (!n)
+        return;
+    value &= bitset_low_mask(n);
+    bitset->data[word] = (bitset->data[word] & bitset_low_mask(shift)) | (value << shift);
+    if (shift + n > BITSET_WORD_BITS)
+        bitset->data[word + 1] = value >> (BITSET_WORD_BITS - shift);
+    bitset->n_bits = idx + n;
+}
+
+// buf must be aligned to 4 bytes
 static inline struct bitset * bitset_init(void *buf, size_t buf_len)
 {
     struct bitset *bitset = (struct bitset *) buf;
 
-    buf_len -= sizeof(struct bitset);
+    buf_len = (buf_len - sizeof(struct bitset)) & ~(sizeof(uint32_t) - 1);
 
     bitset->n_bits = 0;
     bitset->max_bits = buf_len << 3;
     memset(bitset->data, 0, buf_len);
 
-    return bitset;     
+    return bitset;
 }
 
 static inline struct bitset * bitset_alloc(int max_bits)
 {
-    int bytes = (max_bits + 7) >> 3;
     void *buf;
 
-    buf = malloc(sizeof(struct bitset) + bytes);
+    buf = malloc(BITSET_BUF_SIZE(max_bits));
     assert(buf != NULL);
-    return bitset_init(buf, bytes);
+    return bitset_init(buf, BITSET_BUF_SIZE(max_bits));
 }
 
 static inline bool bitset_get(const struct bitset *bitset, int idx)
 {
     assert(idx < bitset->n_bits);
-    return bitset->data[idx >> 3] & (1 << (idx & 0x07)) ? true : false;
+    return bitset->data[idx >> 5] & ((uint32_t) 1 << (idx & 0x1f)) ? true : false;
+}
+
+// Returns n bits starting at idx, bit idx being the least significant one
+static inline uint32_t bitset_get_bits(const struct bitset *bitset, int idx, int n)
+{
+    int word = idx >> 5, shift = idx & 0x1f;
+    uint32_t value;
+
+    assert(n <= BITSET_WORD_BITS && idx + n <= bitset->n_bits);
+    if (!n)
+        return 0;
+    value = bitset->data[word] >> shift;
+    if (shift + n > BITSET_WORD_BITS)
+        value |= bitset->data[word + 1] << (BITSET_WORD_BITS - shift);
+    return value & bitset_low_mask(n);
+}
+
+// Word i of the bitset with the bits past the end cleared
+static inline uint32_t bitset_word(const struct bitset *bitset, int i)
+{
+    return bitset->data[i] & bitset_low_mask(bitset->n_bits - i * BITSET_WORD_BITS);
 }
 
 static inline void bitset_copy(struct bitset *dest, const struct bitset *src)
 {
     assert(dest->max_bits >= src->n_bits);
     dest->n_bits = src->n_bits;
-    memcpy(dest->data, src->data, (src->n_bits + 7) / 8);
+    memmove(dest->data, src->data, BITSET_WORDS(src->n_bits) * sizeof(uint32_t));
 }
 
 static inline struct bitset * bitset_dup(const struct bitset *src)
@@ -80,6 +130,95 @@ static inline struct bitset * bitset_dup(const struct bitset *src)
     return dest;
 }
 
+static inline int bitset_popcount(const struct bitset *bitset)
+{
+    int count = 0;
+
+    for (int i = 0; i < BITSET_WORDS(bitset->n_bits); i++)
+        count += __builtin_popcount(bitset_word(bitset, i));
+    return count;
+}
+
+// Number of bits that differ. Bits past the end of the shorter bitset are
+// all counted as different.
+static inline int bitset_distance(const struct bitset *a, const struct bitset *b)
+{
+    int n_bits = a->n_bits < b->n_bits ? a->n_bits : b->n_bits;
+    int count = a->n_bits + b->n_bits - 2 * n_bits;
+    int i;
+
+    for (i = 0; i < n_bits / BITSET_WORD_BITS; i++)
+        count += __builtin_popcount(a->data[i] ^ b->data[i]);
+    if (n_bits % BITSET_WORD_BITS)
+        count += __builtin_popcount((a->data[i] ^ b->data[i]) & bitset_low_mask(n_bits % BITSET_WORD_BITS));
+    return count;
+}
+
+static inline bool bitset_equal(const struct bitset *a, const struct bitset *b)
+{
+    if (a->n_bits != b->n_bits)
+        return false;
+    for (int i = 0; i < BITSET_WORDS(a->n_bits); i++) {
+        if (bitset_word(a, i) != bitset_word(b, i))
+            return false;
+    }
+    return true;
+}
+
+// FNV-1a over the words, for hash tables keyed by codes
+static inline uint32_t bitset_hash(const struct bitset *bitset)
+{
+    uint32_t hash = 2166136261u ^ bitset->n_bits;
+
+    for (int i = 0; i < BITSET_WORDS(bitset->n_bits); i++)
+        hash = (hash ^ bitset_word(bitset, i)) * 16777619u;
+    return hash;
+}
+
+// Gathers the even bits of a word into its lower half
+static inline uint32_t bitset_even_bits(uint32_t x)
+{
+    x &= 0x55555555;
+    x = (x | (x >> 1)) & 0x33333333;
+    x = (x | (x >> 2)) & 0x0f0f0f0f;
+    x = (x | (x >> 4)) & 0x00ff00ff;
+    x = (x | (x >> 8)) & 0x0000ffff;
+    return x;
+}
+
+// Decodes Manchester coded pairs of bits: 10 is a one and 01 a zero.
+// Returns -1 if src has an odd number of bits or a pair is 00 or 11.
+// dest may be the same bitset as src.
+static inline int bitset_manchester_decode(struct bitset *dest, const struct bitset *src)
+{
+    int n_bits = src->n_bits, i, out_bits = 0;
+
+    if (n_bits & 1)
+        return -1;
+    assert(dest->max_bits >= n_bits / 2);
+
+    for (i = 0; i < BITSET_WORDS(n_bits); i++) {
+        uint32_t w = bitset_word(src, i);
+        int n = n_bits - i * BITSET_WORD_BITS;
+        uint32_t mask = bitset_low_mask(n) & 0x55555555;
+
+        if (((w ^ (w >> 1)) & mask) != mask)
+            return -1;
+        n = n > BITSET_WORD_BITS ? BITSET_WORD_BITS / 2 : n / 2;
+
+        // Each half word of input fills a half word of output, which
+        // never lies past the input we still have to read.
+        w = bitset_even_bits(w);
+        if (out_bits & 0x1f)
+            dest->data[out_bits >> 5] = (dest->data[out_bits >> 5] & 0xffff) | (w << 16);
+        else
+            dest->data[out_bits >> 5] = w;
+        out_bits += n;
+    }
+    dest->n_bits = out_bits;
+    return 0;
+}
+
 static inline void bitset_print(char *out, const struct bitset *bitset)
 {
     for (int idx = 0; idx < bitset->n_bits; idx++) {
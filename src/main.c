@@ -1,5 +1,6 @@
 #include <mgos.h>
 #include "sensors.h"
+#include "sensor_node.h"
 #include "actuators.h"
 
 static int status_led = -1;
@@ -27,22 +28,7 @@ extern void net_watchdog_init(void);
 extern void radiohead_init(void);
 extern void display_init(void);
 extern void mqtt_control_init(void);
-
-static void test_deep_sleep(void *args)
-{
-    printf("LED down\n");
-    mgos_gpio_write(status_led, 1);
-    mgos_msleep(1000);
-
-    printf("Going to sleep\n");
-    mgos_msleep(100);
-
-    sensors_shutdown();
-    mgos_gpio_set_mode(status_led, MGOS_GPIO_MODE_INPUT);
-    //wifi_station_disconnect();
-    //wifi_set_opmode_current(NULL_MODE);
-    system_deep_sleep(10*60*1000*1000);
-}
+extern void rcsw_init(void);
 
 enum mgos_app_init_result mgos_app_init(void)
 {
@@ -54,12 +40,10 @@ enum mgos_app_init_result mgos_app_init(void)
     net_watchdog_init();
     sensors_init();
     actuators_init();
-    //radiohead_init();
+    rcsw_init();
+    radiohead_init();
+    sensor_node_init();
     //display_init();
 
-    //mgos_gpio_write(status_led, 0);
-    //mgos_msleep(1000);
-    //mgos_set_timer(15000, 0, test_deep_sleep, NULL);
-
     return MGOS_APP_INIT_SUCCESS;
 }
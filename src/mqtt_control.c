@@ -1,16 +1,20 @@
 #include <mgos.h>
 #include <mgos_mqtt.h>
+#include "radiohead.h"
+#include "rh_sniffer.h"
 
 #define TOPIC_PREFIX            "thing/"
 #define LOG_TOPIC_SUFFIX        "/log"
 #define ERROR_LOG_TOPIC_SUFFIX  "/log/error"
 #define STATS_TOPIC_SUFFIX      "/stats"
+#define RF_NODES_TOPIC_SUFFIX   "/rf_nodes"
 #define CONTROL_TOPIC_SUFFIX      "/control"
 #define MAX_BUFFER_LINES        64
 #define MQTT_LOG_SEND_DELAY     1000
 
 #undef UART_DEBUG
 
+extern bool rcsw_learn(void);
 
 #ifdef ESP32
 #include <rom/rtc.h>
@@ -104,6 +108,7 @@ static char *mqtt_topic;
 static char *mqtt_log_topic;
 static char *mqtt_error_log_topic;
 static char *mqtt_stats_topic;
+static char *mqtt_rf_nodes_topic;
 static char *mqtt_control_topic;
 
 #ifdef UART_DEBUG
@@ -233,7 +238,7 @@ static void send_stats(void *arg)
 {
     int rssi;
     unsigned int free_heap_size;
-    char buf[100];
+    char buf[1024];
     struct json_out out = JSON_OUT_BUF(buf, sizeof(buf));
 
     if (!mqtt_connected)
@@ -241,13 +246,86 @@ static void send_stats(void *arg)
 
     rssi = mgos_wifi_sta_get_rssi();
     free_heap_size = mgos_get_free_heap_size();
-    json_printf(&out, "{uptime:%.3lf,wifi_rssi:%d,free_heap_size:%u}",
-                mgos_uptime(), rssi, free_heap_size);
+    if (radiohead_is_initialized()) {
+        struct radiohead_rx_stats st;
+        struct radiohead_tx_stats tx;
+        struct radiohead_chan_stats ch;
+        struct rh_sniffer_stats sn;
+
+        // Latency from the nRF24 IRQ to the MQTT publish of the report
+        radiohead_get_rx_stats(&st);
+        radiohead_get_tx_stats(&tx);
+        radiohead_get_chan_stats(&ch);
+        rh_sniffer_get_stats(&sn);
+        json_printf(&out, "{uptime:%.3lf,wifi_rssi:%d,free_heap_size:%u,"
+                    "rh_rx_messages:%u,rh_rx_invalid:%u,rh_rx_latency_avg_ms:%.2lf,rh_rx_latency_max_ms:%.2lf,"
+                    "rh_rx_fifo_full:%u,rh_rx_max_drained:%u,"
+                    "rh_tx_depth:%u,rh_tx_sent:%u,rh_tx_failed:%u,rh_tx_dropped:%u,rh_tx_coalesced:%u,"
+                    "rh_tx_hw_retries:%u,rh_tx_hw_lost:%u,rh_tx_hw_timeouts:%u,"
+                    "rh_channel:%u,rh_data_rate_kbps:%u,rh_chan_changes:%u,rh_chan_surveys:%u,"
+                    "rh_chan_hunts:%u,rh_chan_hunts_failed:%u,"
+                    "rh_sniff_frames:%u,rh_sniff_sent:%u,rh_sniff_dropped:%u,rh_sniff_clients:%u}",
+                    mgos_uptime(), rssi, free_heap_size,
+                    (unsigned int) st.n_messages, (unsigned int) st.n_invalid,
+                    st.n_messages ? st.latency_sum * 1000 / st.n_messages : 0.0,
+                    st.latency_max * 1000,
+                    (unsigned int) st.n_fifo_full, (unsigned int) st.max_drained,
+                    (unsigned int) tx.depth, (unsigned int) tx.n_sent, (unsigned int) tx.n_failed,
+                    (unsigned int) tx.n_dropped, (unsigned int) tx.n_coalesced,
+                    (unsigned int) tx.hw_retransmissions, (unsigned int) tx.hw_lost,
+                    (unsigned int) tx.hw_timeouts,
+                    (unsigned int) ch.channel, (unsigned int) ch.data_rate_kbps,
+                    (unsigned int) ch.n_changes, (unsigned int) ch.n_surveys,
+                    (unsigned int) ch.n_hunts, (unsigned int) ch.n_hunts_failed,
+                    (unsigned int) sn.n_frames, (unsigned int) sn.n_sent,
+                    (unsigned int) sn.n_dropped, (unsigned int) sn.n_clients);
+    } else {
+        json_printf(&out, "{uptime:%.3lf,wifi_rssi:%d,free_heap_size:%u}",
+                    mgos_uptime(), rssi, free_heap_size);
+    }
     debug_printf("%s: %s", mqtt_stats_topic, buf);
 
     mgos_mqtt_pub(mqtt_stats_topic, buf, strlen(buf), 0, true);
 }
 
+// Gateway node table: totals, and the state of each node
+static void send_rf_nodes(void *arg)
+{
+    const struct rh_nodes *t = radiohead_get_nodes();
+    uint32_t now, interval = mgos_sys_config_get_radiohead_gateway_stats_interval();
+    struct rh_nodes_summary sum;
+    struct mbuf mbuf;
+    struct json_out out = JSON_OUT_MBUF(&mbuf);
+    int i, j;
+
+    if (!mqtt_connected || t == NULL)
+        return;
+
+    now = (uint32_t) mgos_uptime();
+    rh_nodes_summarize(t, now, interval, &sum);
+    mbuf_init(&mbuf, 100 + t->n_nodes * 100);
+    json_printf(&out, "{nodes:%u,active:%u,packets:%u,lost:%u,untracked:%u,list:[",
+                (unsigned int) sum.n_nodes, (unsigned int) sum.n_active,
+                (unsigned int) sum.n_packets, (unsigned int) sum.n_lost,
+                (unsigned int) sum.n_untracked);
+    for (i = 0; i < t->n_nodes; i++) {
+        const struct rh_node *node = &t->nodes[i];
+
+        json_printf(&out, "%s{address:%u,last_seen_s:%u,packets:%u,lost:%u,duplicates:%u,rpd:%u,rpd_known:%u,sensors:[",
+                    i ? "," : "", node->address, (unsigned int) (now - node->last_seen),
+                    (unsigned int) node->n_packets, (unsigned int) node->n_lost,
+                    node->n_duplicates, node->n_rpd, node->n_rpd_known);
+        for (j = 0; j < node->n_sensors; j++)
+            json_printf(&out, "%s%u", j ? "," : "", node->sensor_ids[j]);
+        json_printf(&out, "]}");
+    }
+    json_printf(&out, "]}");
+
+    mgos_mqtt_pub(mqtt_rf_nodes_topic, mbuf.buf, mbuf.len, 0, true);
+    mbuf_free(&mbuf);
+    (void) arg;
+}
+
 static void mqtt_control_handler(struct mg_connection *nc, int ev,
                                  void *ev_data, void *user_data)
 {
@@ -266,6 +344,8 @@ static void mqtt_control_handler(struct mg_connection *nc, int ev,
     if (strcmp(command, "reboot") == 0) {
         LOG(LL_WARN, ("Rebooting"));
         mgos_system_restart_after(100);
+    } else if (strcmp(command, "rf433_learn") == 0) {
+        rcsw_learn();
     }
 
     free(command);
@@ -295,6 +375,7 @@ void mqtt_control_init(void)
     mg_asprintf(&mqtt_error_log_topic, 0, "%s%s", mqtt_topic, ERROR_LOG_TOPIC_SUFFIX);
     mg_asprintf(&mqtt_stats_topic, 0, "%s%s", mqtt_topic, STATS_TOPIC_SUFFIX);
     mg_asprintf(&mqtt_control_topic, 0, "%s%s", mqtt_topic, CONTROL_TOPIC_SUFFIX);
+    mg_asprintf(&mqtt_rf_nodes_topic, 0, "%s%s", mqtt_topic, RF_NODES_TOPIC_SUFFIX);
 
     if (!mgos_sys_config_get_mqtt_will_topic())
         mgos_sys_config_set_mqtt_will_topic(mqtt_topic);
@@ -307,4 +388,7 @@ void mqtt_control_init(void)
     mgos_mqtt_global_subscribe(mg_mk_str(mqtt_control_topic), mqtt_control_handler, NULL);
 
     mgos_set_timer(60000, MGOS_TIMER_REPEAT, send_stats, NULL);
+    if (mgos_sys_config_get_radiohead_gateway_enable())
+        mgos_set_timer(mgos_sys_config_get_radiohead_gateway_stats_interval() * 1000,
+                       MGOS_TIMER_REPEAT, send_rf_nodes, NULL);
 }
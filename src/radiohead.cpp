@@ -1,9 +1,16 @@
 #include <mgos_config.h>
+#include <mgos_sys_config.h>
 #include <mgos_timers.h>
 
 #include <RH_NRF24.h>
 #include <RHReliableDatagram.h>
+#include <RHRouter.h>
 #include "radiohead.h"
+#include "radiohead_sensor.h"
+#include "rh_chan.h"
+#include "rh_nodes.h"
+#include "rh_sniffer.h"
+#include "rh_tdma.h"
 
 // ESP8266
 #if 1
@@ -13,9 +20,118 @@
 #define OTHER_ADDRESS 1
 #endif
 
+// Without an IRQ GPIO the RX FIFO is checked this often
+#define RH_RX_POLL_INTERVAL_MS 20
+
+// Outgoing reports waiting for the radio
+#define RH_TX_QUEUE_LEN 8
+
+// Nodes with a downlink message waiting for them
+#define RH_DOWNLINK_SLOTS 4
+
+// Pipe addresses a sniffer can listen on with radiohead.device.auto_ack
+#define RH_SNIFFER_MAX_NODES 6
+
+// Channel survey: one channel per timer tick, listening on it long
+// enough for the RX to settle (130 us) and the RPD to latch (170 us),
+// and back on the own channel in between
+#define RH_CHAN_DWELL_MS                1
+#define RH_CHAN_STEP_INTERVAL_MS        4
+// The gateway announces a switch this many times before it moves
+#define RH_CHAN_ANNOUNCE_REPEATS        5
+#define RH_CHAN_ANNOUNCE_INTERVAL_MS    200
+// ACK timeout of each try while a node hunts for the gateway
+#define RH_CHAN_HUNT_TIMEOUT_MS         5
+
 static RH_NRF24 *driver;
 static RHHardwareSPI *hard_spi;
 static RHReliableDatagram *manager;
+// With radiohead.routing.enable, the manager is a router that also
+// relays messages for other nodes
+static RHRouter *router;
+// radiohead.node.enable: the receiver is off except while waiting for an ACK
+static bool low_power;
+
+// radiohead.tdma.enable: the gateway sends the beacons and hands out the
+// slots, and the other nodes send their reports in their own slot
+static struct {
+    struct rh_tdma_schedule *schedule;  // Gateway
+    bool node;
+    struct rh_tdma_clock clock;
+    bool sync_waited;           // The first report has waited for a beacon
+    uint8_t retries;            // One per superframe
+    mgos_timer_id timer;        // Next beacon on the gateway, own slot on nodes
+} tdma;
+
+static bool tdma_beacon_rx(const uint8_t *buf, uint8_t len, double rx_time);
+static void tdma_init(void);
+
+// radiohead.chan.enable: the gateway surveys the band and moves the
+// network to the least busy channel, and to a data rate that gets
+// through. The other nodes follow its announcements, or hunt for it.
+static struct {
+    bool enable;
+    bool gateway;
+    uint8_t channel;            // In use
+    enum rh_chan_rate rate;
+    enum rh_chan_rate max_rate; // radiohead.data_rate
+    mgos_timer_id timer;        // Survey and announcements on the gateway, the switch on nodes
+
+    // Gateway
+    struct rh_chan_survey *survey;
+    bool initial;               // The survey at boot only picks a channel
+    int sweeps_left;
+    uint8_t sweep_channel;      // Measured next
+    bool tuned_away;            // Listening on sweep_channel
+    struct rh_chan_monitor monitor;
+    uint8_t announce_left;      // Announcements to send before the switch
+    uint8_t announce_id;
+
+    // Nodes
+    struct rh_chan_hunt hunt;
+    bool hunting;
+    unsigned int n_failed;      // Reports in a row
+    uint8_t retries;            // Of the manager, outside a hunt
+    uint16_t timeout;
+
+    struct rh_chan_announce announce;   // The switch in progress
+    struct radiohead_chan_stats stats;
+} chan;
+
+static bool chan_announce_rx(const uint8_t *buf, uint8_t len);
+static void chan_init(void);
+
+// Gives the radio back to the own channel if the survey has it listening
+// on another. Before anything is sent or received: the interrupted
+// channel is measured again later.
+static void chan_sweep_cancel(void)
+{
+    if (!chan.tuned_away)
+        return;
+    chan.tuned_away = false;
+    driver->setModeIdle();
+    driver->setChannel(chan.channel);
+    driver->setModeRx();
+}
+
+// radiohead.sniffer.enable: the radio only listens, and every frame on
+// the channel is streamed to a TCP client, see rh_sniffer.h
+static struct {
+    bool enable;
+    uint32_t fifo_full;         // Reported so far
+} sniffer;
+
+static RH_NRF24::DataRate nrf24_data_rate(enum rh_chan_rate rate)
+{
+    switch (rate) {
+    case RH_CHAN_RATE_1MBPS:
+        return RH_NRF24::DataRate1Mbps;
+    case RH_CHAN_RATE_250KBPS:
+        return RH_NRF24::DataRate250kbps;
+    default:
+        return RH_NRF24::DataRate2Mbps;
+    }
+}
 
 static void config_driver(void)
 {
@@ -30,158 +146,388 @@ static void config_driver(void)
     driver->spiWriteRegister(RH_NRF24_REG_00_CONFIG, val);
     mgos_msleep(10);
 
-    driver->setChannel(mgos_sys_config_get_radiohead_channel());
-    driver->setRF(RH_NRF24::DataRate2Mbps, RH_NRF24::TransmitPower0dBm);
+    driver->setChannel(chan.channel);
+    driver->setRF(nrf24_data_rate(chan.rate), RH_NRF24::TransmitPower0dBm);
+    if (mgos_sys_config_get_radiohead_device_auto_ack() &&
+        !driver->setAutoAck(true, mgos_sys_config_get_radiohead_device_auto_ack_retries(),
+                            mgos_sys_config_get_radiohead_device_auto_ack_delay_us()))
+        LOG(LL_ERROR, ("Invalid radiohead.device.auto_ack settings, using software ACKs"));
+    // Move every payload out of the 3-deep RX FIFO on each pump
+    driver->setRxDrain(true);
     // Mask all other IRQs except RX_DR
     val = driver->spiReadRegister(RH_NRF24_REG_00_CONFIG);
     driver->spiWriteRegister(RH_NRF24_REG_00_CONFIG, val | RH_NRF24_MASK_TX_DS | RH_NRF24_MASK_MAX_RT);
 }
 
-static void poll_manager(void *arg)
+// Reliable sends advance from a timer, and from the RX pump which
+// collects the ACKs.
+static mgos_timer_id tx_timer = MGOS_INVALID_TIMER_ID;
+
+static void tx_poll(void *arg);
+
+static void tx_schedule(uint16_t delay_ms)
+{
+    if (tx_timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(tx_timer);
+    tx_timer = MGOS_INVALID_TIMER_ID;
+    if (delay_ms)
+        tx_timer = mgos_set_timer(delay_ms, 0, tx_poll, NULL);
+}
+
+// Returns the milliseconds until the next call is due, 0 when idle
+static uint16_t tx_advance(void)
+{
+    chan_sweep_cancel();
+    return router ? router->poll() : manager->pollAsync();
+}
+
+static void tx_poll(void *arg)
+{
+    tx_timer = MGOS_INVALID_TIMER_ID;
+    tx_schedule(tx_advance());
+    (void) arg;
+}
+
+// Downlink messages to nodes ride on the hardware ACK of their next
+// report. The nRF24 only knows which pipe the ACK goes to, not which
+// node, so the message for the node that has waited longest is kept
+// loaded until a report from that very node takes it. Reports from other
+// nodes may take it too; they drop it, and it is loaded again.
+struct rh_downlink {
+    uint8_t node;
+    uint8_t len;
+    uint8_t msg[RH_NRF24_MAX_MESSAGE_LEN];
+};
+
+static struct {
+    int n_entries;
+    bool loaded;            // entries[0] is in the TX FIFO
+    uint8_t id;
+    struct rh_downlink entries[RH_DOWNLINK_SLOTS];
+
+    radiohead_downlink_cb cb;
+    void *cb_arg;
+} dl;
+
+static void dl_load(void)
+{
+    struct rh_downlink *e = &dl.entries[0];
+
+    if (dl.loaded || !dl.n_entries || manager->asyncBusy())
+        return;
+    dl.loaded = driver->setAckPayload(e->node, dl.id, e->msg, e->len);
+}
+
+// The TX FIFO must be empty for sending
+static void dl_unload(void)
 {
-    static int counter = 0;
-    uint8_t buf[32];
+    if (dl.loaded) {
+        driver->clearAckPayloads();
+        dl.loaded = false;
+    }
+}
+
+// Sends a broadcast at once, with the ACK payload unloaded meanwhile.
+// Returns false without sending while a message waits for its ACK.
+static bool send_broadcast(const uint8_t *buf, uint8_t len, uint8_t id)
+{
+    if (manager->asyncBusy())
+        return false;
+    chan_sweep_cancel();
+    dl_unload();
+    // A new ID, or the nodes drop it as a duplicate, and not flagged as
+    // an ACK, as the last message sent may have been
+    manager->setHeaderId(id);
+    manager->setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK);
+    if (manager->sendto((uint8_t *) buf, len, RH_BROADCAST_ADDRESS))
+        driver->waitPacketSent();
+    driver->setModeRx();
+    dl_load();
+    return true;
+}
+
+// The ACK of the message just received from node took the loaded message
+static void dl_taken(uint8_t node)
+{
+    dl.loaded = false;
+    if (dl.entries[0].node != node)
+        return;
+    LOG(LL_DEBUG, ("RH downlink message delivered to %d", node));
+    dl.n_entries--;
+    memmove(&dl.entries[0], &dl.entries[1], dl.n_entries * sizeof(dl.entries[0]));
+    dl.id++;
+}
+
+int radiohead_queue_downlink(uint8_t node, const void *msg, unsigned int msg_len)
+{
+    struct rh_downlink *e;
     int i;
 
-#if 1
-    printf("%02x\n", driver->spiReadRegister(0x00));
-    if (driver->available()) {
-        uint8_t buf[RH_NRF24_MAX_MESSAGE_LEN];
-        uint8_t len = sizeof(buf);
-        if (driver->recv(buf, &len))
-            printf("Got message: %s\n", (const char *) buf);
-        else
-            printf("Recv failed\n");
+    if (!radiohead_is_initialized() || !driver->hardwareAck()) {
+        LOG(LL_ERROR, ("RH downlink needs radiohead.device.auto_ack"));
+        return -1;
     }
-#endif
-#if 1
-    if (1) {
-        int msg = 0;
+    if (msg_len > RH_NRF24_MAX_MESSAGE_LEN)
+        return -1;
 
-        driver->setModeRx();
-        mgos_msleep(1);
-        for (i = 0; i < 200; i++) {
-            if (driver->available()) {
-                uint8_t buf[RH_NRF24_MAX_MESSAGE_LEN];
-                uint8_t len = sizeof(buf);
-                msg = 1;
-                if (driver->recv(buf, &len))
-                    printf("Got message: %s\n", (const char *) buf);
-                else
-                    printf("Recv failed\n");
-            }
-            mgos_msleep(1);
-        }
-        if (!msg)
-            printf("no msg\n");
+    // A newer message replaces the one still waiting for the node
+    for (i = 0; i < dl.n_entries; i++) {
+        if (dl.entries[i].node == node)
+            break;
     }
-#endif
-#if 0
-    driver->setModeRx();
-#endif
-    mgos_set_timer(100 + rand() % 100, 0, poll_manager, NULL);
+    if (i == dl.n_entries) {
+        if (dl.n_entries == RH_DOWNLINK_SLOTS)
+            return -1;
+        dl.n_entries++;
+    } else if (i == 0) {
+        dl_unload();
+    }
+    e = &dl.entries[i];
+    e->node = node;
+    e->len = msg_len;
+    memcpy(e->msg, msg, msg_len);
+
+    dl_load();
+    return 0;
 }
 
-static void handle_rx(void)
+void radiohead_set_downlink_handler(radiohead_downlink_cb cb, void *arg)
 {
-    uint8_t buf[48];
-    uint8_t len = sizeof(buf) - 1;
-    uint8_t from;
+    dl.cb = cb;
+    dl.cb_arg = arg;
+}
 
-#if 1
-    if (driver->available()) {
-        uint8_t buf[RH_NRF24_MAX_MESSAGE_LEN];
-        uint8_t len = sizeof(buf);
-        if (driver->recv(buf, &len))
-            printf("Got message: %s\n", (const char *) buf);
-        else
-            printf("Recv failed\n");
-    } else {
-        printf("no msg available\n");
+// The IRQ handler only notes the time of the interrupt and schedules the
+// pump, which does all the SPI work from the main task.
+struct rh_rx {
+    bool pump_pending;
+    double irq_time;            // Uptime of the first unhandled interrupt
+    mgos_timer_id poll_timer;   // If there is no IRQ GPIO
+
+    struct radiohead_rx_stats stats;
+};
+
+static struct rh_rx rx;
+
+// Gateway mode: state of every node heard from
+static struct rh_nodes *nodes;
+
+static void rx_update_stats(double latency)
+{
+    struct radiohead_rx_stats *st = &rx.stats;
+
+    st->n_messages++;
+    st->latency_sum += latency;
+    if (latency > st->latency_max)
+        st->latency_max = latency;
+}
+
+// The frames are handed on as they are: the sniffer acknowledges and
+// decodes nothing, apart from following the channel announcements.
+static void sniffer_pump(double irq_time)
+{
+    uint8_t buf[RH_NRF24_MAX_PAYLOAD_LEN];
+    uint8_t len, flags = RH_SNIFFER_F_IRQ_TIME;
+    double time = irq_time;
+    uint32_t fifo_full;
+
+    for (;;) {
+        len = sizeof(buf);
+        if (!driver->recvRaw(buf, &len))
+            break;
+        rh_sniffer_frame(time, chan.channel, chan.rate, driver->lastRxPipe(), flags, buf, len);
+        if (chan.enable && len > RH_NRF24_HEADER_LEN && buf[0] == RH_BROADCAST_ADDRESS)
+            chan_announce_rx(buf + RH_NRF24_HEADER_LEN, len - RH_NRF24_HEADER_LEN);
+        // Only the first frame has the time of the interrupt, the others
+        // were behind it in the RX FIFO
+        time = mgos_uptime();
+        flags = 0;
+    }
+    fifo_full = driver->rxFifoFull();
+    if (fifo_full != sniffer.fifo_full) {
+        rh_sniffer_fifo_full(fifo_full - sniffer.fifo_full);
+        sniffer.fifo_full = fifo_full;
+    }
+}
+
+// Drains the RX FIFO. Sensor reports are acknowledged, decoded and
+// published before the next message is looked at.
+static void nrf24_rx_pump(void *arg)
+{
+    uint8_t buf[RH_NRF24_MAX_MESSAGE_LEN];
+    uint8_t len, from, id;
+    uint16_t sensor_id;
+    double irq_time = rx.irq_time, latency;
+    struct rh_node *node = NULL;
+    int8_t rpd;
+    bool first = true;
+
+    // Clear the flag before reading the FIFO, so that a message arriving
+    // after we have drained it schedules a new pump.
+    __atomic_store_n(&rx.pump_pending, false, __ATOMIC_SEQ_CST);
+
+    if (sniffer.enable) {
+        sniffer_pump(irq_time);
+        return;
+    }
+    chan_sweep_cancel();
+    while (manager->available()) {
+        len = sizeof(buf);
+        // Routed messages are reported by their source
+        if (router ? !router->recvfromAck(buf, &len, &from, NULL, &id) :
+                     !manager->recvfromAck(buf, &len, &from, NULL, &id)) {
+            first = false;
+            continue;
+        }
+        // Sampled as the message left the RX FIFO, unknown for most
+        // messages, see RH_NRF24::lastRxRpd()
+        rpd = driver->lastRxRpd();
+        if (chan.enable && chan_announce_rx(buf, len)) {
+            first = false;
+            continue;
+        }
+        // Only the first message has the time of the interrupt
+        if (tdma.node && tdma_beacon_rx(buf, len, first ? irq_time : -1)) {
+            first = false;
+            continue;
+        }
+        first = false;
+        if (nodes)
+            node = rh_nodes_packet(nodes, from, id, rpd, (uint32_t) mgos_uptime());
+        if (tdma.schedule)
+            rh_tdma_assign(tdma.schedule, from);
+        if (dl.loaded && !driver->ackPayloadPending())
+            dl_taken(from);
+        if (rh_sensor_handle_message(buf, len, &sensor_id) < 0) {
+            rx.stats.n_invalid++;
+            continue;
+        }
+        if (node)
+            rh_nodes_add_sensor(node, sensor_id);
+        latency = mgos_uptime() - irq_time;
+        rx_update_stats(latency);
+        LOG(LL_DEBUG, ("RH sensor report from %d (%d bytes, pipe %d) published %.1f ms after IRQ",
+                       from, len, driver->lastRxPipe(), latency * 1000));
+    }
+    // The ACK for our own report may have arrived, and the router may
+    // have messages to relay
+    tx_schedule(tx_advance());
+    // Sending the ACKs leaves the radio idle. A low-power node only
+    // listens for the ACKs of its own reports, and the TDMA beacons.
+    if (driver->mode() != RHGenericDriver::RHModeTx && (!low_power || tdma.node)) {
         driver->setModeRx();
+        dl_load();
     }
-    return;
-#endif
+    (void) arg;
+}
 
-    if (!manager->available())
+static void nrf24_irq_handler(int pin, void *arg)
+{
+    rx.stats.n_irqs++;
+    if (__atomic_load_n(&rx.pump_pending, __ATOMIC_SEQ_CST))
         return;
+    rx.irq_time = mgos_uptime();
+    __atomic_store_n(&rx.pump_pending, true, __ATOMIC_SEQ_CST);
+    if (!mgos_invoke_cb(nrf24_rx_pump, NULL, true))
+        __atomic_store_n(&rx.pump_pending, false, __ATOMIC_SEQ_CST);
+    (void) pin;
+    (void) arg;
+}
 
-    if (manager->recvfromAck(buf, &len, &from)) {
-        buf[len] = '\0';
-        printf("Got msg from client %d: %s\n", from, buf);
-        sprintf((char *) buf, "pong");
-        if (!manager->sendtoWait(buf, strlen((char *) buf) + 1, from)) {
-            printf("sendToWait failed\n");
-        } else
-            printf("sendToWait succeeded\n");
-    } else {
-        printf("recvFromAck failed\n");
+static void nrf24_poll_timer_cb(void *arg)
+{
+    rx.irq_time = mgos_uptime();
+    nrf24_rx_pump(arg);
+}
+
+void radiohead_get_rx_stats(struct radiohead_rx_stats *out)
+{
+    *out = rx.stats;
+    if (driver) {
+        out->n_fifo_full = driver->rxFifoFull();
+        out->max_drained = driver->rxMaxDrained();
     }
 }
 
-static void poll_rx(void *arg)
+const struct rh_nodes *radiohead_get_nodes(void)
 {
-    handle_rx();
-    (void) arg;
+    return nodes;
 }
 
-static void nrf24_irq_handler(int pin, void *arg)
+static void gateway_init(void)
 {
-    int status = driver->spiReadRegister(RH_NRF24_REG_07_STATUS);
-    int gpio = mgos_sys_config_get_radiohead_device_irq_gpio();
+    int max_nodes = mgos_sys_config_get_radiohead_gateway_max_nodes();
 
-    printf("a. gpio %d 0x%02x\n", mgos_gpio_read(gpio), status);
-    if (status & RH_NRF24_RX_DR)
-        handle_rx();
-    status = driver->spiReadRegister(RH_NRF24_REG_07_STATUS);
-    if (status & RH_NRF24_RX_DR)
-        driver->spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
-    printf("b. gpio %d 0x%02x\n", mgos_gpio_read(gpio), driver->spiReadRegister(RH_NRF24_REG_07_STATUS));
-    driver->setModeRx();
-    printf("c. gpio %d 0x%02x\n", mgos_gpio_read(gpio), driver->spiReadRegister(RH_NRF24_REG_07_STATUS));
+    nodes = (struct rh_nodes *) malloc(sizeof(*nodes));
+    if (nodes == NULL || rh_nodes_init(nodes, max_nodes) < 0) {
+        LOG(LL_ERROR, ("Unable to allocate gateway table for %d nodes", max_nodes));
+        free(nodes);
+        nodes = NULL;
+        return;
+    }
+    LOG(LL_INFO, ("RadioHead gateway tracking up to %d nodes", max_nodes));
 }
 
-static void test_tx(void *arg)
+// The pipe addresses of radiohead.sniffer.nodes, or by default of the
+// gateway and of broadcasts
+static int sniffer_nodes(uint8_t *out)
 {
-    int server_addr = mgos_sys_config_get_radiohead_sensor_report_address();
-    static int counter = 0;
-    uint8_t buf[48];
+    const char *list = mgos_sys_config_get_radiohead_sniffer_nodes();
+    int gateway = mgos_sys_config_get_radiohead_sensor_report_address();
+    char *end;
+    long addr;
+    int n = 0;
 
-#if 1
-    if (1) {
-        char msg[15];
-        sprintf(msg, "zing%d", counter++);
-        if (driver->send((const uint8_t *) msg, strlen(msg) + 1)) {
-            bool ret = driver->waitPacketSent();
-            if (ret)
-                printf("packet sent (%d)\n", counter);
-            else {
-                printf("waitpacketsent failed?!\n");
-                driver->printRegisters();
-                config_driver();
-            }
-        } else
-            printf("unable to send\n");
+    if (list == NULL || !*list) {
+        if (gateway >= 0 && gateway != RH_BROADCAST_ADDRESS)
+            out[n++] = gateway;
+        out[n++] = RH_BROADCAST_ADDRESS;
+        return n;
     }
-#endif
-#if 0
-    sprintf((char *) buf, "ping%d", counter++);
-    printf("sending to server at %d\n", server_addr);
-    if (manager->sendtoWait(buf, strlen((char *) buf) + 1, server_addr)) {
-        uint8_t len = sizeof(buf) - 1;
-        uint8_t from;
-        if (manager->recvfromAckTimeout(buf, &len, 5000, &from)) {
-            buf[sizeof(buf)-1] = '\0';
-            printf("Got reply from server %d: %s\n", from, buf);
-        } else {
-            printf("recvfromAck failed\n");
+    while (*list) {
+        addr = strtol(list, &end, 0);
+        if (end == list || addr < 0 || addr > 255 || n == RH_SNIFFER_MAX_NODES)
+            return -1;
+        out[n++] = addr;
+        list = end;
+        while (*list == ',' || *list == ' ')
+            list++;
+    }
+    return n;
+}
+
+static int sniffer_init(void)
+{
+    uint8_t addrs[RH_SNIFFER_MAX_NODES];
+    int n = 0;
+
+    // Without hardware ACKs, all nodes send to the network address
+    if (mgos_sys_config_get_radiohead_device_auto_ack()) {
+        n = sniffer_nodes(addrs);
+        if (n < 0) {
+            LOG(LL_ERROR, ("Invalid radiohead.sniffer.nodes, up to %d addresses allowed",
+                           RH_SNIFFER_MAX_NODES));
+            return -1;
         }
-        printf("sendto succeeded\n");
-    } else {
-        printf("sendto failed\n");
     }
-#endif
-    mgos_set_timer(100 + rand() % 100, 0, test_tx, NULL);
+    driver->setSnifferPipes(addrs, n);
+    driver->setPromiscuous(true);
+    if (rh_sniffer_init(mgos_sys_config_get_radiohead_sniffer_port(),
+                        mgos_sys_config_get_radiohead_sniffer_ring_len()) < 0)
+        return -1;
+    sniffer.enable = true;
+    return 0;
+}
+
+static RHGenericSPI::Frequency spi_frequency(int mhz)
+{
+    if (mhz >= 8)
+        return RHGenericSPI::Frequency8MHz;
+    if (mhz >= 4)
+        return RHGenericSPI::Frequency4MHz;
+    if (mhz >= 2)
+        return RHGenericSPI::Frequency2MHz;
+    return RHGenericSPI::Frequency1MHz;
 }
 
 static int8_t radiohead_initialized = 0;
@@ -198,9 +544,14 @@ int radiohead_init(void)
     if (radiohead_initialized)
         return -1;
 
-    hard_spi = new RHHardwareSPI();
+    hard_spi = new RHHardwareSPI(spi_frequency(mgos_sys_config_get_radiohead_device_spi_freq_mhz()));
     driver = new RH_NRF24(ce_gpio, ss_gpio, *hard_spi);
-    manager = new RHReliableDatagram(*driver, address);
+    if (mgos_sys_config_get_radiohead_routing_enable()) {
+        router = new RHRouter(*driver, address);
+        router->setMaxHops(mgos_sys_config_get_radiohead_routing_max_hops());
+        manager = router;
+    } else
+        manager = new RHReliableDatagram(*driver, address);
 
     if (!manager->init()) {
         LOG(LL_ERROR, ("Manager initialization failed"));
@@ -208,21 +559,43 @@ int radiohead_init(void)
         free(hard_spi);
         return -1;
     }
+    chan.channel = mgos_sys_config_get_radiohead_channel() % RH_CHAN_N;
+    chan.max_rate = rh_chan_rate_from_kbps(mgos_sys_config_get_radiohead_data_rate());
+    chan.rate = chan.max_rate;
+    // Where the gateway last moved the network
+    if (mgos_sys_config_get_radiohead_chan_enable() && mgos_sys_config_get_radiohead_chan_data_rate() > 0)
+        chan.rate = rh_chan_rate_from_kbps(mgos_sys_config_get_radiohead_chan_data_rate());
     config_driver();
+    rx.poll_timer = MGOS_INVALID_TIMER_ID;
+    tdma.timer = MGOS_INVALID_TIMER_ID;
+    if (mgos_sys_config_get_radiohead_sniffer_enable()) {
+        // Nothing else: a sniffer never sends
+        if (sniffer_init() < 0)
+            return -1;
+    } else {
+        if (mgos_sys_config_get_radiohead_gateway_enable())
+            gateway_init();
+        low_power = mgos_sys_config_get_radiohead_node_enable();
+        tdma_init();
+    }
+    chan_init();
+    if (low_power && !tdma.node)
+        driver->setModeIdle();
+    else
+        driver->setModeRx();
     if (irq_gpio >= 0) {
         mgos_gpio_set_mode(irq_gpio, MGOS_GPIO_MODE_INPUT);
         mgos_gpio_set_pull(irq_gpio, MGOS_GPIO_PULL_UP);
-        mgos_gpio_set_int_handler(irq_gpio, MGOS_GPIO_INT_EDGE_NEG, nrf24_irq_handler, NULL);
-        driver->setModeRx();
+        mgos_gpio_set_int_handler_isr(irq_gpio, MGOS_GPIO_INT_EDGE_NEG, nrf24_irq_handler, NULL);
         mgos_gpio_enable_int(irq_gpio);
+    } else {
+        rx.poll_timer = mgos_set_timer(RH_RX_POLL_INTERVAL_MS, MGOS_TIMER_REPEAT,
+                                       nrf24_poll_timer_cb, NULL);
     }
 
     LOG(LL_INFO, ("RadioHead initialized for device address %d (CE GPIO %d, SS GPIO %d, IRQ GPIO %d)",
                   address, ce_gpio, ss_gpio, irq_gpio));
 
-    if (mgos_sys_config_get_radiohead_sensor_report_address() >= 0)
-        mgos_set_timer(200, 0, test_tx, NULL);
-
     radiohead_initialized = 1;
 
     return 0;
@@ -261,46 +634,686 @@ int radiohead_is_initialized(void)
     return radiohead_initialized;
 }
 
-struct rh_message {
-    int server_addr;
-    unsigned int msg_len;
-    uint8_t msg[];
+void radiohead_sleep(void)
+{
+    int irq_gpio = mgos_sys_config_get_radiohead_device_irq_gpio();
+
+    if (!radiohead_initialized)
+        return;
+    if (irq_gpio >= 0)
+        mgos_gpio_disable_int(irq_gpio);
+    if (rx.poll_timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(rx.poll_timer);
+    rx.poll_timer = MGOS_INVALID_TIMER_ID;
+    if (tdma.timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(tdma.timer);
+    tdma.timer = MGOS_INVALID_TIMER_ID;
+    if (chan.timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(chan.timer);
+    chan.timer = MGOS_INVALID_TIMER_ID;
+    chan.tuned_away = false;
+    tx_schedule(0);
+    // Power down: about 1 uA, against 26 uA in standby
+    driver->sleep();
+    radiohead_initialized = 0;
+}
+
+// Reports waiting for the radio. Oldest first; the head is sent next.
+// When full, the oldest report is dropped, and a newer report from the
+// same sensor to the same address replaces the one still waiting.
+struct rh_tx_entry {
+    uint8_t address;
+    uint8_t len;
+    int32_t sensor_id;          // -1 if the message is not a sensor report
+    uint8_t tries;              // In earlier TDMA slots
+    uint8_t msg[RH_NRF24_MAX_MESSAGE_LEN];
 };
 
-static void send_message(void *arg)
+struct rh_tx_queue {
+    uint8_t head;
+    uint8_t n_entries;
+    bool next_pending;
+    struct rh_tx_entry entries[RH_TX_QUEUE_LEN];
+    struct rh_tx_entry sending; // Taken off the queue, kept for the TDMA retries
+
+    struct radiohead_tx_stats stats;
+};
+
+static struct rh_tx_queue txq;
+
+static struct rh_tx_entry *txq_entry(int idx)
+{
+    return &txq.entries[(txq.head + idx) % RH_TX_QUEUE_LEN];
+}
+
+static void txq_drop_head(void)
+{
+    txq.head = (txq.head + 1) % RH_TX_QUEUE_LEN;
+    txq.n_entries--;
+}
+
+// Puts a report taken off the queue back at its head
+static bool txq_push_head(const struct rh_tx_entry *e)
+{
+    if (txq.n_entries == RH_TX_QUEUE_LEN)
+        return false;
+    txq.head = (txq.head + RH_TX_QUEUE_LEN - 1) % RH_TX_QUEUE_LEN;
+    txq.n_entries++;
+    *txq_entry(0) = *e;
+    return true;
+}
+
+static void tx_done(bool acked, uint8_t retries, void *arg);
+static void tx_next(void *arg);
+static void tx_reject_head(void);
+static void tx_next_later(void);
+
+// Air time of a frame: preamble, 5 octet address, 9 bit packet control
+// field, headers, payload and 2 octet CRC at the data rate in use
+static double nrf24_air_time(uint8_t len)
+{
+    return (8 * (1 + 5 + RH_NRF24_HEADER_LEN + len + 2) + 9) / (double) rh_chan_rate_bps(chan.rate);
+}
+
+static void tdma_send_beacon(void *arg)
+{
+    uint8_t buf[RH_TDMA_BEACON_MAX_LEN];
+    struct rh_tdma_beacon beacon;
+    double now = mgos_uptime(), next;
+    int len;
+
+    next = rh_tdma_next_beacon(tdma.schedule, now, &beacon);
+    tdma.timer = mgos_set_timer((next - now) * 1000 + 1, 0, tdma_send_beacon, NULL);
+
+    len = rh_tdma_encode_beacon(&beacon, buf, sizeof(buf));
+    // Not while waiting for an ACK: the superframe goes without a beacon
+    send_broadcast(buf, len, beacon.superframe);
+    (void) arg;
+}
+
+static void tdma_slot(void *arg)
+{
+    tdma.timer = MGOS_INVALID_TIMER_ID;
+    tx_next(NULL);
+    (void) arg;
+}
+
+// Tells whether a report may be sent now. If not, tx_next() is called
+// again at the start of the own slot.
+static bool tdma_may_send(void)
+{
+    double now = mgos_uptime(), start, end;
+
+    // A node hunting for the gateway is not in its superframes
+    if (!tdma.node || chan.hunting)
+        return true;
+    if (tdma.timer != MGOS_INVALID_TIMER_ID)
+        return false;
+    if (!tdma.sync_waited && !rh_tdma_clock_synced(&tdma.clock, now)) {
+        // The first report after a boot waits for a beacon, which ends the
+        // wait, to learn the slot
+        tdma.sync_waited = true;
+        tdma.timer = mgos_set_timer(2 * mgos_sys_config_get_radiohead_tdma_max_slots() *
+                                    mgos_sys_config_get_radiohead_tdma_slot_ms(), 0, tdma_slot, NULL);
+        return false;
+    }
+    // Without sync or a slot, send at once
+    if (!rh_tdma_clock_next_slot(&tdma.clock, now, &start, &end) || start <= now)
+        return true;
+    tdma.timer = mgos_set_timer((start - now) * 1000 + 1, 0, tdma_slot, NULL);
+    return false;
+}
+
+// rx_time: uptime of the interrupt for the beacon, < 0 if not known
+static bool tdma_beacon_rx(const uint8_t *buf, uint8_t len, double rx_time)
+{
+    struct rh_tdma_beacon beacon;
+    uint8_t slot = tdma.clock.slot;
+    bool synced = tdma.clock.synced;
+
+    if (rh_tdma_decode_beacon(buf, len, &beacon) < 0)
+        return false;
+    // The polled RX FIFO has no useful time
+    if (rx.poll_timer != MGOS_INVALID_TIMER_ID)
+        rx_time = -1;
+    if (rx_time >= 0)
+        rx_time -= nrf24_air_time(len);
+    rh_tdma_clock_beacon(&tdma.clock, &beacon, manager->thisAddress(), rx_time);
+    if (tdma.clock.slot != slot)
+        LOG(LL_INFO, ("RH TDMA slot %d of %d (%d ms)", tdma.clock.slot, beacon.n_slots,
+                      beacon.slot_ms));
+    // A report waiting for the first beacon can find its slot now
+    if (!synced && tdma.clock.synced && tdma.timer != MGOS_INVALID_TIMER_ID) {
+        mgos_clear_timer(tdma.timer);
+        tdma.timer = MGOS_INVALID_TIMER_ID;
+        tx_next_later();
+    }
+    return true;
+}
+
+static void tdma_init(void)
 {
-    struct rh_message *rh_msg = (struct rh_message *) arg;
+    int slot_ms = mgos_sys_config_get_radiohead_tdma_slot_ms();
+    int retries = mgos_sys_config_get_radiohead_tdma_retries();
+
+    tdma.timer = MGOS_INVALID_TIMER_ID;
+    if (!mgos_sys_config_get_radiohead_tdma_enable())
+        return;
+    // Routed messages carry a routing header the beacons do not have, and
+    // relays forward them at once
+    if (router) {
+        LOG(LL_ERROR, ("RH TDMA does not work with radiohead.routing.enable"));
+        return;
+    }
+
+    if (mgos_sys_config_get_radiohead_gateway_enable()) {
+        tdma.schedule = (struct rh_tdma_schedule *) malloc(sizeof(*tdma.schedule));
+        if (tdma.schedule == NULL) {
+            LOG(LL_ERROR, ("Unable to allocate TDMA schedule"));
+            return;
+        }
+        rh_tdma_schedule_init(tdma.schedule, slot_ms, mgos_sys_config_get_radiohead_tdma_max_slots(),
+                              mgos_uptime());
+        tdma.timer = mgos_set_timer(slot_ms, 0, tdma_send_beacon, NULL);
+        LOG(LL_INFO, ("RH TDMA gateway, %d ms slots", tdma.schedule->slot_ms));
+        return;
+    }
 
-    LOG(LL_DEBUG, ("Sending RH message with %d bytes to addr %d",
-                   rh_msg->msg_len, rh_msg->server_addr));
-    if (manager->sendtoWait(rh_msg->msg, rh_msg->msg_len, rh_msg->server_addr))
-        LOG(LL_ERROR, ("Unable to send message (sendtoWait failed)"));
-    free(rh_msg);
+    tdma.node = true;
+    rh_tdma_clock_init(&tdma.clock);
+    tdma.retries = retries < 0 ? 0 : retries;
+    // One try per slot: the retries go in the next superframes, and the
+    // ACK is due within the slot
+    manager->setRetries(0);
+    manager->setTimeout(slot_ms / 2 > 1 ? slot_ms / 2 : 1);
+    if (mgos_sys_config_get_radiohead_device_irq_gpio() < 0)
+        LOG(LL_WARN, ("RH TDMA node without an IRQ GPIO cannot sync to the beacons"));
+}
+
+// Moves the radio to another channel or data rate
+static void chan_apply(uint8_t channel, enum rh_chan_rate rate)
+{
+    bool rx_on = driver->mode() == RHGenericDriver::RHModeRx;
+
+    chan.channel = channel;
+    chan.rate = rate;
+    driver->setModeIdle();
+    driver->setChannel(channel);
+    driver->setRF(nrf24_data_rate(rate), RH_NRF24::TransmitPower0dBm);
+    if (rx_on)
+        driver->setModeRx();
+}
+
+// Keeps the channel and rate over a reboot, and over the deep sleep of a
+// low-power node
+static void chan_save(void)
+{
+    char *msg = NULL;
+
+    mgos_sys_config_set_radiohead_channel(chan.channel);
+    mgos_sys_config_set_radiohead_chan_data_rate(rh_chan_rate_bps(chan.rate) / 1000);
+    if (!save_cfg(&mgos_sys_config, &msg)) {
+        LOG(LL_ERROR, ("Unable to save RH channel: %s", msg ? msg : ""));
+        free(msg);
+    }
+}
+
+static void chan_switched(void)
+{
+    chan.stats.n_changes++;
+    LOG(LL_INFO, ("RH now on channel %d at %u kbit/s", chan.channel,
+                  (unsigned int) (rh_chan_rate_bps(chan.rate) / 1000)));
+    chan_save();
+}
+
+// Gateway: the loss is judged from the switch on
+static void chan_monitor_reset(void)
+{
+    struct rh_nodes_summary sum;
+
+    memset(&sum, 0, sizeof(sum));
+    if (nodes)
+        rh_nodes_summarize(nodes, (uint32_t) mgos_uptime(), 0, &sum);
+    rh_chan_monitor_init(&chan.monitor, mgos_sys_config_get_radiohead_chan_max_loss_pct() * 10,
+                         mgos_sys_config_get_radiohead_chan_min_packets(), sum.n_packets, sum.n_lost);
+}
+
+static void chan_announce(void *arg)
+{
+    uint8_t buf[RH_CHAN_ANNOUNCE_LEN];
+    int len;
+
+    chan.timer = MGOS_INVALID_TIMER_ID;
+    if (!chan.announce_left) {
+        chan_apply(chan.announce.channel, (enum rh_chan_rate) chan.announce.rate);
+        chan_switched();
+        chan_monitor_reset();
+        return;
+    }
+    chan.announce.delay_ms = chan.announce_left * RH_CHAN_ANNOUNCE_INTERVAL_MS;
+    chan.announce_left--;
+    chan.timer = mgos_set_timer(RH_CHAN_ANNOUNCE_INTERVAL_MS, 0, chan_announce, NULL);
+
+    len = rh_chan_encode_announce(&chan.announce, buf, sizeof(buf));
+    // Not while waiting for an ACK: the nodes hear one of the others
+    if (send_broadcast(buf, len, chan.announce_id))
+        chan.announce_id++;
+    (void) arg;
+}
+
+static void chan_announce_start(uint8_t channel, enum rh_chan_rate rate)
+{
+    LOG(LL_INFO, ("RH moving from channel %d at %u kbit/s to channel %d at %u kbit/s",
+                  chan.channel, (unsigned int) (rh_chan_rate_bps(chan.rate) / 1000), channel,
+                  (unsigned int) (rh_chan_rate_bps(rate) / 1000)));
+    chan.announce.serial++;
+    chan.announce.channel = channel;
+    chan.announce.rate = rate;
+    chan.announce_left = RH_CHAN_ANNOUNCE_REPEATS;
+    chan_announce(NULL);
+}
+
+static void chan_survey_done(void)
+{
+    int first = mgos_sys_config_get_radiohead_chan_first();
+    int last = mgos_sys_config_get_radiohead_chan_last();
+    char map[RH_CHAN_N + 1];
+    enum rh_chan_rate rate = chan.rate;
+    uint8_t channel;
+    bool change;
+
+    rh_chan_survey_format(chan.survey, map);
+    LOG(LL_INFO, ("RH channel occupancy (tens of %%, from channel 0): %s", map));
+    if (chan.initial) {
+        channel = rh_chan_pick(chan.survey, first, last, chan.channel);
+        change = channel != chan.channel;
+    } else {
+        change = rh_chan_decide(chan.survey, first, last, chan.channel, chan.rate, &channel, &rate);
+        if (!change)
+            LOG(LL_WARN, ("RH link degraded, but no better channel or slower rate to move to"));
+    }
+    chan.initial = false;
+    if (change)
+        chan_announce_start(channel, rate);
+    else
+        chan_monitor_reset();
+}
+
+// Tunes to the next channel on one tick and reads its RPD on the next,
+// so that the loop never waits for the radio. The nodes are heard on
+// the own channel between the channels.
+static void chan_sweep(void *arg)
+{
+    bool rpd;
+
+    chan.timer = MGOS_INVALID_TIMER_ID;
+    if (chan.tuned_away) {
+        rpd = driver->spiReadRegister(RH_NRF24_REG_09_RPD) & RH_NRF24_RPD;
+        rh_chan_survey_add(chan.survey, chan.sweep_channel, rpd);
+        chan_sweep_cancel();
+        if (++chan.sweep_channel == RH_CHAN_N) {
+            rh_chan_survey_sweep_done(chan.survey);
+            chan.sweep_channel = 0;
+            if (--chan.sweeps_left <= 0) {
+                chan_survey_done();
+                return;
+            }
+        }
+    } else if (!manager->asyncBusy() && driver->mode() != RHGenericDriver::RHModeTx) {
+        // Not while sending or waiting for an ACK: the next tick instead
+        driver->setModeIdle();
+        driver->setChannel(chan.sweep_channel);
+        driver->setModeRx();
+        chan.tuned_away = true;
+        chan.timer = mgos_set_timer(RH_CHAN_DWELL_MS, 0, chan_sweep, NULL);
+        return;
+    }
+    chan.timer = mgos_set_timer(RH_CHAN_STEP_INTERVAL_MS, 0, chan_sweep, NULL);
+    (void) arg;
+}
+
+static void chan_survey_start(bool initial)
+{
+    int sweeps = mgos_sys_config_get_radiohead_chan_sweeps();
+
+    rh_chan_survey_init(chan.survey);
+    chan.initial = initial;
+    chan.sweeps_left = sweeps > 0 ? sweeps : 1;
+    chan.sweep_channel = 0;
+    chan.tuned_away = false;
+    chan.stats.n_surveys++;
+    chan.timer = mgos_set_timer(RH_CHAN_STEP_INTERVAL_MS, 0, chan_sweep, NULL);
+}
+
+// Gateway: every radiohead.chan.check_interval, from the loss of the
+// nodes' ID sequences
+static void chan_check(void *arg)
+{
+    struct rh_nodes_summary sum;
+
+    // Surveying or switching
+    if (!nodes || chan.timer != MGOS_INVALID_TIMER_ID)
+        return;
+    rh_nodes_summarize(nodes, (uint32_t) mgos_uptime(), 0, &sum);
+    switch (rh_chan_monitor_check(&chan.monitor, sum.n_packets, sum.n_lost)) {
+    case RH_CHAN_DEGRADED:
+        LOG(LL_WARN, ("RH link degraded on channel %d, surveying", chan.channel));
+        chan_survey_start(false);
+        break;
+    case RH_CHAN_GOOD_LONG:
+        // Back towards radiohead.data_rate
+        if (chan.rate > chan.max_rate)
+            chan_announce_start(chan.channel, (enum rh_chan_rate) (chan.rate - 1));
+        break;
+    default:
+        break;
+    }
+    (void) arg;
+}
+
+// Nodes: the gateway moves after the delay of the announcement
+static void chan_follow(void *arg)
+{
+    chan.timer = MGOS_INVALID_TIMER_ID;
+    chan_apply(chan.announce.channel, (enum rh_chan_rate) chan.announce.rate);
+    chan_switched();
+    (void) arg;
+}
+
+static bool chan_announce_rx(const uint8_t *buf, uint8_t len)
+{
+    struct rh_chan_announce announce;
+
+    if (rh_chan_decode_announce(buf, len, &announce) < 0)
+        return false;
+    // The repeats of the one already followed
+    if (chan.gateway || chan.timer != MGOS_INVALID_TIMER_ID ||
+        (announce.channel == chan.channel && announce.rate == chan.rate))
+        return true;
+    chan.announce = announce;
+    chan.timer = mgos_set_timer(announce.delay_ms ? announce.delay_ms : 1, 0, chan_follow, NULL);
+    return true;
+}
+
+static void chan_hunt_end(void)
+{
+    chan.hunting = false;
+    chan.n_failed = 0;
+    manager->setRetries(chan.retries);
+    manager->setTimeout(chan.timeout);
+}
+
+// A report was acknowledged
+static void chan_acked(void)
+{
+    chan.n_failed = 0;
+    if (!chan.hunting)
+        return;
+    chan_hunt_end();
+    chan_switched();
+}
+
+// A report failed. After radiohead.chan.hunt_after in a row (or the first
+// on a low-power node, which sends one per wake), the gateway may have
+// moved: the report is tried on every channel and rate until it answers.
+// Returns true if the report goes again.
+static bool chan_hunt(void)
+{
+    int hunt_after = mgos_sys_config_get_radiohead_chan_hunt_after();
+
+    if (!chan.enable || chan.gateway)
+        return false;
+    if (!chan.hunting) {
+        if (++chan.n_failed < (low_power || hunt_after < 1 ? 1u : (unsigned int) hunt_after))
+            return false;
+        rh_chan_hunt_init(&chan.hunt, mgos_sys_config_get_radiohead_chan_first(),
+                          mgos_sys_config_get_radiohead_chan_last(), chan.channel, chan.rate);
+        chan.hunting = true;
+        chan.stats.n_hunts++;
+        manager->setRetries(0);
+        manager->setTimeout(RH_CHAN_HUNT_TIMEOUT_MS);
+        LOG(LL_WARN, ("RH gateway lost on channel %d, searching", chan.channel));
+    }
+    if (!rh_chan_hunt_next(&chan.hunt)) {
+        chan_hunt_end();
+        chan_apply(chan.hunt.start_channel, (enum rh_chan_rate) chan.hunt.start_rate);
+        chan.stats.n_hunts_failed++;
+        LOG(LL_ERROR, ("RH gateway not found on any channel"));
+        return false;
+    }
+    chan_apply(chan.hunt.channel, (enum rh_chan_rate) chan.hunt.rate);
+    return txq_push_head(&txq.sending);
+}
+
+static void chan_init(void)
+{
+    chan.timer = MGOS_INVALID_TIMER_ID;
+    if (!mgos_sys_config_get_radiohead_chan_enable())
+        return;
+    // Routed messages carry a routing header the announcements do not have
+    if (router) {
+        LOG(LL_ERROR, ("RH channel selection does not work with radiohead.routing.enable"));
+        return;
+    }
+    chan.enable = true;
+    chan.retries = manager->retries();
+    chan.timeout = manager->timeout();
+    // A sniffer follows the gateway like the nodes do
+    if (!mgos_sys_config_get_radiohead_gateway_enable() || sniffer.enable)
+        return;
+
+    chan.survey = (struct rh_chan_survey *) malloc(sizeof(*chan.survey));
+    if (chan.survey == NULL) {
+        LOG(LL_ERROR, ("Unable to allocate RH channel survey"));
+        return;
+    }
+    chan.gateway = true;
+    chan_monitor_reset();
+    mgos_set_timer(mgos_sys_config_get_radiohead_chan_check_interval() * 1000, MGOS_TIMER_REPEAT,
+                   chan_check, NULL);
+    chan_survey_start(true);
+}
+
+// Starts sending the head of the queue, if the radio is free
+static void tx_next(void *arg)
+{
+    struct rh_tx_entry *e;
+
+    txq.next_pending = false;
+    if ((router ? router->queueFull() : manager->asyncBusy()) || !txq.n_entries)
+        return;
+    if (!tdma_may_send())
+        return;
+
+    dl_unload();
+    chan_sweep_cancel();
+    e = txq_entry(0);
+    LOG(LL_DEBUG, ("Sending RH message with %d bytes to addr %d", e->len, e->address));
+    if (router) {
+        uint8_t err = router->sendtoAsync(e->msg, e->len, e->address, tx_done, NULL);
+
+        if (err == RH_ROUTER_ERROR_QUEUE_FULL)
+            return;
+        if (err != RH_ROUTER_ERROR_NONE) {
+            LOG(LL_ERROR, ("RH message with %d bytes too long for routing", e->len));
+            tx_reject_head();
+            return;
+        }
+    } else if (!manager->sendtoAsync(e->msg, e->len, e->address, tx_done, NULL)) {
+        // Not busy, checked above: the message can never be sent
+        LOG(LL_ERROR, ("RH message with %d bytes not accepted by the manager", e->len));
+        tx_reject_head();
+        return;
+    }
+    txq.sending = *e;
+    txq_drop_head();
+    tx_schedule(1);
+    (void) arg;
+}
+
+static struct {
+    radiohead_sent_cb cb;
+    void *arg;
+} sent;
+
+void radiohead_set_sent_handler(radiohead_sent_cb cb, void *arg)
+{
+    sent.cb = cb;
+    sent.arg = arg;
+}
+
+// Sends the next report from the loop
+static void tx_next_later(void)
+{
+    if (txq.n_entries && !txq.next_pending) {
+        txq.next_pending = true;
+        if (!mgos_invoke_cb(tx_next, NULL, false))
+            txq.next_pending = false;
+    }
+}
+
+// Fails the head of the queue without sending it: no retries or hunts,
+// as no other try would go better, and on to the next report
+static void tx_reject_head(void)
+{
+    txq_drop_head();
+    txq.stats.n_failed++;
+    tx_next_later();
+    if (sent.cb != NULL)
+        sent.cb(false, 0, sent.arg);
+}
+
+// A report not acknowledged in its TDMA slot goes back to the head of the
+// queue for the next superframe, unless a newer one has replaced it
+static bool txq_retry(void)
+{
+    struct rh_tx_entry *e = &txq.sending;
+    int i;
+
+    if (!tdma.node || e->tries >= tdma.retries)
+        return false;
+    for (i = 0; e->sensor_id >= 0 && i < txq.n_entries; i++) {
+        if (txq_entry(i)->address == e->address && txq_entry(i)->sensor_id == e->sensor_id) {
+            txq.stats.n_coalesced++;
+            return true;
+        }
+    }
+    if (txq.n_entries == RH_TX_QUEUE_LEN)
+        return false;
+    e->tries++;
+    return txq_push_head(e);
+}
+
+static void tx_done(bool acked, uint8_t retries, void *arg)
+{
+    uint8_t buf[RH_NRF24_MAX_MESSAGE_LEN];
+    uint8_t len = sizeof(buf);
+    bool retry = false;
+
+    if (tdma.node)
+        retries = txq.sending.tries;
+    if (acked) {
+        txq.stats.n_sent++;
+        chan_acked();
+        LOG(LL_DEBUG, ("RH sensor report delivered (%d retries)", retries));
+        // The gateway may have had something for us
+        if (driver->recvAckPayload(buf, &len)) {
+            if (dl.cb != NULL)
+                dl.cb(driver->headerFrom(), buf, len, dl.cb_arg);
+            else
+                LOG(LL_INFO, ("RH downlink message from %d (%d bytes) ignored",
+                              driver->headerFrom(), len));
+        }
+    } else if (txq_retry() || chan_hunt()) {
+        retry = true;
+    } else {
+        txq.stats.n_failed++;
+        LOG(LL_ERROR, ("RH sensor report not acknowledged after %d retries", retries));
+    }
+
+    // Called from within the manager, so send the next one from the loop
+    tx_next_later();
+    if (sent.cb != NULL && !retry)
+        sent.cb(acked, retries, sent.arg);
+    (void) arg;
+}
+
+static void txq_add(uint8_t address, const void *msg, unsigned int msg_len)
+{
+    struct rf_report_view report;
+    struct rh_tx_entry *e = NULL;
+    int32_t sensor_id = -1;
+    int i;
+
+    if (rf_report_decode_msg((const uint8_t *) msg, msg_len, &report) == 0)
+        sensor_id = report.sensor_id;
+
+    for (i = 0; sensor_id >= 0 && i < txq.n_entries; i++) {
+        if (txq_entry(i)->address == address && txq_entry(i)->sensor_id == sensor_id) {
+            e = txq_entry(i);
+            txq.stats.n_coalesced++;
+            break;
+        }
+    }
+    if (e == NULL) {
+        if (txq.n_entries == RH_TX_QUEUE_LEN) {
+            txq_drop_head();
+            txq.stats.n_dropped++;
+        }
+        e = txq_entry(txq.n_entries++);
+    }
+
+    e->address = address;
+    e->len = msg_len;
+    e->sensor_id = sensor_id;
+    e->tries = 0;
+    memcpy(e->msg, msg, msg_len);
+
+    if (txq.n_entries > txq.stats.max_depth)
+        txq.stats.max_depth = txq.n_entries;
+}
+
+void radiohead_get_tx_stats(struct radiohead_tx_stats *out)
+{
+    *out = txq.stats;
+    out->depth = txq.n_entries;
+    out->hw_retransmissions = driver->txRetransmissions();
+    out->hw_lost = driver->txLost();
+    out->hw_timeouts = driver->txTimeouts();
+}
+
+void radiohead_get_chan_stats(struct radiohead_chan_stats *out)
+{
+    *out = chan.stats;
+    out->channel = chan.channel;
+    out->data_rate_kbps = rh_chan_rate_bps(chan.rate) / 1000;
 }
 
 int radiohead_send_sensor_report(const void *msg, unsigned int msg_len)
 {
-    struct rh_message *rh_msg;
     int server_addr;
 
     if (!radiohead_is_initialized()) {
         LOG(LL_ERROR, ("RH not initialized, unable to send sensor report"));
         return -1;
     }
+    if (sniffer.enable) {
+        LOG(LL_ERROR, ("RH sniffer does not send, sensor report dropped"));
+        return -1;
+    }
     server_addr = mgos_sys_config_get_radiohead_sensor_report_address();
     if (server_addr < 0) {
         LOG(LL_ERROR, ("RH server address not configured"));
         return -1;
     }
 
-    rh_msg = (struct rh_message *) malloc(sizeof(*rh_msg) + msg_len);
-    rh_msg->server_addr = server_addr;
-    rh_msg->msg_len = msg_len;
-    memcpy(rh_msg->msg, msg, msg_len);
-    if (!mgos_invoke_cb(send_message, rh_msg, false)) {
-        free(rh_msg);
+    if (msg_len > RH_NRF24_MAX_MESSAGE_LEN) {
+        LOG(LL_ERROR, ("RH sensor report too long (%d bytes)", msg_len));
         return -1;
     }
 
+    txq_add(server_addr, msg, msg_len);
+    tx_next(NULL);
+
     return 0;
 }
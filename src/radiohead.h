@@ -1,14 +1,67 @@
 #ifndef __MOSTHING_RADIOHEAD_H
 #define __MOSTHING_RADIOHEAD_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "rh_nodes.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct radiohead_rx_stats {
+    uint32_t n_irqs;
+    uint32_t n_messages;        // Sensor reports published
+    uint32_t n_invalid;
+    double latency_sum;         // Seconds from IRQ to MQTT publish
+    double latency_max;
+    uint32_t n_fifo_full;       // RX FIFO found full, messages may have been lost
+    uint32_t max_drained;       // Most messages taken from the RX FIFO at once
+};
+
+typedef void (*radiohead_downlink_cb)(uint8_t from, const uint8_t *msg, unsigned int msg_len, void *arg);
+typedef void (*radiohead_sent_cb)(bool acked, uint8_t retries, void *arg);
+
+struct radiohead_tx_stats {
+    uint32_t depth;             // Reports waiting in the queue now
+    uint32_t max_depth;
+    uint32_t n_sent;            // Acknowledged
+    uint32_t n_failed;          // Retries exhausted
+    uint32_t n_dropped;         // Queue full, oldest report dropped
+    uint32_t n_coalesced;       // Replaced by a newer report from the same sensor
+    uint32_t hw_timeouts;       // Never reported as sent by the radio
+
+    // With radiohead.device.auto_ack
+    uint32_t hw_retransmissions;
+    uint32_t hw_lost;           // Not acknowledged after all hardware retries
+};
+
+struct radiohead_chan_stats {
+    uint32_t channel;
+    uint32_t data_rate_kbps;
+    uint32_t n_changes;         // Moves to another channel or data rate
+    uint32_t n_surveys;         // Gateway
+    uint32_t n_hunts;           // Nodes: searches for the gateway on all channels
+    uint32_t n_hunts_failed;
+};
+
 int radiohead_init(void);
 int radiohead_is_configured(void);
 int radiohead_is_initialized(void);
 int radiohead_send_sensor_report(const void *msg, unsigned int msg_len);
+// Called when each report has been acknowledged or has failed
+void radiohead_set_sent_handler(radiohead_sent_cb cb, void *arg);
+// Powers the radio down until the next radiohead_init(), after a reset
+void radiohead_sleep(void);
+void radiohead_get_rx_stats(struct radiohead_rx_stats *out);
+void radiohead_get_tx_stats(struct radiohead_tx_stats *out);
+void radiohead_get_chan_stats(struct radiohead_chan_stats *out);
+// NULL unless radiohead.gateway.enable is set
+const struct rh_nodes *radiohead_get_nodes(void);
+
+// Downlink messages ride on the hardware ACKs (radiohead.device.auto_ack)
+int radiohead_queue_downlink(uint8_t node, const void *msg, unsigned int msg_len);
+void radiohead_set_downlink_handler(radiohead_downlink_cb cb, void *arg);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,71 @@
+#include <mgos.h>
+#include <mgos_mqtt.h>
+#include "capture.h"
+
+int rf433_capture_init(struct rf433_capture *cap, const char *file, long max_size,
+                       const char *mqtt_topic)
+{
+    memset(cap, 0, sizeof(*cap));
+
+    if (file != NULL && *file) {
+        cap->fp = fopen(file, "ab");
+        if (cap->fp == NULL) {
+            LOG(LL_ERROR, ("Unable to open 433 MHz capture file %s", file));
+            return -1;
+        }
+        fseek(cap->fp, 0, SEEK_END);
+        cap->file_size = ftell(cap->fp);
+        cap->max_size = max_size;
+        if (cap->file_size == 0) {
+            uint8_t header[RF433_CAPTURE_HEADER_LEN];
+
+            rf433_capture_write_header(header);
+            fwrite(header, sizeof(header), 1, cap->fp);
+            cap->file_size = sizeof(header);
+        }
+        LOG(LL_INFO, ("Capturing 433 MHz pulses to %s (%ld/%ld bytes used)",
+                      file, cap->file_size, cap->max_size));
+    }
+    if (mqtt_topic != NULL && *mqtt_topic) {
+        cap->mqtt_topic = strdup(mqtt_topic);
+        LOG(LL_INFO, ("Publishing 433 MHz pulses to MQTT topic %s", mqtt_topic));
+    }
+
+    return 0;
+}
+
+bool rf433_capture_enabled(const struct rf433_capture *cap)
+{
+    return cap->fp != NULL || cap->mqtt_topic != NULL;
+}
+
+void rf433_capture_pulse(struct rf433_capture *cap, const struct timing *t)
+{
+    if (cap->len + RF433_CAPTURE_PULSE_LEN > (int) sizeof(cap->buf))
+        rf433_capture_flush(cap);
+    rf433_capture_encode(cap->buf + cap->len, t);
+    cap->len += RF433_CAPTURE_PULSE_LEN;
+}
+
+// Writes out the pulses collected so far. Called at the end of each burst.
+void rf433_capture_flush(struct rf433_capture *cap)
+{
+    if (!cap->len)
+        return;
+
+    if (cap->fp != NULL) {
+        if (cap->file_size + cap->len > cap->max_size) {
+            LOG(LL_INFO, ("433 MHz capture file full (%ld bytes)", cap->file_size));
+            fclose(cap->fp);
+            cap->fp = NULL;
+        } else {
+            fwrite(cap->buf, cap->len, 1, cap->fp);
+            fflush(cap->fp);
+            cap->file_size += cap->len;
+        }
+    }
+    if (cap->mqtt_topic != NULL)
+        mgos_mqtt_pub(cap->mqtt_topic, cap->buf, cap->len, 0, false);
+
+    cap->len = 0;
+}
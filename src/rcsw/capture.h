@@ -0,0 +1,82 @@
+/*
+ Raw 433 MHz pulse capture format
+
+ - Header: 8 bytes
+   - Magic: "RF433" (5 bytes)
+   - Format version: 8 bits
+   - Padding: 16 bits
+ - Pulses: 16 bits each, little endian
+   - Line state: 1 bit (bit 15)
+   - Duration in microseconds: 15 bits
+
+ Capture files start with the header. Bursts published over MQTT only
+ contain the pulses, so that the messages can simply be concatenated
+ after a header.
+ */
+
+#ifndef __RCSW_CAPTURE_H
+#define __RCSW_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "decoder.h"
+
+#define RF433_CAPTURE_MAGIC         "RF433"
+#define RF433_CAPTURE_VERSION       1
+#define RF433_CAPTURE_HEADER_LEN    8
+#define RF433_CAPTURE_PULSE_LEN     2
+
+#define RF433_CAPTURE_BUF_PULSES    180
+
+static inline void rf433_capture_write_header(uint8_t *buf)
+{
+    memcpy(buf, RF433_CAPTURE_MAGIC, 5);
+    buf[5] = RF433_CAPTURE_VERSION;
+    buf[6] = 0;
+    buf[7] = 0;
+}
+
+// Returns the length of the header at the start of buf, 0 if there is no
+// header and -1 if the format version is not supported.
+static inline int rf433_capture_check_header(const uint8_t *buf, size_t len)
+{
+    if (len < RF433_CAPTURE_HEADER_LEN || memcmp(buf, RF433_CAPTURE_MAGIC, 5) != 0)
+        return 0;
+    if (buf[5] != RF433_CAPTURE_VERSION)
+        return -1;
+    return RF433_CAPTURE_HEADER_LEN;
+}
+
+static inline void rf433_capture_encode(uint8_t *buf, const struct timing *t)
+{
+    uint16_t val = (t->state << 15) | t->time_us;
+
+    buf[0] = val;
+    buf[1] = val >> 8;
+}
+
+static inline void rf433_capture_decode(const uint8_t *buf, struct timing *t)
+{
+    uint16_t val = buf[0] | (buf[1] << 8);
+
+    t->state = val >> 15;
+    t->time_us = val & TIMING_MAX_US;
+}
+
+struct rf433_capture {
+    FILE *fp;
+    long file_size, max_size;
+    char *mqtt_topic;
+
+    int len;
+    uint8_t buf[RF433_CAPTURE_BUF_PULSES * RF433_CAPTURE_PULSE_LEN];
+};
+
+int rf433_capture_init(struct rf433_capture *cap, const char *file, long max_size,
+                       const char *mqtt_topic);
+bool rf433_capture_enabled(const struct rf433_capture *cap);
+void rf433_capture_pulse(struct rf433_capture *cap, const struct timing *t);
+void rf433_capture_flush(struct rf433_capture *cap);
+
+#endif
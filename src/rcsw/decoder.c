@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <string.h>
+#include "decoder.h"
+
+enum {
+    STATE_IDLE,             // Waiting for the high pulse of a sync word
+    STATE_SYNC_LOW,         // Waiting for the low pulse of a sync word
+    STATE_SYNC_HIGH,        // Waiting for a repeated sync word or the first data bit
+    STATE_DATA_HIGH,
+    STATE_DATA_LOW,
+};
+
+// Symbols a high pulse can be the start of
+#define HIGH_MATCH_MASK (RF433_H_ZERO | RF433_H_ONE | RF433_H_PAUSE | RF433_H_SYNC_MIN)
+
+int rf433_nexa_decode(const struct rf433_protocol *proto, struct bitset *code)
+{
+    if (code->n_bits != 64)
+        return -1;
+
+    (void) proto;
+    return bitset_manchester_decode(code, code);
+}
+
+int rf433_nexa_describe(const struct rf433_protocol *proto, const struct bitset *code,
+                        char *buf, int buf_len)
+{
+    uint32_t transmitter_id, flags;
+    uint8_t unit_id, channel;
+
+    transmitter_id = bitset_get_bits(code, 0, 26);
+    // Bits 26-31: group, off, channel (2 bits, MSB first), unit (2 bits)
+    flags = bitset_get_bits(code, 26, 6);
+
+    channel = ((flags >> 1) & 0x02) | ((flags >> 3) & 0x01);
+    unit_id = (1 << ((flags >> 4) & 0x01)) | ((flags >> 5) & 0x01);
+    if (channel == 3)
+        unit_id = ~unit_id & 0x03;
+    unit_id = unit_id + 1;
+
+    (void) proto;
+    return snprintf(buf, buf_len, "transmitter 0x%08x %s unit %d: %s",
+                    (unsigned int) transmitter_id, flags & 0x01 ? "" : "group",
+                    unit_id, flags & 0x02 ? "off" : "on");
+}
+
+static inline struct bitset *proto_code(struct rf433_proto_state *st)
+{
+    return (struct bitset *) st->code_buf;
+}
+
+static void start_data(struct rf433_proto_state *st)
+{
+    bitset_init(st->code_buf, sizeof(st->code_buf));
+    st->state = STATE_DATA_HIGH;
+}
+
+static void end_frame(struct rf433_decoder *dec, const struct rf433_protocol *proto,
+                      struct rf433_proto_state *st, uint32_t end_pos)
+{
+    struct bitset *code = proto_code(st);
+    struct rf433_frame frame;
+
+    if (code->n_bits < RF433_MIN_CODE_BITS)
+        return;
+    if (proto->decode != NULL && proto->decode(proto, code) < 0)
+        return;
+
+    frame.proto = proto;
+    frame.pos = st->start_pos;
+    frame.end_pos = end_pos;
+    frame.code = code;
+    dec->last_frame_end = end_pos;
+    dec->n_frames++;
+    if (dec->frame_cb != NULL)
+        dec->frame_cb(&frame, dec->cb_arg);
+}
+
+static void proto_idle(struct rf433_decoder *dec, struct rf433_proto_state *st,
+                       uint16_t cls)
+{
+    st->state = STATE_IDLE;
+    if (!(cls & RF433_H_SYNC_MIN))
+        return;
+    st->state = STATE_SYNC_LOW;
+    st->n_sync = 0;
+    st->high_match = 0;
+    st->start_pos = dec->pos;
+}
+
+static void proto_data_low(struct rf433_decoder *dec, const struct rf433_protocol *proto,
+                           struct rf433_proto_state *st, uint16_t cls)
+{
+    struct bitset *code = proto_code(st);
+    uint8_t match = st->high_match;
+
+    if ((match & RF433_H_ZERO) && (cls & RF433_L_ZERO))
+        bitset_append(code, 0);
+    else if ((match & RF433_H_ONE) && (cls & RF433_L_ONE))
+        bitset_append(code, 1);
+    else if ((match & RF433_H_PAUSE) && (cls & RF433_L_PAUSE)) {
+        // It's the pause "bit" between transmissions
+        end_frame(dec, proto, st, dec->pos + 1);
+        st->state = STATE_IDLE;
+        return;
+    } else if ((match & RF433_H_SYNC_MIN) && (cls & RF433_L_SYNC)) {
+        // Next transmission starts right away
+        end_frame(dec, proto, st, dec->pos - 1);
+        st->start_pos = dec->pos - 1;
+        st->n_sync = 1;
+        st->high_match = 0;
+        if (st->n_sync == (proto->sync_max ? proto->sync_max : 1))
+            start_data(st);
+        else
+            st->state = STATE_SYNC_HIGH;
+        return;
+    } else {
+        if (cls & RF433_L_GAP)
+            end_frame(dec, proto, st, dec->pos + 1);
+        st->state = STATE_IDLE;
+        return;
+    }
+
+    // No need to wait for the pause if we already have the whole frame
+    if (code->n_bits == proto->n_bits || code->n_bits == code->max_bits) {
+        end_frame(dec, proto, st, dec->pos + 1);
+        st->state = STATE_IDLE;
+        return;
+    }
+    st->state = STATE_DATA_HIGH;
+}
+
+// Advances the state machine of one protocol with the symbol classes the
+// current pulse matches (only the bits for the pulse's level are set).
+static void proto_step(struct rf433_decoder *dec, const struct rf433_protocol *proto,
+                       struct rf433_proto_state *st, uint16_t cls)
+{
+    int sync_min = proto->sync_min ? proto->sync_min : 1;
+    int sync_max = proto->sync_max ? proto->sync_max : 1;
+
+    switch (st->state) {
+    case STATE_IDLE:
+        proto_idle(dec, st, cls);
+        break;
+    case STATE_SYNC_LOW:
+        if (cls & RF433_L_SYNC) {
+            st->n_sync++;
+            if (st->n_sync == sync_max)
+                start_data(st);
+            else
+                st->state = STATE_SYNC_HIGH;
+        } else if (st->n_sync >= sync_min && st->high_match) {
+            // The high pulse we took for another sync word was the first
+            // data bit instead.
+            start_data(st);
+            proto_data_low(dec, proto, st, cls);
+        } else
+            proto_idle(dec, st, cls);
+        break;
+    case STATE_SYNC_HIGH:
+        if (cls & RF433_H_SYNC) {
+            st->high_match = st->n_sync >= sync_min ? cls & HIGH_MATCH_MASK : 0;
+            st->state = STATE_SYNC_LOW;
+            break;
+        }
+        if (st->n_sync < sync_min) {
+            proto_idle(dec, st, cls);
+            break;
+        }
+        start_data(st);
+        /* fall through */
+    case STATE_DATA_HIGH:
+        st->high_match = cls & HIGH_MATCH_MASK;
+        if (st->high_match)
+            st->state = STATE_DATA_LOW;
+        else
+            proto_idle(dec, st, cls);
+        break;
+    case STATE_DATA_LOW:
+        proto_data_low(dec, proto, st, cls);
+        break;
+    }
+}
+
+void rf433_decoder_reset(struct rf433_decoder *dec)
+{
+    dec->pos = 0;
+    dec->last_frame_end = 0;
+    dec->n_frames = 0;
+    for (int i = 0; i < dec->n_protocols; i++)
+        dec->proto_state[i].state = STATE_IDLE;
+}
+
+void rf433_decoder_init(struct rf433_decoder *dec, rf433_frame_cb cb, void *cb_arg)
+{
+    memset(dec, 0, sizeof(*dec));
+    for (int i = 0; i < rf433_n_protocols; i++)
+        dec->protocols[i] = rf433_protocols + i;
+    dec->n_protocols = rf433_n_protocols;
+    dec->frame_cb = cb;
+    dec->cb_arg = cb_arg;
+    rf433_decoder_reset(dec);
+}
+
+// Adds a protocol after the built-in ones. The protocol must have been
+// compiled and must stay around as long as the decoder. Returns the index
+// of the protocol or -1 if there is no room.
+int rf433_decoder_add_protocol(struct rf433_decoder *dec, const struct rf433_protocol *proto)
+{
+    int idx = dec->n_protocols;
+
+    if (idx == RF433_MAX_PROTOCOLS)
+        return -1;
+    memset(dec->proto_state + idx, 0, sizeof(dec->proto_state[idx]));
+    dec->proto_state[idx].state = STATE_IDLE;
+    dec->protocols[idx] = proto;
+    dec->n_protocols++;
+    return idx;
+}
+
+// Runs every pulse through the state machines of all protocols in a
+// single pass. Can be called with any number of pulses at a time.
+// Returns the number of frames found.
+int rf433_decoder_feed(struct rf433_decoder *dec, const struct timing *rx, int n_rx)
+{
+    uint32_t n_frames = dec->n_frames;
+    int i, p;
+
+    for (i = 0; i < n_rx; i++, rx++) {
+        int bucket = rf433_bucket(rx->time_us);
+        uint16_t level_mask = rx->state ? RF433_H_MASK : RF433_L_MASK;
+
+        for (p = 0; p < dec->n_protocols; p++) {
+            const struct rf433_protocol *proto = dec->protocols[p];
+
+            proto_step(dec, proto, dec->proto_state + p, proto->lut[bucket] & level_mask);
+        }
+        dec->pos++;
+    }
+    return dec->n_frames - n_frames;
+}
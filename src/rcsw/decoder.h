@@ -0,0 +1,156 @@
+/*
+ 433 MHz OOK pulse decoder
+
+ The decoder is fed a stream of (state, duration) pulses and runs one small
+ state machine per protocol over it. Every pulse is looked at exactly once
+ and checked against the timing windows of all protocols at the same time,
+ so the cost is linear in the number of pulses.
+
+ The state machines keep their state between calls, so pulses can be fed
+ one by one as they arrive. Protocols with a fixed frame length report the
+ frame as soon as its last bit is in; the others report it when the end
+ of the frame is seen.
+
+ A frame consists of:
+ - Sync: sync_min..sync_max repeats of the sync high/low pair
+ - Data: high/low pairs matching either the zero or the one symbol
+ - End: a pause symbol, a new sync word or an inter-frame gap
+
+ The protocol table is built at compile time in protocols.cpp. Besides the
+ timing windows of each symbol, every protocol gets a lookup table that
+ maps a quantized pulse length to the symbols it can be part of, so the
+ decoder only does one table lookup per pulse and protocol. Protocols
+ learned at runtime (see learner.h) get the same treatment from
+ rf433_protocol_compile() and are added with rf433_decoder_add_protocol().
+ */
+
+#ifndef __RCSW_DECODER_H
+#define __RCSW_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bitset/bitset.h"
+
+#define RF433_MAX_PROTOCOLS     12
+#define RF433_MAX_CODE_BITS     128
+#define RF433_MIN_CODE_BITS     8
+#define RF433_GAP_US            4300
+
+#define RF433_TOLERANCE_US      200
+#define RF433_TOLERANCE_PERCENT 20
+
+struct timing {
+    uint16_t time_us:15;
+    uint8_t state:1;
+} __attribute__((packed));
+
+#define TIMING_MAX_US           0x7fff
+
+// Pulse lengths are quantized to 64 us steps up to 8 ms and to 1 ms steps
+// above that.
+#define RF433_FINE_SHIFT        6
+#define RF433_FINE_LIMIT        8192
+#define RF433_COARSE_SHIFT      10
+#define RF433_N_BUCKETS         ((RF433_FINE_LIMIT >> RF433_FINE_SHIFT) + \
+                                 ((TIMING_MAX_US + 1 - RF433_FINE_LIMIT) >> RF433_COARSE_SHIFT))
+
+// Symbol classes of a high pulse
+#define RF433_H_ZERO            0x0001
+#define RF433_H_ONE             0x0002
+#define RF433_H_PAUSE           0x0004
+#define RF433_H_SYNC            0x0008
+#define RF433_H_SYNC_MIN        0x0010  // At least as long as a sync pulse
+#define RF433_H_MASK            0x00ff
+
+// Symbol classes of a low pulse
+#define RF433_L_ZERO            0x0100
+#define RF433_L_ONE             0x0200
+#define RF433_L_PAUSE           0x0400  // At least as long as a pause
+#define RF433_L_SYNC            0x0800
+#define RF433_L_GAP             0x1000  // Inter-frame gap
+#define RF433_L_MASK            0xff00
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rf433_hi_lo {
+    uint8_t high;
+    uint8_t low;
+};
+
+struct rf433_protocol {
+    const char *name;
+
+    uint16_t pulse_length;
+    struct rf433_hi_lo sync;
+    struct rf433_hi_lo zero;
+    struct rf433_hi_lo one;
+    struct rf433_hi_lo pause;
+    uint8_t sync_min, sync_max;     // How many times the sync pair repeats (0 means 1)
+    uint8_t n_bits;                 // Frame length in bits (0 if variable)
+
+    int (* decode)(const struct rf433_protocol *proto, struct bitset *);
+    // Formats a decoded code in human-readable form
+    int (* describe)(const struct rf433_protocol *proto, const struct bitset *, char *buf, int buf_len);
+
+    // Derived from the above by rf433_protocol_compile()
+    const uint16_t *lut;            // Symbol classes indexed by rf433_bucket()
+};
+
+struct rf433_frame {
+    const struct rf433_protocol *proto;
+    uint32_t pos;           // Pulse position of the sync word
+    uint32_t end_pos;       // Pulse position of the first pulse after the data bits
+    const struct bitset *code;
+};
+
+typedef void (* rf433_frame_cb)(const struct rf433_frame *frame, void *arg);
+
+struct rf433_proto_state {
+    uint8_t state;
+    uint8_t n_sync;
+    uint8_t high_match;     // Symbols the preceding high pulse matched
+    uint32_t start_pos;
+    uint8_t code_buf[BITSET_BUF_SIZE(RF433_MAX_CODE_BITS)] __attribute__((aligned(4)));
+};
+
+struct rf433_decoder {
+    const struct rf433_protocol *protocols[RF433_MAX_PROTOCOLS];
+    int n_protocols;
+
+    uint32_t pos;           // Number of pulses fed so far
+    uint32_t last_frame_end;
+    uint32_t n_frames;
+    struct rf433_proto_state proto_state[RF433_MAX_PROTOCOLS];
+
+    rf433_frame_cb frame_cb;
+    void *cb_arg;
+};
+
+extern const struct rf433_protocol * const rf433_protocols;
+extern const int rf433_n_protocols;
+
+static inline int rf433_bucket(uint16_t time_us)
+{
+    if (time_us < RF433_FINE_LIMIT)
+        return time_us >> RF433_FINE_SHIFT;
+    return (RF433_FINE_LIMIT >> RF433_FINE_SHIFT) + ((time_us - RF433_FINE_LIMIT) >> RF433_COARSE_SHIFT);
+}
+
+void rf433_protocol_compile(struct rf433_protocol *proto, uint16_t *lut);
+
+int rf433_nexa_decode(const struct rf433_protocol *proto, struct bitset *code);
+int rf433_nexa_describe(const struct rf433_protocol *proto, const struct bitset *code,
+                        char *buf, int buf_len);
+
+void rf433_decoder_init(struct rf433_decoder *dec, rf433_frame_cb cb, void *cb_arg);
+void rf433_decoder_reset(struct rf433_decoder *dec);
+int rf433_decoder_add_protocol(struct rf433_decoder *dec, const struct rf433_protocol *proto);
+int rf433_decoder_feed(struct rf433_decoder *dec, const struct timing *rx, int n_rx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#include "dedup.h"
+
+static inline struct bitset *entry_code(struct rf433_dedup_entry *e)
+{
+    return (struct bitset *) e->code_buf;
+}
+
+void rf433_dedup_init(struct rf433_dedup *dedup, uint32_t window_ms, rf433_event_cb cb, void *cb_arg)
+{
+    memset(dedup, 0, sizeof(*dedup));
+    dedup->window_ms = window_ms;
+    dedup->event_cb = cb;
+    dedup->cb_arg = cb_arg;
+}
+
+static bool entry_matches(struct rf433_dedup_entry *e, const struct rf433_frame *frame)
+{
+    if (e->proto != frame->proto || e->n_bits != frame->code->n_bits)
+        return false;
+    return bitset_distance(entry_code(e), frame->code) <= RF433_DEDUP_MAX_ERRORS;
+}
+
+static void entry_vote(struct rf433_dedup_entry *e, const struct bitset *code)
+{
+    // The majority is clear long before the votes would overflow
+    if (e->repeats < UINT8_MAX) {
+        for (int i = 0; i < BITSET_WORDS(code->n_bits); i++) {
+            // Only the ones get a vote
+            for (uint32_t w = bitset_word(code, i); w; w &= w - 1)
+                e->ones[i * BITSET_WORD_BITS + __builtin_ctz(w)]++;
+        }
+    }
+    if (e->repeats < UINT16_MAX)
+        e->repeats++;
+}
+
+// Reports an entry with the majority of the votes and removes it
+static void entry_report(struct rf433_dedup *dedup, int idx)
+{
+    struct rf433_dedup_entry *e = dedup->entries + idx;
+    struct bitset *code = entry_code(e);
+    struct rf433_frame frame;
+    int votes = e->repeats < UINT8_MAX ? e->repeats : UINT8_MAX;
+
+    // Ties go to the first frame
+    for (int i = 0; i < e->n_bits; i++) {
+        if (e->ones[i] * 2 > votes)
+            bitset_set(code, i);
+        else if (e->ones[i] * 2 < votes)
+            bitset_unset(code, i);
+    }
+
+    frame.proto = e->proto;
+    frame.pos = e->pos;
+    frame.end_pos = e->pos;
+    frame.code = code;
+    if (dedup->event_cb != NULL)
+        dedup->event_cb(&frame, e->repeats, dedup->cb_arg);
+
+    dedup->n_entries--;
+    if (idx != dedup->n_entries)
+        memcpy(e, dedup->entries + dedup->n_entries, sizeof(*e));
+}
+
+// Adds a decoded frame. With a zero window every frame is reported right
+// away.
+void rf433_dedup_add(struct rf433_dedup *dedup, const struct rf433_frame *frame, uint32_t now_ms)
+{
+    struct rf433_dedup_entry *e;
+    int i, oldest = 0;
+
+    rf433_dedup_expire(dedup, now_ms);
+    for (i = 0; i < dedup->n_entries; i++) {
+        e = dedup->entries + i;
+        if (entry_matches(e, frame)) {
+            entry_vote(e, frame->code);
+            e->last_ms = now_ms;
+            return;
+        }
+        if (now_ms - e->last_ms > now_ms - dedup->entries[oldest].last_ms)
+            oldest = i;
+    }
+
+    // Make room by reporting the entry that has been quiet the longest
+    if (dedup->n_entries == RF433_DEDUP_SLOTS)
+        entry_report(dedup, oldest);
+
+    e = dedup->entries + dedup->n_entries++;
+    memset(e->ones, 0, sizeof(e->ones));
+    e->proto = frame->proto;
+    e->pos = frame->pos;
+    e->last_ms = now_ms;
+    e->repeats = 0;
+    e->n_bits = frame->code->n_bits;
+    bitset_init(e->code_buf, sizeof(e->code_buf));
+    bitset_copy(entry_code(e), frame->code);
+    entry_vote(e, frame->code);
+
+    if (!dedup->window_ms)
+        entry_report(dedup, dedup->n_entries - 1);
+}
+
+// Reports the entries that have not been repeated within the window.
+// Returns the number of entries still waiting.
+int rf433_dedup_expire(struct rf433_dedup *dedup, uint32_t now_ms)
+{
+    int i = 0;
+
+    while (i < dedup->n_entries) {
+        if (now_ms - dedup->entries[i].last_ms >= dedup->window_ms)
+            entry_report(dedup, i);
+        else
+            i++;
+    }
+    return dedup->n_entries;
+}
+
+// Milliseconds until the next entry is due to be reported, -1 if there
+// are none
+int32_t rf433_dedup_next_ms(const struct rf433_dedup *dedup, uint32_t now_ms)
+{
+    int32_t next = -1, left;
+    uint32_t quiet;
+    int i;
+
+    for (i = 0; i < dedup->n_entries; i++) {
+        quiet = now_ms - dedup->entries[i].last_ms;
+        left = quiet < dedup->window_ms ? (int32_t) (dedup->window_ms - quiet) : 0;
+        if (next < 0 || left < next)
+            next = left;
+    }
+    return next;
+}
+
+void rf433_dedup_flush(struct rf433_dedup *dedup)
+{
+    while (dedup->n_entries)
+        entry_report(dedup, 0);
+}
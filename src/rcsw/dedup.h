@@ -0,0 +1,60 @@
+/*
+ Repeat suppression for decoded 433 MHz frames
+
+ Remotes send every frame several times per key press. Frames are
+ collected in a small cache keyed by protocol and code, and repeats that
+ arrive within the window of each other are merged into one entry. A
+ repeat may differ from the first frame in up to RF433_DEDUP_MAX_ERRORS
+ bits; every bit of the reported code is the majority vote of all the
+ repeats, so single bit errors in some of them are corrected.
+
+ An entry is reported once, with the number of repeats, when no repeat
+ has arrived for the whole window.
+ */
+
+#ifndef __RCSW_DEDUP_H
+#define __RCSW_DEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "decoder.h"
+
+#define RF433_DEDUP_SLOTS           4
+#define RF433_DEDUP_MAX_ERRORS      2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (* rf433_event_cb)(const struct rf433_frame *frame, int repeats, void *arg);
+
+struct rf433_dedup_entry {
+    const struct rf433_protocol *proto;
+    uint32_t pos;
+    uint32_t last_ms;
+    uint16_t repeats;
+    uint8_t n_bits;
+    uint8_t ones[RF433_MAX_CODE_BITS];      // Votes for a one, per bit
+    uint8_t code_buf[BITSET_BUF_SIZE(RF433_MAX_CODE_BITS)] __attribute__((aligned(4)));
+};
+
+struct rf433_dedup {
+    uint32_t window_ms;
+    int n_entries;
+    struct rf433_dedup_entry entries[RF433_DEDUP_SLOTS];
+
+    rf433_event_cb event_cb;
+    void *cb_arg;
+};
+
+void rf433_dedup_init(struct rf433_dedup *dedup, uint32_t window_ms, rf433_event_cb cb, void *cb_arg);
+void rf433_dedup_add(struct rf433_dedup *dedup, const struct rf433_frame *frame, uint32_t now_ms);
+int rf433_dedup_expire(struct rf433_dedup *dedup, uint32_t now_ms);
+int32_t rf433_dedup_next_ms(const struct rf433_dedup *dedup, uint32_t now_ms);
+void rf433_dedup_flush(struct rf433_dedup *dedup);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <string.h>
+#include "learner.h"
+
+#define MIN_CLUSTER_SHARE   50      // Clusters with less than 1/50 of the pulses are noise
+#define NO_CLUSTER          0xff
+
+struct cluster {
+    uint32_t count;
+    uint32_t mean_us;
+};
+
+struct clusters {
+    int n;
+    struct cluster c[RF433_LEARN_MAX_CLUSTERS];
+    uint8_t bucket_cluster[RF433_N_BUCKETS];
+};
+
+// A symbol: a high pulse cluster followed by a low pulse cluster
+struct symbol {
+    uint8_t high, low;
+    uint32_t count;
+};
+
+void rf433_learner_init(struct rf433_learner *learner)
+{
+    memset(learner, 0, sizeof(*learner));
+}
+
+static void histogram_add(struct rf433_histogram *hist, uint16_t time_us)
+{
+    int bucket = rf433_bucket(time_us);
+
+    if (hist->count[bucket] == UINT16_MAX) {
+        // Age the histogram so that it keeps following the latest bursts
+        for (int i = 0; i < RF433_N_BUCKETS; i++) {
+            hist->count[i] /= 2;
+            hist->sum_us[i] /= 2;
+        }
+    }
+    hist->count[bucket]++;
+    hist->sum_us[bucket] += time_us;
+}
+
+void rf433_learner_add_burst(struct rf433_learner *learner, const struct timing *burst, int n)
+{
+    for (int i = 0; i < n; i++) {
+        const struct timing *t = burst + i;
+
+        // Zero is a glitch and the maximum a timeout, neither is a symbol
+        if (t->time_us != 0 && t->time_us != TIMING_MAX_US)
+            histogram_add(&learner->hist[t->state], t->time_us);
+
+        learner->pulses[learner->head] = *t;
+        learner->head = (learner->head + 1) % RF433_LEARN_MAX_PULSES;
+        if (learner->n_pulses < RF433_LEARN_MAX_PULSES)
+            learner->n_pulses++;
+    }
+    learner->n_bursts++;
+}
+
+static uint32_t bucket_min_us(int bucket)
+{
+    if (bucket < (RF433_FINE_LIMIT >> RF433_FINE_SHIFT))
+        return bucket << RF433_FINE_SHIFT;
+    return RF433_FINE_LIMIT + ((bucket - (RF433_FINE_LIMIT >> RF433_FINE_SHIFT)) << RF433_COARSE_SHIFT);
+}
+
+static void add_cluster(const struct rf433_histogram *hist, struct clusters *cl,
+                        uint32_t total, int first, int last)
+{
+    uint32_t count = 0;
+    uint64_t sum = 0;
+
+    for (int b = first; b <= last; b++) {
+        count += hist->count[b];
+        sum += hist->sum_us[b];
+    }
+    if (count * MIN_CLUSTER_SHARE < total || cl->n == RF433_LEARN_MAX_CLUSTERS)
+        return;
+    cl->c[cl->n].count = count;
+    cl->c[cl->n].mean_us = sum / count;
+    memset(cl->bucket_cluster + first, cl->n, last + 1 - first);
+    cl->n++;
+}
+
+// Buckets closer to each other than an eighth of the pulse length belong
+// to the same cluster. Rare pulses like the sync are spread thinly over
+// the buckets, so the cluster can have holes in it.
+static void find_clusters(const struct rf433_histogram *hist, struct clusters *cl)
+{
+    uint32_t total = 0;
+    int b, first = -1, last = -1;
+
+    for (b = 0; b < RF433_N_BUCKETS; b++)
+        total += hist->count[b];
+
+    cl->n = 0;
+    memset(cl->bucket_cluster, NO_CLUSTER, sizeof(cl->bucket_cluster));
+    for (b = 0; b < RF433_N_BUCKETS; b++) {
+        if (!hist->count[b])
+            continue;
+        if (first >= 0 && bucket_min_us(b) - bucket_min_us(last) > (1 << RF433_FINE_SHIFT) &&
+            bucket_min_us(b) - bucket_min_us(last) > bucket_min_us(last) / 8) {
+            add_cluster(hist, cl, total, first, last);
+            first = -1;
+        }
+        if (first < 0)
+            first = b;
+        last = b;
+    }
+    if (first >= 0)
+        add_cluster(hist, cl, total, first, last);
+}
+
+static int count_symbols(const struct rf433_learner *learner, const struct clusters *cl,
+                         struct symbol *symbols)
+{
+    uint32_t counts[RF433_LEARN_MAX_CLUSTERS][RF433_LEARN_MAX_CLUSTERS];
+    int tail = (learner->head + RF433_LEARN_MAX_PULSES - learner->n_pulses) % RF433_LEARN_MAX_PULSES;
+    uint8_t high = NO_CLUSTER;
+    int i, n = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < learner->n_pulses; i++) {
+        const struct timing *t = learner->pulses + (tail + i) % RF433_LEARN_MAX_PULSES;
+        uint8_t c = cl[t->state].bucket_cluster[rf433_bucket(t->time_us)];
+
+        if (t->state) {
+            high = c;
+            continue;
+        }
+        if (high != NO_CLUSTER && c != NO_CLUSTER)
+            counts[high][c]++;
+        high = NO_CLUSTER;
+    }
+
+    for (int h = 0; h < cl[1].n; h++) {
+        for (int l = 0; l < cl[0].n; l++) {
+            if (!counts[h][l])
+                continue;
+            symbols[n].high = h;
+            symbols[n].low = l;
+            symbols[n].count = counts[h][l];
+            n++;
+        }
+    }
+    return n;
+}
+
+static uint8_t pulses(uint32_t time_us, uint32_t pulse_length)
+{
+    uint32_t n = (time_us + pulse_length / 2) / pulse_length;
+
+    return n < 1 ? 1 : n > 255 ? 255 : n;
+}
+
+// Proposes a protocol that matches the unknown bursts seen so far. The
+// result is compiled and ready to be added to a decoder; it refers to
+// itself, so it must not be moved. Returns -1 if no protocol was found.
+int rf433_learner_propose(const struct rf433_learner *learner, struct rf433_learned_protocol *out,
+                          const char *name)
+{
+    struct clusters cl[2];
+    struct symbol symbols[RF433_LEARN_MAX_CLUSTERS * RF433_LEARN_MAX_CLUSTERS];
+    const struct symbol *zero = NULL, *one = NULL, *sync = NULL, *pause = NULL;
+    uint32_t data_low_max, pulse_length, max_count = 0;
+    int i, n_symbols;
+
+#define HIGH_US(s)  (cl[1].c[(s)->high].mean_us)
+#define LOW_US(s)   (cl[0].c[(s)->low].mean_us)
+
+    find_clusters(&learner->hist[1], &cl[1]);
+    find_clusters(&learner->hist[0], &cl[0]);
+    n_symbols = count_symbols(learner, cl, symbols);
+
+    // The data bits are the two most common symbols
+    for (i = 0; i < n_symbols; i++) {
+        const struct symbol *s = symbols + i;
+
+        if (zero == NULL || s->count > zero->count) {
+            one = zero;
+            zero = s;
+        } else if (one == NULL || s->count > one->count)
+            one = s;
+    }
+    if (one == NULL)
+        return -1;
+    if (HIGH_US(one) < HIGH_US(zero) ||
+        (one->high == zero->high && LOW_US(one) > LOW_US(zero))) {
+        const struct symbol *tmp = zero;
+
+        zero = one;
+        one = tmp;
+    }
+
+    // The sync word and the pause have longer lows than the data bits
+    data_low_max = LOW_US(zero) > LOW_US(one) ? LOW_US(zero) : LOW_US(one);
+    for (i = 0; i < n_symbols; i++) {
+        if (LOW_US(symbols + i) > data_low_max && symbols[i].count > max_count)
+            max_count = symbols[i].count;
+    }
+    for (i = 0; i < n_symbols; i++) {
+        const struct symbol *s = symbols + i;
+
+        if (LOW_US(s) <= data_low_max || s->count * 2 < max_count)
+            continue;
+        if (sync == NULL || LOW_US(s) < LOW_US(sync))
+            sync = s;
+        if (pause == NULL || LOW_US(s) > LOW_US(pause))
+            pause = s;
+    }
+    if (sync == NULL)
+        return -1;
+    if (pause->low == sync->low)
+        pause = NULL;
+
+    pulse_length = HIGH_US(zero);
+    if (HIGH_US(one) < pulse_length)
+        pulse_length = HIGH_US(one);
+    if (LOW_US(zero) < pulse_length)
+        pulse_length = LOW_US(zero);
+    if (LOW_US(one) < pulse_length)
+        pulse_length = LOW_US(one);
+
+    memset(out, 0, sizeof(*out));
+    snprintf(out->name, sizeof(out->name), "%s", name);
+    out->proto.name = out->name;
+    out->proto.pulse_length = pulse_length;
+    out->proto.zero.high = pulses(HIGH_US(zero), pulse_length);
+    out->proto.zero.low = pulses(LOW_US(zero), pulse_length);
+    out->proto.one.high = pulses(HIGH_US(one), pulse_length);
+    out->proto.one.low = pulses(LOW_US(one), pulse_length);
+    out->proto.sync.high = pulses(HIGH_US(sync), pulse_length);
+    out->proto.sync.low = pulses(LOW_US(sync), pulse_length);
+    if (pause != NULL) {
+        out->proto.pause.high = pulses(HIGH_US(pause), pulse_length);
+        out->proto.pause.low = pulses(LOW_US(pause), pulse_length);
+    }
+
+#undef HIGH_US
+#undef LOW_US
+
+    // Both bits rounded to the same symbol
+    if (out->proto.zero.high == out->proto.one.high && out->proto.zero.low == out->proto.one.low)
+        return -1;
+
+    rf433_protocol_compile(&out->proto, out->lut);
+    return 0;
+}
+
+// Formats a protocol the way it would be added to protocols.cpp
+int rf433_learner_format(const struct rf433_protocol *proto, char *buf, int buf_len)
+{
+    return snprintf(buf, buf_len, "{\"%s\", %u, {%u, %u}, {%u, %u}, {%u, %u}, {%u, %u}},",
+                    proto->name, proto->pulse_length,
+                    proto->sync.high, proto->sync.low, proto->zero.high, proto->zero.low,
+                    proto->one.high, proto->one.low, proto->pause.high, proto->pause.low);
+}
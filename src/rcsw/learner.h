@@ -0,0 +1,70 @@
+/*
+ 433 MHz protocol learner
+
+ Bursts that no protocol matched are collected into a histogram of pulse
+ lengths, separately for high and low pulses. On request the histograms
+ are clustered into the distinct pulse lengths in use, and the most
+ recent bursts are walked once more to count which high and low clusters
+ appear together as symbols:
+
+ - The two most common symbols are the data bits. The one with the
+   shorter high pulse (or, if the highs are the same, the longer low
+   pulse) is taken as the zero.
+ - The remaining symbols with a low pulse longer than the data bits are
+   the sync word (the shorter one) and the pause (the longer one).
+ - The shortest data pulse is the base pulse length, and all symbols are
+   expressed as multiples of it.
+
+ The result is a protocol entry that can be compiled and added to the
+ decoder at runtime, or pasted into the table in protocols.cpp. Protocols
+ whose sync word looks like a data bit (like Everflourish) are not
+ recognized.
+ */
+
+#ifndef __RCSW_LEARNER_H
+#define __RCSW_LEARNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "decoder.h"
+
+#define RF433_LEARN_MAX_PULSES      512     // Kept for the symbol analysis
+#define RF433_LEARN_MAX_CLUSTERS    8       // Per pulse level
+#define RF433_LEARN_NAME_LEN        12
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rf433_histogram {
+    uint16_t count[RF433_N_BUCKETS];
+    uint32_t sum_us[RF433_N_BUCKETS];
+};
+
+struct rf433_learner {
+    uint32_t n_bursts;
+    struct rf433_histogram hist[2];     // Indexed by pulse state
+
+    // The most recent pulses of unknown bursts, oldest first from tail
+    uint16_t head, n_pulses;
+    struct timing pulses[RF433_LEARN_MAX_PULSES];
+};
+
+// A learned protocol and the storage its compiled form needs
+struct rf433_learned_protocol {
+    struct rf433_protocol proto;
+    char name[RF433_LEARN_NAME_LEN];
+    uint16_t lut[RF433_N_BUCKETS];
+};
+
+void rf433_learner_init(struct rf433_learner *learner);
+void rf433_learner_add_burst(struct rf433_learner *learner, const struct timing *burst, int n);
+int rf433_learner_propose(const struct rf433_learner *learner, struct rf433_learned_protocol *out,
+                          const char *name);
+int rf433_learner_format(const struct rf433_protocol *proto, char *buf, int buf_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+// 433 MHz protocol table
+//
+// Everything in here is evaluated at compile time: the timing windows of
+// the symbols and the per-protocol lookup tables from quantized pulse
+// length to symbol class end up as constant data. Protocols learned at
+// runtime are run through the same functions by rf433_protocol_compile().
+
+#include "decoder.h"
+
+namespace {
+
+// Pulse lengths, in us, that match a symbol
+struct rf433_window {
+    uint16_t min;
+    uint16_t max;
+};
+
+struct proto_def {
+    const char *name;
+
+    uint16_t pulse_length;
+    rf433_hi_lo sync;
+    rf433_hi_lo zero;
+    rf433_hi_lo one;
+    rf433_hi_lo pause;
+    uint8_t sync_min, sync_max;
+    uint8_t n_bits;
+
+    int (* decode)(const rf433_protocol *proto, bitset *);
+    int (* describe)(const rf433_protocol *proto, const bitset *, char *buf, int buf_len);
+};
+
+// Adding a protocol only takes a new line here.
+constexpr proto_def defs[] = {
+    // name             pulse  sync      zero     one      pause       sync x  bits  decode, describe
+    // 1180us     590us    pause 16ms
+    {"everflourish",    590, { 1,  1}, {1,  2}, {1,  1}, {  1,  27}, 3, 5},
+    {"nexa",            250, { 1, 10}, {1,  5}, {1,  1}, {  1,  40}, 0, 0,  64, rf433_nexa_decode, rf433_nexa_describe},
+    {"1",               350, { 1, 31}, {1,  3}, {3,  1}, },    // protocol 1
+    {"2",               650, { 1, 10}, {1,  2}, {2,  1}, },    // protocol 2
+    {"3",               100, {30, 71}, {4, 11}, {9,  6}, },    // protocol 3
+    {"4",               380, { 1,  6}, {1,  3}, {3,  1}, },    // protocol 4
+    {"5",               500, { 6, 14}, {1,  2}, {2,  1}, },    // protocol 5
+};
+
+constexpr int n_defs = sizeof(defs) / sizeof(defs[0]);
+
+static_assert(n_defs <= RF433_MAX_PROTOCOLS, "too many 433 MHz protocols");
+
+constexpr uint32_t calc_tolerance(uint32_t time)
+{
+    return time * RF433_TOLERANCE_PERCENT / 100 < RF433_TOLERANCE_US ?
+        RF433_TOLERANCE_US : time * RF433_TOLERANCE_PERCENT / 100;
+}
+
+constexpr uint16_t clamp_us(uint32_t time)
+{
+    return time > TIMING_MAX_US ? TIMING_MAX_US : time;
+}
+
+constexpr rf433_window window_us(uint32_t time)
+{
+    return {
+        (uint16_t) (time > calc_tolerance(time) ? time - calc_tolerance(time) : 0),
+        clamp_us(time + calc_tolerance(time)),
+    };
+}
+
+// A symbol that is zero pulses long never matches.
+constexpr rf433_window window(uint16_t pulse_length, uint8_t pulses)
+{
+    return pulses ? window_us((uint32_t) pulse_length * pulses) : rf433_window{0xffff, 0};
+}
+
+constexpr bool in_window(rf433_window w, uint16_t us)
+{
+    return us >= w.min && us <= w.max;
+}
+
+constexpr bool above_min(rf433_window w, uint16_t us)
+{
+    return w.min <= w.max && us >= w.min;
+}
+
+// Classify pulse lengths by the middle of their quantization bucket
+constexpr uint16_t bucket_us(int bucket)
+{
+    return bucket < (RF433_FINE_LIMIT >> RF433_FINE_SHIFT) ?
+        (bucket << RF433_FINE_SHIFT) + (1 << (RF433_FINE_SHIFT - 1)) :
+        clamp_us(RF433_FINE_LIMIT +
+                 ((uint32_t) (bucket - (RF433_FINE_LIMIT >> RF433_FINE_SHIFT)) << RF433_COARSE_SHIFT) +
+                 (1 << (RF433_COARSE_SHIFT - 1)));
+}
+
+// The classifiers work on both proto_def and rf433_protocol
+template <typename P>
+constexpr uint16_t high_classes(const P &d, uint16_t us)
+{
+    return (in_window(window(d.pulse_length, d.zero.high), us) ? RF433_H_ZERO : 0) |
+           (in_window(window(d.pulse_length, d.one.high), us) ? RF433_H_ONE : 0) |
+           (in_window(window(d.pulse_length, d.pause.high), us) ? RF433_H_PAUSE : 0) |
+           (in_window(window(d.pulse_length, d.sync.high), us) ? RF433_H_SYNC : 0) |
+           // The high pulse before the first sync might be longer than what we
+           // expect, probably because we're still receiving noise.
+           (above_min(window(d.pulse_length, d.sync.high), us) ? RF433_H_SYNC_MIN : 0);
+}
+
+template <typename P>
+constexpr uint16_t low_classes(const P &d, uint16_t us)
+{
+    return (in_window(window(d.pulse_length, d.zero.low), us) ? RF433_L_ZERO : 0) |
+           (in_window(window(d.pulse_length, d.one.low), us) ? RF433_L_ONE : 0) |
+           // The pause can be arbitrarily long
+           (d.pause.high && above_min(window(d.pulse_length, d.pause.low), us) ? RF433_L_PAUSE : 0) |
+           (in_window(window(d.pulse_length, d.sync.low), us) ? RF433_L_SYNC : 0) |
+           (us >= RF433_GAP_US ? RF433_L_GAP : 0);
+}
+
+template <typename P>
+constexpr uint16_t classify(const P &d, int bucket)
+{
+    return high_classes(d, bucket_us(bucket)) | low_classes(d, bucket_us(bucket));
+}
+
+template <int... Is> struct indices {};
+template <int N, int... Is> struct make_indices : make_indices<N - 1, N - 1, Is...> {};
+template <int... Is> struct make_indices<0, Is...> { typedef indices<Is...> type; };
+
+struct lut_row {
+    uint16_t classes[RF433_N_BUCKETS];
+};
+
+struct lut_table {
+    lut_row rows[n_defs];
+};
+
+template <int... Bs>
+constexpr lut_row make_row(const proto_def &d, indices<Bs...>)
+{
+    return {{ classify(d, Bs)... }};
+}
+
+template <int... Ps>
+constexpr lut_table make_table(indices<Ps...>)
+{
+    return {{ make_row(defs[Ps], make_indices<RF433_N_BUCKETS>::type())... }};
+}
+
+constexpr lut_table luts = make_table(make_indices<n_defs>::type());
+
+constexpr rf433_protocol compile(const proto_def &d, const uint16_t *lut)
+{
+    return {
+        d.name, d.pulse_length, d.sync, d.zero, d.one, d.pause,
+        d.sync_min, d.sync_max, d.n_bits, d.decode, d.describe, lut,
+    };
+}
+
+template <typename> struct protocol_table;
+
+template <int... Ps> struct protocol_table<indices<Ps...>> {
+    static constexpr rf433_protocol protocols[sizeof...(Ps)] = {
+        compile(defs[Ps], luts.rows[Ps].classes)...
+    };
+};
+
+template <int... Ps>
+constexpr rf433_protocol protocol_table<indices<Ps...>>::protocols[sizeof...(Ps)];
+
+}
+
+extern "C" {
+
+const struct rf433_protocol * const rf433_protocols = protocol_table<make_indices<n_defs>::type>::protocols;
+const int rf433_n_protocols = n_defs;
+
+void rf433_protocol_compile(struct rf433_protocol *proto, uint16_t *lut)
+{
+    for (int bucket = 0; bucket < RF433_N_BUCKETS; bucket++)
+        lut[bucket] = classify(*proto, bucket);
+    proto->lut = lut;
+}
+
+}
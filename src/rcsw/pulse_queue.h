@@ -0,0 +1,80 @@
+/*
+ Single-producer/single-consumer lock-free pulse queue
+
+ The GPIO interrupt handler is the only producer and the decoder the only
+ consumer. Each side only ever writes its own index: the producer
+ publishes pulses with a release store of head, and the consumer frees
+ slots with a release store of tail. Neither side needs to mask
+ interrupts.
+
+ The indices run freely and are masked on access, so the queue size must
+ be a power of two.
+ */
+
+#ifndef __RCSW_PULSE_QUEUE_H
+#define __RCSW_PULSE_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "decoder.h"
+
+#define PULSE_QUEUE_SIZE    256
+#define PULSE_QUEUE_MASK    (PULSE_QUEUE_SIZE - 1)
+
+struct pulse_queue {
+    uint32_t head;          // Written by the producer only
+    uint32_t tail;          // Written by the consumer only
+    uint32_t overruns;      // Pulses dropped because the queue was full
+    struct timing buf[PULSE_QUEUE_SIZE];
+};
+
+static inline void pulse_queue_init(struct pulse_queue *q)
+{
+    q->head = 0;
+    q->tail = 0;
+    q->overruns = 0;
+}
+
+// Called from the producer only
+static inline bool pulse_queue_push(struct pulse_queue *q, struct timing t)
+{
+    uint32_t head = q->head;
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail == PULSE_QUEUE_SIZE) {
+        __atomic_store_n(&q->overruns, q->overruns + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    q->buf[head & PULSE_QUEUE_MASK] = t;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Called from the consumer only. Returns the number of pulses that can be
+// read in one go starting at *out (the queued pulses might wrap around the
+// end of the buffer, in which case the rest is returned by the next call).
+static inline int pulse_queue_peek(struct pulse_queue *q, const struct timing **out)
+{
+    uint32_t tail = q->tail;
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    uint32_t n = head - tail;
+    uint32_t idx = tail & PULSE_QUEUE_MASK;
+
+    if (n > PULSE_QUEUE_SIZE - idx)
+        n = PULSE_QUEUE_SIZE - idx;
+    *out = q->buf + idx;
+    return n;
+}
+
+// Called from the consumer only, after it's done with the peeked pulses
+static inline void pulse_queue_consume(struct pulse_queue *q, int n)
+{
+    __atomic_store_n(&q->tail, q->tail + n, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t pulse_queue_overruns(const struct pulse_queue *q)
+{
+    return __atomic_load_n(&q->overruns, __ATOMIC_RELAXED);
+}
+
+#endif
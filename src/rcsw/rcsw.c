@@ -0,0 +1,266 @@
+#include <mgos.h>
+
+#include "decoder.h"
+#include "pulse_queue.h"
+#include "capture.h"
+#include "learner.h"
+#include "dedup.h"
+
+#define MAX_BURST_PULSES    180
+#define MIN_PULSES          14
+#define MIN_PULSE_US        80
+
+struct rf433 {
+    int input_gpio;
+
+    // Owned by the interrupt handler
+    double last_rx_time;
+    uint8_t last_state;
+
+    bool pump_pending;
+    struct pulse_queue rxq;
+
+    // Owned by the decoder
+    struct rf433_decoder decoder;
+    uint32_t reported_overruns;
+
+    // Repeats of a frame are reported once
+    struct rf433_dedup dedup;
+    mgos_timer_id dedup_timer;
+
+    // Pulses since the last inter-frame gap, for dumping unknown bursts
+    uint16_t rx_id;
+    uint16_t n_burst;
+    uint32_t burst_frames;
+    struct timing burst[MAX_BURST_PULSES];
+
+    bool capture_enabled;
+    struct rf433_capture capture;
+
+    // Unknown bursts go to the learner, if enabled
+    struct rf433_learner *learner;
+    int n_learned;
+};
+
+static struct rf433 *rf433_rx;
+
+static uint32_t rf433_now_ms(void)
+{
+    return (uint32_t) (mgos_uptime() * 1000);
+}
+
+static void rf433_event(const struct rf433_frame *frame, int repeats, void *arg)
+{
+    struct rf433 *rf = (struct rf433 *) arg;
+    char buf[RF433_MAX_CODE_BITS + RF433_MAX_CODE_BITS / 8 + 1];
+
+    bitset_print(buf, frame->code);
+    printf("[%04x] %s: Packet found at %u (%d bits, %d repeats)\ncode: %s\n", rf->rx_id,
+           frame->proto->name, (unsigned int) frame->pos, frame->code->n_bits, repeats, buf);
+    if (frame->proto->describe != NULL) {
+        frame->proto->describe(frame->proto, frame->code, buf, sizeof(buf));
+        printf("%s\n", buf);
+    }
+}
+
+static void rf433_dedup_timer_cb(void *arg);
+
+// Sets the timer for when the first entry's window ends
+static void rf433_dedup_arm(struct rf433 *rf, uint32_t now_ms)
+{
+    int32_t next = rf433_dedup_next_ms(&rf->dedup, now_ms);
+
+    if (rf->dedup_timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(rf->dedup_timer);
+    rf->dedup_timer = MGOS_INVALID_TIMER_ID;
+    if (next >= 0)
+        rf->dedup_timer = mgos_set_timer(next ? next : 1, 0, rf433_dedup_timer_cb, rf);
+}
+
+static void rf433_dedup_timer_cb(void *arg)
+{
+    struct rf433 *rf = (struct rf433 *) arg;
+    uint32_t now_ms = rf433_now_ms();
+
+    rf->dedup_timer = MGOS_INVALID_TIMER_ID;
+    rf433_dedup_expire(&rf->dedup, now_ms);
+    rf433_dedup_arm(rf, now_ms);
+}
+
+static void rf433_frame_found(const struct rf433_frame *frame, void *arg)
+{
+    struct rf433 *rf = (struct rf433 *) arg;
+    uint32_t now_ms = rf433_now_ms();
+
+    rf433_dedup_add(&rf->dedup, frame, now_ms);
+    // Report the frame once the repeats are over
+    rf433_dedup_arm(rf, now_ms);
+}
+
+static void rf433_burst_done(struct rf433 *rf)
+{
+    rf433_capture_flush(&rf->capture);
+    if (rf->n_burst >= MIN_PULSES && rf->decoder.n_frames == rf->burst_frames) {
+        LOG(LL_DEBUG, ("[%04x] Unknown burst of %d pulses", rf->rx_id, rf->n_burst));
+        if (rf->learner != NULL)
+            rf433_learner_add_burst(rf->learner, rf->burst, rf->n_burst);
+    }
+    rf->rx_id++;
+    rf->n_burst = 0;
+    rf->burst_frames = rf->decoder.n_frames;
+}
+
+// Feeds the pulses received so far to the decoder. Frames get reported
+// as soon as their last pulse has been received.
+static void rf433_rx_pump(void *arg)
+{
+    struct rf433 *rf = (struct rf433 *) arg;
+    const struct timing *t;
+    uint32_t overruns;
+    int i, n;
+
+    // Clear the flag before looking at the queue, so that a pulse pushed
+    // after we have drained it schedules a new pump.
+    __atomic_store_n(&rf->pump_pending, false, __ATOMIC_SEQ_CST);
+
+    while ((n = pulse_queue_peek(&rf->rxq, &t)) > 0) {
+        for (i = 0; i < n; i++, t++) {
+            rf433_decoder_feed(&rf->decoder, t, 1);
+            if (rf->n_burst < MAX_BURST_PULSES)
+                rf->burst[rf->n_burst++] = *t;
+            if (rf->capture_enabled)
+                rf433_capture_pulse(&rf->capture, t);
+            if (!t->state && t->time_us > RF433_GAP_US)
+                rf433_burst_done(rf);
+        }
+        pulse_queue_consume(&rf->rxq, n);
+    }
+
+    overruns = pulse_queue_overruns(&rf->rxq);
+    if (overruns != rf->reported_overruns) {
+        LOG(LL_WARN, ("433 MHz decoder fell behind, %u pulses dropped (%u total)",
+                      (unsigned int) (overruns - rf->reported_overruns), (unsigned int) overruns));
+        rf->reported_overruns = overruns;
+    }
+}
+
+static void rf433_int_handler(int pin, void *arg)
+{
+    struct rf433 *rf = (struct rf433 *) arg;
+    struct timing t;
+    double now = mgos_uptime();
+    int state;
+    unsigned int diff_us;
+
+    state = mgos_gpio_read(rf->input_gpio);
+    diff_us = (int) ((now - rf->last_rx_time) * 1000000);
+    if (diff_us > TIMING_MAX_US)
+        diff_us = TIMING_MAX_US;
+    rf->last_rx_time = now;
+
+    // Too short pulse. No protocol matches a zero-length pulse, so this
+    // makes the decoders start over.
+    if (diff_us < MIN_PULSE_US)
+        diff_us = 0;
+
+    // Store the time for the last received state change. If the decoder
+    // has fallen a whole queue behind, the pulse is dropped and counted
+    // as an overrun.
+    t.state = rf->last_state;
+    t.time_us = diff_us;
+    pulse_queue_push(&rf->rxq, t);
+    rf->last_state = state;
+
+    // The pump only ever clears the flag and cannot preempt us, so this
+    // does not need to be an atomic exchange.
+    if (!__atomic_load_n(&rf->pump_pending, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&rf->pump_pending, true, __ATOMIC_SEQ_CST);
+        if (!mgos_invoke_cb(rf433_rx_pump, rf, true))
+            __atomic_store_n(&rf->pump_pending, false, __ATOMIC_SEQ_CST);
+    }
+
+    (void) pin;
+}
+
+void rcsw_init(void)
+{
+    struct rf433 *rf;
+
+    if (!mgos_sys_config_get_rcsw_enable())
+        return;
+    if (mgos_sys_config_get_rcsw_gpio() < 0) {
+        LOG(LL_ERROR, ("rcsw.gpio not set in config"));
+        return;
+    }
+
+    rf = (struct rf433 *) malloc(sizeof(*rf));
+    memset(rf, 0, sizeof(*rf));
+    rf->input_gpio = mgos_sys_config_get_rcsw_gpio();
+    rf->last_rx_time = mgos_uptime();
+    pulse_queue_init(&rf->rxq);
+    rf433_decoder_init(&rf->decoder, rf433_frame_found, rf);
+    rf433_dedup_init(&rf->dedup, mgos_sys_config_get_rcsw_dedup_window_ms(), rf433_event, rf);
+    rf->dedup_timer = MGOS_INVALID_TIMER_ID;
+
+    rf433_capture_init(&rf->capture, mgos_sys_config_get_rcsw_capture_file(),
+                       mgos_sys_config_get_rcsw_capture_max_size(),
+                       mgos_sys_config_get_rcsw_capture_mqtt_topic());
+    rf->capture_enabled = rf433_capture_enabled(&rf->capture);
+
+    if (mgos_sys_config_get_rcsw_learn()) {
+        rf->learner = (struct rf433_learner *) malloc(sizeof(*rf->learner));
+        if (rf->learner != NULL)
+            rf433_learner_init(rf->learner);
+        else
+            LOG(LL_ERROR, ("Out of memory for 433 MHz protocol learning, disabled"));
+    }
+
+    mgos_gpio_set_mode(rf->input_gpio, MGOS_GPIO_MODE_INPUT);
+    rf->last_state = mgos_gpio_read(rf->input_gpio);
+    mgos_gpio_set_int_handler_isr(rf->input_gpio, MGOS_GPIO_INT_EDGE_ANY, rf433_int_handler, rf);
+    mgos_gpio_enable_int(rf->input_gpio);
+
+    rf433_rx = rf;
+    LOG(LL_INFO, ("433 MHz receiver initialized (GPIO %d, %d protocols)",
+                  rf->input_gpio, rf->decoder.n_protocols));
+}
+
+// Proposes a protocol for the unknown bursts received so far and starts
+// decoding it right away. The learner starts over for the next protocol.
+bool rcsw_learn(void)
+{
+    struct rf433 *rf = rf433_rx;
+    struct rf433_learned_protocol *learned;
+    char name[RF433_LEARN_NAME_LEN], buf[100];
+
+    if (rf == NULL || rf->learner == NULL) {
+        LOG(LL_ERROR, ("433 MHz protocol learning not enabled"));
+        return false;
+    }
+    if (rf->decoder.n_protocols == RF433_MAX_PROTOCOLS) {
+        LOG(LL_ERROR, ("No room for more 433 MHz protocols"));
+        return false;
+    }
+
+    learned = (struct rf433_learned_protocol *) malloc(sizeof(*learned));
+    if (learned == NULL) {
+        LOG(LL_ERROR, ("Out of memory for a learned 433 MHz protocol"));
+        return false;
+    }
+    snprintf(name, sizeof(name), "learned%d", rf->n_learned);
+    if (rf433_learner_propose(rf->learner, learned, name) < 0) {
+        LOG(LL_WARN, ("No 433 MHz protocol found in %u unknown bursts",
+                      (unsigned int) rf->learner->n_bursts));
+        free(learned);
+        return false;
+    }
+
+    rf433_learner_format(&learned->proto, buf, sizeof(buf));
+    LOG(LL_INFO, ("Learned 433 MHz protocol from %u bursts: %s",
+                  (unsigned int) rf->learner->n_bursts, buf));
+    rf433_decoder_add_protocol(&rf->decoder, &learned->proto);
+    rf->n_learned++;
+    rf433_learner_init(rf->learner);
+
+    return true;
+}
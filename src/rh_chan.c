@@ -0,0 +1,190 @@
+#include <string.h>
+#include "rh_chan.h"
+
+uint32_t rh_chan_rate_bps(enum rh_chan_rate rate)
+{
+    switch (rate) {
+    case RH_CHAN_RATE_1MBPS:
+        return 1000000;
+    case RH_CHAN_RATE_250KBPS:
+        return 250000;
+    default:
+        return 2000000;
+    }
+}
+
+enum rh_chan_rate rh_chan_rate_from_kbps(int kbps)
+{
+    if (kbps < 600)
+        return RH_CHAN_RATE_250KBPS;
+    if (kbps < 1500)
+        return RH_CHAN_RATE_1MBPS;
+    return RH_CHAN_RATE_2MBPS;
+}
+
+void rh_chan_survey_init(struct rh_chan_survey *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void rh_chan_survey_add(struct rh_chan_survey *s, uint8_t channel, bool rpd)
+{
+    if (channel < RH_CHAN_N && rpd)
+        s->busy[channel]++;
+}
+
+void rh_chan_survey_sweep_done(struct rh_chan_survey *s)
+{
+    s->n_sweeps++;
+}
+
+unsigned int rh_chan_occupancy(const struct rh_chan_survey *s, uint8_t channel)
+{
+    if (channel >= RH_CHAN_N || !s->n_sweeps)
+        return 0;
+    return s->busy[channel] * 1000u / s->n_sweeps;
+}
+
+unsigned int rh_chan_cost(const struct rh_chan_survey *s, uint8_t channel)
+{
+    unsigned int cost = 2 * rh_chan_occupancy(s, channel);
+
+    // The band edges count as busy neighbours
+    cost += channel > 0 ? rh_chan_occupancy(s, channel - 1) : 1000;
+    cost += channel < RH_CHAN_N - 1 ? rh_chan_occupancy(s, channel + 1) : 1000;
+    return cost;
+}
+
+uint8_t rh_chan_pick(const struct rh_chan_survey *s, uint8_t first, uint8_t last, int current)
+{
+    unsigned int cost, best_cost = ~0u;
+    uint8_t best = first;
+    unsigned int ch;
+
+    if (last >= RH_CHAN_N)
+        last = RH_CHAN_N - 1;
+    for (ch = first; ch <= last; ch++) {
+        cost = rh_chan_cost(s, ch);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = ch;
+        }
+    }
+    if (current >= first && current <= last &&
+        rh_chan_cost(s, current) <= best_cost + RH_CHAN_HYSTERESIS_PERMILLE)
+        return current;
+    return best;
+}
+
+void rh_chan_survey_format(const struct rh_chan_survey *s, char *out)
+{
+    unsigned int ch, occ;
+
+    for (ch = 0; ch < RH_CHAN_N; ch++) {
+        occ = rh_chan_occupancy(s, ch);
+        out[ch] = occ > 900 ? '*' : '0' + occ / 100;
+    }
+    out[RH_CHAN_N] = '\0';
+}
+
+void rh_chan_monitor_init(struct rh_chan_monitor *m, unsigned int max_loss_permille,
+                          unsigned int min_packets, uint32_t packets, uint32_t lost)
+{
+    memset(m, 0, sizeof(*m));
+    m->max_loss_permille = max_loss_permille;
+    m->min_packets = min_packets ? min_packets : 1;
+    m->packets = packets;
+    m->lost = lost;
+}
+
+enum rh_chan_verdict rh_chan_monitor_check(struct rh_chan_monitor *m, uint32_t packets, uint32_t lost)
+{
+    uint32_t n_packets = packets - m->packets, n_lost = lost - m->lost;
+
+    // Lost packets were sent too: they count towards the window
+    if (n_packets + n_lost < m->min_packets)
+        return RH_CHAN_WAIT;
+    m->packets = packets;
+    m->lost = lost;
+    if (n_lost * 1000ull > (uint64_t) m->max_loss_permille * (n_packets + n_lost)) {
+        m->n_good = 0;
+        return RH_CHAN_DEGRADED;
+    }
+    if (++m->n_good >= RH_CHAN_GOOD_WINDOWS) {
+        m->n_good = 0;
+        return RH_CHAN_GOOD_LONG;
+    }
+    return RH_CHAN_OK;
+}
+
+bool rh_chan_decide(const struct rh_chan_survey *s, uint8_t first, uint8_t last,
+                    uint8_t channel, enum rh_chan_rate rate, uint8_t *new_channel,
+                    enum rh_chan_rate *new_rate)
+{
+    *new_channel = rh_chan_pick(s, first, last, channel);
+    *new_rate = rate;
+    if (*new_channel != channel)
+        return true;
+    // As quiet as it gets: the signal is too weak for the rate
+    if (rate + 1 < RH_CHAN_N_RATES) {
+        *new_rate = (enum rh_chan_rate) (rate + 1);
+        return true;
+    }
+    return false;
+}
+
+int rh_chan_encode_announce(const struct rh_chan_announce *a, uint8_t *buf, unsigned int buf_size)
+{
+    if (buf_size < RH_CHAN_ANNOUNCE_LEN)
+        return -1;
+    buf[0] = RH_CHAN_ANNOUNCE_MAGIC;
+    buf[1] = a->serial;
+    buf[2] = a->channel;
+    buf[3] = a->rate;
+    buf[4] = a->delay_ms >> 8;
+    buf[5] = a->delay_ms;
+    return RH_CHAN_ANNOUNCE_LEN;
+}
+
+int rh_chan_decode_announce(const uint8_t *buf, unsigned int len, struct rh_chan_announce *out)
+{
+    if (len != RH_CHAN_ANNOUNCE_LEN || buf[0] != RH_CHAN_ANNOUNCE_MAGIC)
+        return -1;
+    out->serial = buf[1];
+    out->channel = buf[2];
+    out->rate = buf[3];
+    out->delay_ms = (buf[4] << 8) | buf[5];
+    if (out->channel >= RH_CHAN_N || out->rate >= RH_CHAN_N_RATES)
+        return -1;
+    return 0;
+}
+
+void rh_chan_hunt_init(struct rh_chan_hunt *h, uint8_t first, uint8_t last, uint8_t channel,
+                       enum rh_chan_rate rate)
+{
+    memset(h, 0, sizeof(*h));
+    if (last >= RH_CHAN_N)
+        last = RH_CHAN_N - 1;
+    if (first > last)
+        first = last;
+    if (channel < first || channel > last)
+        channel = first;
+    h->first = first;
+    h->last = last;
+    h->start_channel = channel;
+    h->start_rate = rate;
+    h->channel = channel;
+    h->rate = rate;
+}
+
+bool rh_chan_hunt_next(struct rh_chan_hunt *h)
+{
+    unsigned int n_channels = h->last - h->first + 1;
+
+    // The first combination is where the node lost the gateway
+    if (++h->n_tried >= n_channels * RH_CHAN_N_RATES)
+        return false;
+    h->channel = h->first + (h->start_channel - h->first + h->n_tried) % n_channels;
+    h->rate = (h->start_rate + h->n_tried / n_channels) % RH_CHAN_N_RATES;
+    return true;
+}
@@ -0,0 +1,150 @@
+/*
+ Channel and data rate selection for the RF network
+
+ The gateway surveys the band: it sweeps all RH_CHAN_N nRF24 channels
+ many times, reading the Received Power Detector (RPD, set when the
+ channel had more than -64 dBm during the last 170 us of listening) on
+ each, and counts how often each channel was busy. Wi-Fi and other
+ traffic show up as runs of busy channels. The cost of a channel is its
+ own occupancy counted twice plus that of both neighbours, as a 2 Mbps
+ nRF24 signal is 2 MHz wide and interference rarely stops at a channel
+ edge. The least costly channel in the allowed range wins, unless the
+ current one is within RH_CHAN_HYSTERESIS_PERMILLE of it.
+
+ The gateway watches the loss of the ID sequences of the nodes it
+ hears from (see rh_nodes.h) over windows of a fixed length. A window
+ with more loss than allowed is degraded: the gateway surveys again and
+ moves to a better channel, or, if the current channel is as good as any,
+ the interference is not the problem and it steps the data rate down,
+ trading air time for receiver sensitivity. After RH_CHAN_GOOD_WINDOWS
+ good windows in a row it steps the rate back up towards the configured
+ one.
+
+ The gateway moves the nodes with an announcement (6 bytes, a RadioHead
+ broadcast, repeated a few times before the switch):
+
+ - Magic: 8 bits, RH_CHAN_ANNOUNCE_MAGIC, which is neither a valid
+   rfreport version nor a TDMA beacon
+ - Serial: 8 bits, one more for every switch
+ - Channel: 8 bits
+ - Data rate: 8 bits, enum rh_chan_rate
+ - Delay until the switch, ms: 16 bits, big endian
+
+ Nodes that miss it, such as low-power nodes with the receiver off, find
+ the gateway again by hunting: trying the report on every channel and
+ rate until it is acknowledged, see rh_chan_hunt_next().
+
+ Everything here is independent of the radio and of Mongoose OS.
+ */
+
+#ifndef __MOSTHING_RH_CHAN_H
+#define __MOSTHING_RH_CHAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RH_CHAN_N                       126
+#define RH_CHAN_HYSTERESIS_PERMILLE     50
+#define RH_CHAN_GOOD_WINDOWS            12
+
+#define RH_CHAN_ANNOUNCE_MAGIC          0xc5
+#define RH_CHAN_ANNOUNCE_LEN            6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fastest first
+enum rh_chan_rate {
+    RH_CHAN_RATE_2MBPS = 0,
+    RH_CHAN_RATE_1MBPS,
+    RH_CHAN_RATE_250KBPS,
+    RH_CHAN_N_RATES
+};
+
+uint32_t rh_chan_rate_bps(enum rh_chan_rate rate);
+// The rate closest to kbps
+enum rh_chan_rate rh_chan_rate_from_kbps(int kbps);
+
+struct rh_chan_survey {
+    uint16_t n_sweeps;
+    uint16_t busy[RH_CHAN_N];   // Sweeps with RPD set
+};
+
+void rh_chan_survey_init(struct rh_chan_survey *s);
+void rh_chan_survey_add(struct rh_chan_survey *s, uint8_t channel, bool rpd);
+// After every channel has been added once
+void rh_chan_survey_sweep_done(struct rh_chan_survey *s);
+// Busy sweeps per thousand
+unsigned int rh_chan_occupancy(const struct rh_chan_survey *s, uint8_t channel);
+// Occupancy of the channel and its neighbours, per thousand, up to 4000
+unsigned int rh_chan_cost(const struct rh_chan_survey *s, uint8_t channel);
+// The channel from first to last to use, current if it is about as good
+// as the best
+uint8_t rh_chan_pick(const struct rh_chan_survey *s, uint8_t first, uint8_t last, int current);
+// Writes the occupancy of every channel as one character, '0' to '9'
+// for 0 to 90 % and '*' above, and a terminating NUL: RH_CHAN_N + 1 bytes
+void rh_chan_survey_format(const struct rh_chan_survey *s, char *out);
+
+// Gateway: loss over windows
+enum rh_chan_verdict {
+    RH_CHAN_WAIT = 0,           // Too few packets in the window to tell
+    RH_CHAN_OK,
+    RH_CHAN_DEGRADED,
+    RH_CHAN_GOOD_LONG,          // RH_CHAN_GOOD_WINDOWS good windows in a row
+};
+
+struct rh_chan_monitor {
+    uint32_t packets;           // Totals at the start of the window
+    uint32_t lost;
+    unsigned int max_loss_permille;
+    unsigned int min_packets;
+    unsigned int n_good;
+};
+
+void rh_chan_monitor_init(struct rh_chan_monitor *m, unsigned int max_loss_permille,
+                          unsigned int min_packets, uint32_t packets, uint32_t lost);
+// packets and lost are running totals. A window with too few packets
+// goes on into the next call.
+enum rh_chan_verdict rh_chan_monitor_check(struct rh_chan_monitor *m, uint32_t packets, uint32_t lost);
+
+// What to do about a degraded link, given a fresh survey: returns true
+// and the new channel and rate if anything should change
+bool rh_chan_decide(const struct rh_chan_survey *s, uint8_t first, uint8_t last,
+                    uint8_t channel, enum rh_chan_rate rate, uint8_t *new_channel,
+                    enum rh_chan_rate *new_rate);
+
+struct rh_chan_announce {
+    uint8_t serial;
+    uint8_t channel;
+    uint8_t rate;
+    uint16_t delay_ms;
+};
+
+int rh_chan_encode_announce(const struct rh_chan_announce *a, uint8_t *buf, unsigned int buf_size);
+// Returns < 0 if the message is not an announcement
+int rh_chan_decode_announce(const uint8_t *buf, unsigned int len, struct rh_chan_announce *out);
+
+// Node: the search for the gateway after it has moved. Every channel
+// from first to last at the current rate, then at each other rate.
+struct rh_chan_hunt {
+    uint8_t first;
+    uint8_t last;
+    uint8_t start_channel;
+    uint8_t start_rate;
+    uint16_t n_tried;
+    uint8_t channel;            // Being tried
+    uint8_t rate;
+};
+
+void rh_chan_hunt_init(struct rh_chan_hunt *h, uint8_t first, uint8_t last, uint8_t channel,
+                       enum rh_chan_rate rate);
+// Moves to the next channel and rate to try. Returns false when all
+// have been tried.
+bool rh_chan_hunt_next(struct rh_chan_hunt *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
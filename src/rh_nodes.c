@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rh_nodes.h"
+
+int rh_nodes_init(struct rh_nodes *t, unsigned int max_nodes)
+{
+    memset(t, 0, sizeof(*t));
+    if (max_nodes == 0 || max_nodes > RH_NODES_MAX)
+        return -1;
+    t->nodes = calloc(max_nodes, sizeof(*t->nodes));
+    if (t->nodes == NULL)
+        return -1;
+    t->max_nodes = max_nodes;
+    return 0;
+}
+
+void rh_nodes_free(struct rh_nodes *t)
+{
+    free(t->nodes);
+    memset(t, 0, sizeof(*t));
+}
+
+struct rh_node *rh_nodes_lookup(struct rh_nodes *t, uint8_t address)
+{
+    uint8_t idx = t->index[address];
+
+    return idx ? &t->nodes[idx - 1] : NULL;
+}
+
+static struct rh_node *node_add(struct rh_nodes *t, uint8_t address, uint8_t id)
+{
+    struct rh_node *node;
+
+    if (t->n_nodes >= t->max_nodes)
+        return NULL;
+    node = &t->nodes[t->n_nodes++];
+    memset(node, 0, sizeof(*node));
+    node->address = address;
+    // The first packet is not a gap
+    node->last_id = id - 1;
+    t->index[address] = t->n_nodes;
+    return node;
+}
+
+struct rh_node *rh_nodes_packet(struct rh_nodes *t, uint8_t address, uint8_t id,
+                                int rpd, uint32_t now)
+{
+    struct rh_node *node;
+    uint8_t gap;
+
+    node = rh_nodes_lookup(t, address);
+    if (node == NULL)
+        node = node_add(t, address, id);
+    if (node == NULL) {
+        t->n_untracked++;
+        return NULL;
+    }
+
+    gap = (uint8_t) (id - node->last_id);
+    if (gap == 0) {
+        if (node->n_duplicates < UINT16_MAX)
+            node->n_duplicates++;
+    } else {
+        // After a long silence the node has more likely restarted its
+        // sequence than lost up to 255 packets.
+        if (now - node->last_seen < RH_NODES_RESYNC_S)
+            node->n_lost += gap - 1;
+        node->last_id = id;
+    }
+    node->n_packets++;
+    node->last_seen = now;
+    if (rpd >= 0 && node->n_rpd_known < UINT16_MAX) {
+        node->n_rpd_known++;
+        if (rpd)
+            node->n_rpd++;
+    }
+    return node;
+}
+
+void rh_nodes_add_sensor(struct rh_node *node, uint16_t sensor_id)
+{
+    int i;
+
+    for (i = 0; i < node->n_sensors; i++) {
+        if (node->sensor_ids[i] == sensor_id)
+            return;
+    }
+    if (node->n_sensors < RH_NODES_MAX_SENSORS)
+        node->sensor_ids[node->n_sensors++] = sensor_id;
+}
+
+void rh_nodes_summarize(const struct rh_nodes *t, uint32_t now, uint32_t active_window,
+                        struct rh_nodes_summary *out)
+{
+    int i;
+
+    memset(out, 0, sizeof(*out));
+    for (i = 0; i < t->n_nodes; i++) {
+        const struct rh_node *node = &t->nodes[i];
+
+        if (now - node->last_seen <= active_window)
+            out->n_active++;
+        out->n_packets += node->n_packets;
+        out->n_lost += node->n_lost;
+    }
+    out->n_nodes = t->n_nodes;
+    out->n_untracked = t->n_untracked;
+}
@@ -0,0 +1,77 @@
+/*
+ Per-node state of the RF gateway
+
+ The gateway tracks every node it hears from: the last RadioHead ID
+ (the sequence number of the reliable datagram layer), when it was last
+ heard, how many packets arrived and how many went missing in the ID
+ sequence, how often the nRF24 Received Power Detector (RPD, above
+ -64 dBm) was set as a proxy for RSSI, and which sensor IDs the node
+ reports. RPD is only known for some packets: n_rpd counts out of
+ n_rpd_known.
+
+ Addresses are 8 bits, so a node is found by indexing a 256-byte table
+ with its address; no lookup scans the node array. The node array is
+ allocated once for max_nodes entries. Nodes beyond that are not
+ tracked, but their packets are counted.
+ */
+
+#ifndef __MOSTHING_RH_NODES_H
+#define __MOSTHING_RH_NODES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RH_NODES_MAX_SENSORS        4
+#define RH_NODES_MAX                255
+// After this much silence a gap in the IDs is not counted as lost
+#define RH_NODES_RESYNC_S           3600
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rh_node {
+    uint8_t address;
+    uint8_t last_id;
+    uint8_t n_sensors;
+    uint32_t last_seen;         // Uptime, seconds
+    uint32_t n_packets;
+    uint32_t n_lost;            // Gaps in the ID sequence
+    uint16_t n_duplicates;
+    uint16_t n_rpd;             // Packets received with RPD set
+    uint16_t n_rpd_known;       // Packets with RPD known
+    uint16_t sensor_ids[RH_NODES_MAX_SENSORS];
+};
+
+struct rh_nodes {
+    uint8_t index[256];         // Node slot + 1 by address, 0 if not tracked
+    uint16_t max_nodes;
+    uint16_t n_nodes;
+    uint32_t n_untracked;       // Packets from nodes that did not fit
+    struct rh_node *nodes;
+};
+
+struct rh_nodes_summary {
+    uint32_t n_nodes;
+    uint32_t n_active;          // Heard from within the window
+    uint32_t n_packets;
+    uint32_t n_lost;
+    uint32_t n_untracked;
+};
+
+int rh_nodes_init(struct rh_nodes *t, unsigned int max_nodes);
+void rh_nodes_free(struct rh_nodes *t);
+struct rh_node *rh_nodes_lookup(struct rh_nodes *t, uint8_t address);
+// Accounts a packet with the given RadioHead ID. rpd is < 0 if not
+// known. Returns NULL if the node is not tracked.
+struct rh_node *rh_nodes_packet(struct rh_nodes *t, uint8_t address, uint8_t id,
+                                int rpd, uint32_t now);
+void rh_nodes_add_sensor(struct rh_node *node, uint16_t sensor_id);
+void rh_nodes_summarize(const struct rh_nodes *t, uint32_t now, uint32_t active_window,
+                        struct rh_nodes_summary *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+#include <mgos.h>
+#include "rh_sniffer.h"
+
+// Stop sending while this much is waiting for the client
+#define SEND_MAX            16384
+#define FLUSH_INTERVAL_MS   10
+
+struct entry {
+    // Lost between the frame before and this one, reported ahead of it
+    uint32_t lost_dropped;
+    uint32_t lost_fifo_full;
+    uint8_t len;                // Of the record
+    uint8_t rec[RH_SNIFFER_FRAME_REC_LEN];
+};
+
+static struct {
+    struct entry *ring;
+    unsigned int ring_len;
+    unsigned int head;          // Next to send
+    unsigned int count;
+    struct mg_connection *client;
+    // Lost since the newest frame in the ring
+    uint32_t lost_dropped;
+    uint32_t lost_fifo_full;
+    struct rh_sniffer_stats stats;
+} sniffer;
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_be64(uint8_t *p, uint64_t v)
+{
+    put_be32(p, v >> 32);
+    put_be32(p + 4, v);
+}
+
+static void send_header(struct mg_connection *nc)
+{
+    uint8_t header[RH_SNIFFER_HEADER_LEN];
+
+    memcpy(header, RH_SNIFFER_MAGIC, 7);
+    header[7] = RH_SNIFFER_VERSION;
+    put_be64(header + 8, (uint64_t) (mgos_uptime() * 1e6));
+    mg_send(nc, header, sizeof(header));
+}
+
+static void send_lost(struct mg_connection *nc, uint32_t *dropped, uint32_t *fifo_full)
+{
+    uint8_t rec[2 + 8];
+
+    if (!*dropped && !*fifo_full)
+        return;
+    rec[0] = RH_SNIFFER_REC_LOST;
+    rec[1] = sizeof(rec) - 2;
+    put_be32(rec + 2, *dropped);
+    put_be32(rec + 6, *fifo_full);
+    mg_send(nc, rec, sizeof(rec));
+    *dropped = 0;
+    *fifo_full = 0;
+}
+
+static void flush_cb(void *arg)
+{
+    struct mg_connection *nc = sniffer.client;
+    struct entry *e;
+
+    if (nc == NULL)
+        return;
+    while (nc->send_mbuf.len < SEND_MAX) {
+        if (!sniffer.count) {
+            // Everything received before the loss has been sent
+            send_lost(nc, &sniffer.lost_dropped, &sniffer.lost_fifo_full);
+            break;
+        }
+        e = &sniffer.ring[sniffer.head];
+        send_lost(nc, &e->lost_dropped, &e->lost_fifo_full);
+        mg_send(nc, e->rec, e->len);
+        sniffer.head = (sniffer.head + 1) % sniffer.ring_len;
+        sniffer.count--;
+        sniffer.stats.n_sent++;
+    }
+    (void) arg;
+}
+
+static void handler(struct mg_connection *nc, int ev, void *ev_data, void *user_data)
+{
+    switch (ev) {
+    case MG_EV_ACCEPT:
+        // The newest client wins: the old one has most likely gone away
+        if (sniffer.client != NULL)
+            sniffer.client->flags |= MG_F_CLOSE_IMMEDIATELY;
+        sniffer.client = nc;
+        sniffer.count = 0;
+        sniffer.lost_dropped = 0;
+        sniffer.lost_fifo_full = 0;
+        sniffer.stats.n_clients++;
+        send_header(nc);
+        LOG(LL_INFO, ("RF sniffer client connected"));
+        break;
+    case MG_EV_RECV:
+        // Nothing to say to us
+        mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+        break;
+    case MG_EV_CLOSE:
+        if (nc == sniffer.client) {
+            sniffer.client = NULL;
+            sniffer.count = 0;
+            LOG(LL_INFO, ("RF sniffer client disconnected"));
+        }
+        break;
+    }
+    (void) ev_data;
+    (void) user_data;
+}
+
+int rh_sniffer_init(int port, unsigned int ring_len)
+{
+    char addr[16];
+
+    if (ring_len < 1)
+        ring_len = 1;
+    sniffer.ring = calloc(ring_len, sizeof(*sniffer.ring));
+    if (sniffer.ring == NULL) {
+        LOG(LL_ERROR, ("Out of memory for the RF sniffer ring (%u frames)", ring_len));
+        return -1;
+    }
+    sniffer.ring_len = ring_len;
+
+    snprintf(addr, sizeof(addr), "tcp://:%d", port);
+    if (mg_bind(mgos_get_mgr(), addr, handler, NULL) == NULL) {
+        LOG(LL_ERROR, ("Unable to listen for RF sniffer clients on port %d", port));
+        free(sniffer.ring);
+        sniffer.ring = NULL;
+        return -1;
+    }
+    mgos_set_timer(FLUSH_INTERVAL_MS, MGOS_TIMER_REPEAT, flush_cb, NULL);
+    LOG(LL_INFO, ("RF sniffer listening on port %d, %u frame ring", port, ring_len));
+    return 0;
+}
+
+void rh_sniffer_frame(double time, uint8_t channel, uint8_t rate, uint8_t pipe, uint8_t flags,
+                      const uint8_t *frame, uint8_t len)
+{
+    struct entry *e;
+
+    sniffer.stats.n_frames++;
+    if (sniffer.client == NULL)
+        return;
+    if (sniffer.count == sniffer.ring_len) {
+        sniffer.stats.n_dropped++;
+        sniffer.lost_dropped++;
+        return;
+    }
+    if (len > RH_SNIFFER_MAX_FRAME_LEN)
+        len = RH_SNIFFER_MAX_FRAME_LEN;
+
+    e = &sniffer.ring[(sniffer.head + sniffer.count) % sniffer.ring_len];
+    e->len = 2 + 12 + len;
+    e->rec[0] = RH_SNIFFER_REC_FRAME;
+    e->rec[1] = e->len - 2;
+    put_be64(e->rec + 2, (uint64_t) (time * 1e6));
+    e->rec[10] = channel;
+    e->rec[11] = rate;
+    e->rec[12] = pipe;
+    e->rec[13] = flags;
+    memcpy(e->rec + 14, frame, len);
+    e->lost_dropped = sniffer.lost_dropped;
+    e->lost_fifo_full = sniffer.lost_fifo_full;
+    sniffer.lost_dropped = 0;
+    sniffer.lost_fifo_full = 0;
+    sniffer.count++;
+}
+
+void rh_sniffer_fifo_full(unsigned int n)
+{
+    sniffer.stats.n_fifo_full += n;
+    if (sniffer.client != NULL)
+        sniffer.lost_fifo_full += n;
+}
+
+void rh_sniffer_get_stats(struct rh_sniffer_stats *out)
+{
+    *out = sniffer.stats;
+}
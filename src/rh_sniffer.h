@@ -0,0 +1,76 @@
+/*
+ RF network sniffer stream
+
+ With radiohead.sniffer.enable, radiohead.cpp receives every frame on
+ the channel without acknowledging anything, and hands each to
+ rh_sniffer_frame() with the time the radio received it. The frames are
+ kept in a ring, so that draining the RX FIFO never waits for the
+ network, and streamed to one TCP client at a time on
+ radiohead.sniffer.port. tools/rh_sniff.c turns the stream into pcap
+ files. Frames received while no client is connected are discarded.
+
+ Stream (all fields big endian):
+
+ - Header, once at the start of every connection: 16 bytes
+   - Magic: "RHSNIFF" (7 bytes)
+   - Format version: 8 bits
+   - Uptime of the device when the client connected, us: 64 bits
+ - Records: type 8 bits, length of the rest of the record 8 bits, then
+   - RH_SNIFFER_REC_FRAME:
+     - Reception time, uptime in us: 64 bits
+     - Channel: 8 bits
+     - Data rate: 8 bits, enum rh_chan_rate
+     - Pipe: 8 bits
+     - Flags: 8 bits, RH_SNIFFER_F_*
+     - The frame as on the air: the 4 RadioHead headers (to, from, ID,
+       flags) and the payload, up to 32 bytes
+   - RH_SNIFFER_REC_LOST, where the loss happened: after the frames
+     received before it, ahead of the next one:
+     - Frames dropped because the ring was full: 32 bits
+     - Times the RX FIFO was found full, and frames may have been lost
+       in the radio: 32 bits
+ */
+
+#ifndef __MOSTHING_RH_SNIFFER_H
+#define __MOSTHING_RH_SNIFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RH_SNIFFER_MAGIC            "RHSNIFF"
+#define RH_SNIFFER_VERSION          1
+#define RH_SNIFFER_HEADER_LEN       16
+#define RH_SNIFFER_MAX_FRAME_LEN    32
+
+#define RH_SNIFFER_REC_FRAME        1
+#define RH_SNIFFER_REC_LOST         2
+#define RH_SNIFFER_FRAME_REC_LEN    (2 + 12 + RH_SNIFFER_MAX_FRAME_LEN)
+
+// The time is that of the IRQ, not of reading the RX FIFO
+#define RH_SNIFFER_F_IRQ_TIME       0x01
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rh_sniffer_stats {
+    uint32_t n_frames;          // Received
+    uint32_t n_sent;            // Streamed to a client
+    uint32_t n_dropped;         // Ring full
+    uint32_t n_fifo_full;
+    uint32_t n_clients;
+};
+
+int rh_sniffer_init(int port, unsigned int ring_len);
+// time: uptime in seconds
+void rh_sniffer_frame(double time, uint8_t channel, uint8_t rate, uint8_t pipe, uint8_t flags,
+                      const uint8_t *frame, uint8_t len);
+// The RX FIFO was found full n times
+void rh_sniffer_fifo_full(unsigned int n);
+void rh_sniffer_get_stats(struct rh_sniffer_stats *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+#include <string.h>
+#include "rh_tdma.h"
+
+int rh_tdma_encode_beacon(const struct rh_tdma_beacon *beacon, uint8_t *buf, unsigned int buf_size)
+{
+    unsigned int len = RH_TDMA_BEACON_HEADER_LEN + 2 * beacon->n_assignments;
+    unsigned int i;
+
+    if (beacon->n_assignments > RH_TDMA_MAX_ASSIGNMENTS || len > buf_size)
+        return -1;
+    buf[0] = RH_TDMA_BEACON_MAGIC;
+    buf[1] = beacon->n_slots;
+    buf[2] = beacon->slot_ms;
+    buf[3] = beacon->superframe >> 8;
+    buf[4] = beacon->superframe;
+    buf[5] = beacon->delay_us >> 8;
+    buf[6] = beacon->delay_us;
+    buf[7] = beacon->n_assignments;
+    for (i = 0; i < beacon->n_assignments; i++) {
+        buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i] = beacon->assignments[i].address;
+        buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i + 1] = beacon->assignments[i].slot;
+    }
+    return len;
+}
+
+int rh_tdma_decode_beacon(const uint8_t *buf, unsigned int len, struct rh_tdma_beacon *out)
+{
+    unsigned int i;
+
+    if (len < RH_TDMA_BEACON_HEADER_LEN || buf[0] != RH_TDMA_BEACON_MAGIC)
+        return -1;
+    out->n_slots = buf[1];
+    out->slot_ms = buf[2];
+    out->superframe = (buf[3] << 8) | buf[4];
+    out->delay_us = (buf[5] << 8) | buf[6];
+    out->n_assignments = buf[7];
+    if (out->n_slots < RH_TDMA_FIRST_NODE_SLOT || out->slot_ms == 0 ||
+        out->n_assignments > RH_TDMA_MAX_ASSIGNMENTS ||
+        len < RH_TDMA_BEACON_HEADER_LEN + 2u * out->n_assignments)
+        return -1;
+    for (i = 0; i < out->n_assignments; i++) {
+        out->assignments[i].address = buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i];
+        out->assignments[i].slot = buf[RH_TDMA_BEACON_HEADER_LEN + 2 * i + 1];
+    }
+    return 0;
+}
+
+double rh_tdma_period(uint8_t n_slots, uint8_t slot_ms)
+{
+    return n_slots * slot_ms / 1000.0;
+}
+
+void rh_tdma_schedule_init(struct rh_tdma_schedule *s, unsigned int slot_ms, unsigned int max_slots,
+                           double now)
+{
+    memset(s, 0, sizeof(*s));
+    if (slot_ms < 1)
+        slot_ms = 1;
+    if (slot_ms > 255)
+        slot_ms = 255;
+    if (max_slots < RH_TDMA_FIRST_NODE_SLOT + 1)
+        max_slots = RH_TDMA_FIRST_NODE_SLOT + 1;
+    if (max_slots > RH_TDMA_MAX_SLOTS)
+        max_slots = RH_TDMA_MAX_SLOTS;
+    s->slot_ms = slot_ms;
+    s->max_slots = max_slots;
+    s->n_slots = RH_TDMA_FIRST_NODE_SLOT;
+    s->announced_slots = s->n_slots;
+    s->next_announce = RH_TDMA_FIRST_NODE_SLOT;
+    // The first beacon is due now
+    s->start = now - rh_tdma_period(s->announced_slots, s->slot_ms);
+    s->superframe = 0xffff;
+}
+
+int rh_tdma_assign(struct rh_tdma_schedule *s, uint8_t address)
+{
+    uint8_t slot;
+
+    if (s->slot_of[address])
+        return s->slot_of[address];
+    if (address == 0xff || s->n_slots >= s->max_slots) {
+        s->n_full++;
+        return 0;
+    }
+    // The superframe grows from the next beacon on
+    slot = s->n_slots++;
+    s->slot_of[address] = slot;
+    s->address_of[slot] = address;
+    if (s->n_new < RH_TDMA_MAX_ASSIGNMENTS)
+        s->new_slots[s->n_new++] = slot;
+    return slot;
+}
+
+static bool beacon_has(const struct rh_tdma_beacon *b, uint8_t slot)
+{
+    unsigned int i;
+
+    for (i = 0; i < b->n_assignments; i++) {
+        if (b->assignments[i].slot == slot)
+            return true;
+    }
+    return false;
+}
+
+static void beacon_add(const struct rh_tdma_schedule *s, struct rh_tdma_beacon *b, uint8_t slot)
+{
+    b->assignments[b->n_assignments].address = s->address_of[slot];
+    b->assignments[b->n_assignments].slot = slot;
+    b->n_assignments++;
+}
+
+double rh_tdma_next_beacon(struct rh_tdma_schedule *s, double now, struct rh_tdma_beacon *out)
+{
+    // The superframe that ends now is as long as its beacon said
+    double period = rh_tdma_period(s->announced_slots, s->slot_ms);
+    double start = s->start + period;
+    unsigned int n, i;
+    uint8_t slot;
+
+    s->superframe++;
+    if (now > start + period) {
+        // Missed superframes are skipped, keeping the grid
+        n = (now - start) / period;
+        start += n * period;
+        s->superframe += n;
+    }
+    // A beacon later than half a slot would run into slot 1, and one
+    // sent early (the timer has ms resolution) starts its superframe
+    if (now < start || now - start > s->slot_ms / 2000.0)
+        start = now;
+    s->start = start;
+    s->announced_slots = s->n_slots;
+
+    memset(out, 0, sizeof(*out));
+    out->n_slots = s->n_slots;
+    out->slot_ms = s->slot_ms;
+    out->superframe = s->superframe;
+    out->delay_us = (now - start) * 1000000;
+
+    // Newly assigned slots first, then all of them in turn
+    for (i = 0; i < s->n_new; i++)
+        beacon_add(s, out, s->new_slots[i]);
+    s->n_new = 0;
+    n = s->n_slots - RH_TDMA_FIRST_NODE_SLOT;
+    for (i = 0; i < n && out->n_assignments < RH_TDMA_MAX_ASSIGNMENTS; i++) {
+        slot = s->next_announce;
+        if (++s->next_announce >= s->n_slots)
+            s->next_announce = RH_TDMA_FIRST_NODE_SLOT;
+        if (!beacon_has(out, slot))
+            beacon_add(s, out, slot);
+    }
+
+    return start + rh_tdma_period(s->announced_slots, s->slot_ms);
+}
+
+void rh_tdma_clock_init(struct rh_tdma_clock *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->rate = 1.0;
+}
+
+void rh_tdma_clock_beacon(struct rh_tdma_clock *c, const struct rh_tdma_beacon *beacon,
+                          uint8_t address, double rx_time)
+{
+    double start, elapsed, rate, max_rate = RH_TDMA_MAX_RATE_PPM / 1e6;
+    uint16_t n_superframes;
+    unsigned int i;
+
+    for (i = 0; i < beacon->n_assignments; i++) {
+        if (beacon->assignments[i].address == address)
+            c->slot = beacon->assignments[i].slot;
+    }
+    // Not ours any more: the gateway has restarted
+    if (c->slot >= beacon->n_slots)
+        c->slot = 0;
+    if (rx_time < 0)
+        return;
+
+    start = rx_time - beacon->delay_us / 1e6 * c->rate;
+    n_superframes = beacon->superframe - c->superframe;
+    if (c->synced && n_superframes > 0 && n_superframes <= RH_TDMA_SYNC_LOST) {
+        // The superframes in between were as long as the last beacon said,
+        // as the slot count only changes at beacons: assume it did not
+        elapsed = n_superframes * rh_tdma_period(c->n_slots, c->slot_ms);
+        rate = (start - c->start) / elapsed;
+        if (rate > 1.0 - max_rate && rate < 1.0 + max_rate)
+            c->rate += (rate - c->rate) / 8;
+    } else if (!c->synced && c->n_beacons) {
+        c->n_resyncs++;
+    }
+    c->synced = true;
+    c->superframe = beacon->superframe;
+    c->n_slots = beacon->n_slots;
+    c->slot_ms = beacon->slot_ms;
+    c->start = start;
+    c->n_beacons++;
+}
+
+bool rh_tdma_clock_synced(struct rh_tdma_clock *c, double now)
+{
+    if (c->synced && now - c->start > RH_TDMA_SYNC_LOST * rh_tdma_period(c->n_slots, c->slot_ms))
+        c->synced = false;
+    return c->synced;
+}
+
+bool rh_tdma_clock_next_slot(struct rh_tdma_clock *c, double now, double *start, double *end)
+{
+    double period, slot_len, guard, first;
+    unsigned int n;
+
+    if (!rh_tdma_clock_synced(c, now) || !c->slot)
+        return false;
+    period = rh_tdma_period(c->n_slots, c->slot_ms) * c->rate;
+    slot_len = c->slot_ms / 1000.0 * c->rate;
+    first = c->start + c->slot * slot_len;
+    n = now > first ? (unsigned int) ((now - first) / period) : 0;
+    while (true) {
+        *start = first + n * period;
+        // The clock error grows with the time since the beacon
+        guard = RH_TDMA_GUARD_S + (*start - c->start) * RH_TDMA_GUARD_DRIFT_PPM / 1e6;
+        if (2 * guard >= slot_len)
+            return false;
+        *end = *start + slot_len - guard;
+        *start += guard;
+        if (*end > now)
+            return true;
+        n++;
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ Time-division access for the RF network
+
+ The gateway divides time into superframes of n_slots slots of slot_ms
+ each. Slot 0 holds the beacon the gateway broadcasts at the start of
+ every superframe, and every other slot belongs to one node, which is
+ the only one transmitting in it. The gateway gives a slot to every node
+ it hears from, and announces the assignments in the beacons: newly assigned
+ ones first, then the others in turn, up to RH_TDMA_MAX_ASSIGNMENTS per
+ beacon. Until a node hears its slot, it sends at once, as without
+ TDMA: a few collisions while the nodes join are cheaper than taking
+ turns in one contention slot per superframe.
+
+ Nodes discipline their clock against the beacons: the superframe start
+ is taken from the reception time of each beacon, corrected by the delay
+ the gateway had sending it, and the rate of the local clock against the
+ gateway's is tracked, so that slots stay aligned when beacons are
+ missed. Each slot is shrunk by a guard time that grows with the time
+ since the last beacon.
+
+ Beacon (up to 28 bytes, a RadioHead broadcast):
+
+ - Magic: 8 bits, RH_TDMA_BEACON_MAGIC, which is not a valid rfreport
+   version
+ - Number of slots, beacon slot included: 8 bits
+ - Slot length, ms: 8 bits
+ - Superframe number: 16 bits
+ - Delay from the superframe start to sending the beacon, us: 16 bits
+ - Number of assignments: 8 bits
+ - Assignments: address 8 bits, slot 8 bits
+
+ All fields are big endian. Everything here is independent of the radio
+ and of Mongoose OS: times are seconds of any monotonic local clock.
+ */
+
+#ifndef __MOSTHING_RH_TDMA_H
+#define __MOSTHING_RH_TDMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RH_TDMA_BEACON_MAGIC        0xb1
+#define RH_TDMA_BEACON_HEADER_LEN   8
+#define RH_TDMA_MAX_ASSIGNMENTS     10
+#define RH_TDMA_BEACON_MAX_LEN      (RH_TDMA_BEACON_HEADER_LEN + 2 * RH_TDMA_MAX_ASSIGNMENTS)
+
+#define RH_TDMA_SLOT_BEACON         0
+#define RH_TDMA_FIRST_NODE_SLOT     1
+#define RH_TDMA_MAX_SLOTS           255
+
+// Guard at both ends of a slot right after a beacon, and its growth
+// with the time since, for the clock error left after discipline
+#define RH_TDMA_GUARD_S             0.0005
+#define RH_TDMA_GUARD_DRIFT_PPM     100
+// Local clocks further than this off are not believed
+#define RH_TDMA_MAX_RATE_PPM        1000
+// Without a beacon for this many superframes, the node is out of sync
+#define RH_TDMA_SYNC_LOST           8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rh_tdma_assignment {
+    uint8_t address;
+    uint8_t slot;
+};
+
+struct rh_tdma_beacon {
+    uint8_t n_slots;
+    uint8_t slot_ms;
+    uint16_t superframe;
+    uint16_t delay_us;
+    uint8_t n_assignments;
+    struct rh_tdma_assignment assignments[RH_TDMA_MAX_ASSIGNMENTS];
+};
+
+int rh_tdma_encode_beacon(const struct rh_tdma_beacon *beacon, uint8_t *buf, unsigned int buf_size);
+// Returns < 0 if the message is not a beacon
+int rh_tdma_decode_beacon(const uint8_t *buf, unsigned int len, struct rh_tdma_beacon *out);
+
+// Gateway
+struct rh_tdma_schedule {
+    uint8_t slot_of[256];       // Slot by address, 0 if none
+    uint8_t address_of[RH_TDMA_MAX_SLOTS + 1];
+    uint8_t n_slots;            // Beacon slot included
+    uint8_t announced_slots;    // In the beacon of the current superframe
+    uint8_t max_slots;
+    uint8_t slot_ms;
+    uint8_t n_new;              // Assignments not announced yet
+    uint8_t new_slots[RH_TDMA_MAX_ASSIGNMENTS];
+    uint8_t next_announce;      // Round robin over the assigned slots
+    uint16_t superframe;
+    double start;               // Of the current superframe
+    uint32_t n_full;            // Nodes that got no slot
+};
+
+void rh_tdma_schedule_init(struct rh_tdma_schedule *s, unsigned int slot_ms, unsigned int max_slots,
+                           double now);
+// Returns the slot of the node, assigning one if needed, or 0 if all are taken
+int rh_tdma_assign(struct rh_tdma_schedule *s, uint8_t address);
+double rh_tdma_period(uint8_t n_slots, uint8_t slot_ms);
+// Starts the superframe due at or before now, skipping missed ones, and
+// fills the beacon to send for it. Returns the time of the next one.
+double rh_tdma_next_beacon(struct rh_tdma_schedule *s, double now, struct rh_tdma_beacon *out);
+
+// Node
+struct rh_tdma_clock {
+    bool synced;
+    uint8_t slot;               // Own slot, 0 until assigned
+    uint8_t n_slots;
+    uint8_t slot_ms;
+    uint16_t superframe;        // Of the last beacon
+    double start;               // Local time the last beacon's superframe started
+    double rate;                // Local seconds per gateway second
+    uint32_t n_beacons;
+    uint32_t n_resyncs;         // Beacons after losing sync
+};
+
+void rh_tdma_clock_init(struct rh_tdma_clock *c);
+// rx_time: local time the beacon started on the air (the end of its
+// reception less its air time), if known; beacons with rx_time < 0 only
+// update the slot assignment
+void rh_tdma_clock_beacon(struct rh_tdma_clock *c, const struct rh_tdma_beacon *beacon,
+                          uint8_t address, double rx_time);
+bool rh_tdma_clock_synced(struct rh_tdma_clock *c, double now);
+// Finds the usable part of the node's next slot that ends after now.
+// Returns false if not in sync, or no slot is assigned.
+bool rh_tdma_clock_next_slot(struct rh_tdma_clock *c, double now, double *start, double *end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
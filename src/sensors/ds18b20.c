@@ -4,46 +4,72 @@
 #include "sensors.h"
 
 
-static int ds18b20_read_temperature(int pin, int res, float *temperature)
-{
-    bool found = false;
-    uint8_t rom[8], data[9];
-    int16_t raw;
-    int us, cfg;
-    struct mgos_onewire *ow;
+#define DS18B20_RESOLUTION  12
 
-    // Step 1: Determine config
+// A conversion started by ds18b20_start()
+struct ds18b20_state {
+    uint8_t rom[8];
+    double ready_time;          // Uptime when the conversion is done, 0 if none
+};
+
+// Conversion time in microseconds of each resolution
+static int ds18b20_config(int res, int *cfg)
+{
     if (res == 9) { // 9-bit resolution (93.75ms delay)
-        cfg = 0x1f;
-        us = 93750;
+        *cfg = 0x1f;
+        return 93750;
     } else if (res == 10) { // 10-bit resolution (187.5ms delay)
-        cfg = 0x3f;
-        us = 187500;
+        *cfg = 0x3f;
+        return 187500;
     } else if (res == 11) { // 11-bit resolution (375ms delay)
-        cfg = 0x5f;
-        us = 375000;
+        *cfg = 0x5f;
+        return 375000;
     } else {  // 12-bit resolution (750ms delay)
-        cfg = 0x7f;
-        us = 750000;
+        *cfg = 0x7f;
+        return 750000;
     }
+}
+
+static struct mgos_onewire *ds18b20_find(int pin, uint8_t *rom)
+{
+    bool found = false;
+    uint8_t dev[8];
+    struct mgos_onewire *ow;
 
-    // Step 2: Find all the sensors
     ow = mgos_onewire_create(pin);
     mgos_onewire_search_clean(ow);
-    while (mgos_onewire_next(ow, rom, 1)) {
-        if (rom[0] != 0x28)
+    while (mgos_onewire_next(ow, dev, 1)) {
+        if (dev[0] != 0x28)
             continue; // Skip devices that are not DS18B20's
         if (found) {
             LOG(LL_ERROR, ("OneWire bus has more than one DS18B20 sensor. This is unsupported."));
             break;
         }
         // Only use the first found DS18B20 for now.
+        memcpy(rom, dev, sizeof(dev));
         found = true;
     }
     if (!found) {
         LOG(LL_ERROR, ("DS18B20 not found on OneWire bus"));
-        return -1;
+        mgos_onewire_close(ow);
+        return NULL;
     }
+    return ow;
+}
+
+// Returns the conversion time in microseconds
+static int ds18b20_start_conversion(int pin, int res, uint8_t *rom)
+{
+    struct mgos_onewire *ow;
+    int us, cfg;
+
+    // Step 1: Determine config
+    us = ds18b20_config(res, &cfg);
+
+    // Step 2: Find all the sensors
+    ow = ds18b20_find(pin, rom);
+    if (ow == NULL)
+        return -1;
 
     // Step 3: Write the configuration
     mgos_onewire_reset(ow);                         // Reset
@@ -53,14 +79,25 @@ static int ds18b20_read_temperature(int pin, int res, float *temperature)
     mgos_onewire_write(ow, 0x00);                   // Tl or User Byte 2
     mgos_onewire_write(ow, cfg);                    // Configuration register
     mgos_onewire_write(ow, 0x48);                   // Copy scratchpad
-    
+
     // Step 4: Start temperature conversion
     mgos_onewire_reset(ow);                         // Reset
     mgos_onewire_write(ow, 0xcc);                   // Skip Rom
     mgos_onewire_write(ow, 0x44);                   // Start conversion
-    mgos_usleep(us);                                // Wait for conversion
+
+    mgos_onewire_close(ow);
+    return us;
+}
+
+static int ds18b20_read_result(int pin, const uint8_t *rom, float *temperature)
+{
+    uint8_t data[9];
+    int16_t raw;
+    int cfg;
+    struct mgos_onewire *ow;
 
     // Step 5: Read the temperatures
+    ow = mgos_onewire_create(pin);
     mgos_onewire_reset(ow);                     // Reset
     mgos_onewire_select(ow, rom);               // Select the device
     mgos_onewire_write(ow, 0xbe);               // Issue read command
@@ -77,16 +114,37 @@ static int ds18b20_read_temperature(int pin, int res, float *temperature)
     *temperature = (float) raw / 16.0;
 
     mgos_onewire_close(ow);                     // Close one wire
-
     return 0;
 }
 
+int ds18b20_start(struct sensor *sensor)
+{
+    struct ds18b20_state *state = sensor->driver_data;
+    int us;
+
+    us = ds18b20_start_conversion(sensor->gpio, DS18B20_RESOLUTION, state->rom);
+    if (us < 0)
+        return -1;
+    state->ready_time = mgos_uptime() + us / 1e6;
+    return (us + 999) / 1000;
+}
+
 int ds18b20_poll(struct sensor *sensor, struct sensor_measurement *out)
 {
+    struct ds18b20_state *state = sensor->driver_data;
+    double wait;
     float temp;
     int ret;
 
-    ret = ds18b20_read_temperature(sensor->gpio, 12, &temp);
+    // Without ds18b20_start(), convert now
+    if (!state->ready_time && ds18b20_start(sensor) < 0)
+        return -1;
+    wait = state->ready_time - mgos_uptime();
+    if (wait > 0)
+        mgos_usleep(wait * 1e6);                // Wait for conversion
+    state->ready_time = 0;
+
+    ret = ds18b20_read_result(sensor->gpio, state->rom, &temp);
     if (ret < 0)
         return -1;
 
@@ -104,7 +162,8 @@ int ds18b20_poll(struct sensor *sensor, struct sensor_measurement *out)
 
 int ds18b20_init(struct sensor *sensor)
 {
-    struct sensor_measurement out;
+    struct ds18b20_state *state;
+    struct mgos_onewire *ow;
 
     LOG(LL_INFO, ("Initializing DS18B20 sensor (GPIO %d, power GPIO %d)", sensor->gpio,
                   sensor->power_gpio));
@@ -112,8 +171,18 @@ int ds18b20_init(struct sensor *sensor)
         mgos_gpio_set_mode(sensor->power_gpio, MGOS_GPIO_MODE_OUTPUT);
         mgos_gpio_write(sensor->power_gpio, 1);
     }
-    if (ds18b20_poll(sensor, &out) < 0)
+    state = calloc(1, sizeof(*state));
+    if (state == NULL)
         return -1;
+    // Only look for the sensor: a conversion would keep a low-power
+    // node awake for 750 ms more
+    ow = ds18b20_find(sensor->gpio, state->rom);
+    if (ow == NULL) {
+        free(state);
+        return -1;
+    }
+    mgos_onewire_close(ow);
+    sensor->driver_data = state;
     LOG(LL_INFO, ("DS18B20 initialized"));
 
     return 0;
@@ -22,14 +22,19 @@ int rh_sensor_is_initialized()
     return rh_sensor_initialized;
 }
 
-int rh_sensor_handle_message(const uint8_t *buf, unsigned int buf_len)
+int rh_sensor_handle_message(const uint8_t *buf, unsigned int buf_len, uint16_t *sensor_id)
 {
-    struct rf_sensor_report *report;
+    struct rf_report_view report;
+    int ret;
 
-    if (rf_report_decode_msg(buf, buf_len, &report) < 0)
+    ret = rf_report_decode_msg(buf, buf_len, &report);
+    if (ret < 0) {
+        LOG(LL_DEBUG, ("Invalid RF report (%s)", rf_report_strerror(ret)));
         return -1;
-    sensors_handle_rf_report(report);
-    free(report);
+    }
+    if (sensor_id)
+        *sensor_id = report.sensor_id;
+    sensors_handle_rf_report(&report);
 
     return 0;
 }
@@ -4,9 +4,17 @@
 #include <stdint.h>
 #include "rfreport.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int rh_sensor_init();
 int rh_sensor_is_initialized();
-int rh_sensor_handle_message(const uint8_t *buf, unsigned int buf_len);
+int rh_sensor_handle_message(const uint8_t *buf, unsigned int buf_len, uint16_t *sensor_id);
 int rh_sensor_send_message(const uint8_t *buf, unsigned int buf_len);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -1,7 +1,25 @@
-#include <mgos.h>
-#include <common/cs_crc32.h>
+#include <math.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
 #include "rfreport.h"
 
+// Resolution and zero point of the v2 fixed point values
+static const struct {
+    float scale;        // Steps per unit
+    float offset;       // Value encoded as zero
+} v2_scales[RF_PHENOMENON_MAX + 1] = {
+    [RF_PHENOMENON_TEMPERATURE] =       { 100, 0 },     // 0.01 C
+    [RF_PHENOMENON_HUMIDITY] =          { 10, 0 },      // 0.1 %
+    [RF_PHENOMENON_LUMINOSITY] =        { 1, 0 },       // 1 lx
+    [RF_PHENOMENON_PRESSURE] =          { 10, 1000 },   // 0.1 hPa
+    [RF_PHENOMENON_SOIL_MOISTURE] =     { 10, 0 },      // 0.1 %
+    [RF_PHENOMENON_BATTERY_VOLTAGE] =   { 1000, 0 },    // 1 mV
+    [RF_PHENOMENON_CO2_LEVEL] =         { 1, 400 },     // 1 ppm
+    [RF_PHENOMENON_DISTANCE] =          { 1000, 0 },    // 1 mm
+    [RF_PHENOMENON_AWAKE_TIME] =        { 1000, 0 },    // 1 ms
+};
+
 
 static inline void write_uint32(uint8_t **buf, uint32_t val)
 {
@@ -28,7 +46,7 @@ static inline uint32_t read_uint32(const uint8_t **buf)
     const uint8_t *p = *buf;
     uint32_t val;
 
-    val = (*p++) << 24;
+    val = (uint32_t) (*p++) << 24;
     val |= (*p++) << 16;
     val |= (*p++) << 8;
     val |= *p++;
@@ -49,17 +67,156 @@ static inline uint16_t read_uint16(const uint8_t **buf)
     return val;
 }
 
-void rf_report_encode_msg(uint16_t sensor_id, unsigned int n_observations,
-                          const struct rf_sensor_observation *observations,
-                          uint8_t **buf_out, unsigned int *buf_len)
+static inline int write_varint(uint8_t **buf, const uint8_t *end, uint32_t val)
+{
+    uint8_t *p = *buf;
+
+    do {
+        if (p == end)
+            return -1;
+        *p++ = (val & 0x7f) | (val > 0x7f ? 0x80 : 0);
+        val >>= 7;
+    } while (val);
+    *buf = p;
+    return 0;
+}
+
+static inline int read_varint(const uint8_t **buf, const uint8_t *end, uint32_t *val)
+{
+    const uint8_t *p = *buf;
+    uint32_t v = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end)
+            return -1;
+        v |= (uint32_t) (*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *val = v;
+            *buf = p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline uint32_t zigzag_encode(int32_t val)
+{
+    return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t val)
 {
-    uint32_t crc;
-    uint8_t *p;
+    return (int32_t) ((val >> 1) ^ -(val & 1));
+}
+
+static int32_t to_fixed(int phenomenon, float val)
+{
+    float f = (val - v2_scales[phenomenon].offset) * v2_scales[phenomenon].scale;
+
+    if (f >= 2147483647.0f)
+        return INT32_MAX;
+    if (f <= -2147483648.0f)
+        return INT32_MIN;
+    return (int32_t) (f >= 0 ? f + 0.5f : f - 0.5f);
+}
+
+static float from_fixed(int phenomenon, int32_t val)
+{
+    return val / v2_scales[phenomenon].scale + v2_scales[phenomenon].offset;
+}
+
+// CRC-16/CCITT-FALSE, four bits at a time
+static uint16_t crc16(const uint8_t *buf, size_t len)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+    uint16_t crc = 0xffff;
+
+    while (len--) {
+        crc ^= *buf++ << 8;
+        crc = (crc << 4) ^ table[crc >> 12];
+        crc = (crc << 4) ^ table[crc >> 12];
+    }
+    return crc;
+}
+
+// The same CRC-32 as cs_crc32(), four bits at a time instead of one
+static uint32_t crc32(const uint8_t *buf, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    uint32_t crc = 0xffffffff;
+
+    while (len--) {
+        crc ^= *buf++;
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+// Encodes a v2 message. Returns its length or a negative error code.
+int rf_report_encode_msg(uint16_t sensor_id, unsigned int n_observations,
+                         const struct rf_sensor_observation *observations,
+                         uint8_t *buf, unsigned int buf_size)
+{
+    const struct rf_sensor_observation *by_phenomenon[RF_PHENOMENON_MAX + 1];
+    const uint8_t *end = buf + buf_size;
+    uint32_t phenomena = 0;
+    uint8_t *p = buf;
+    int i;
+
+    memset(by_phenomenon, 0, sizeof(by_phenomenon));
+    for (i = 0; i < (int) n_observations; i++) {
+        const struct rf_sensor_observation *obs = observations + i;
+
+        if (obs->phenomenon > RF_PHENOMENON_MAX || by_phenomenon[obs->phenomenon] != NULL ||
+            obs->value_type != RF_VALUE_FLOAT || !isfinite(obs->value.float_val))
+            return RF_REPORT_ERR_INVALID;
+        by_phenomenon[obs->phenomenon] = obs;
+        phenomena |= 1 << obs->phenomenon;
+    }
+
+    if (buf_size < 3)
+        return RF_REPORT_ERR_NO_SPACE;
+    *p++ = RF_PROTOCOL_V2 << 4;
+    write_uint16(&p, sensor_id);
+    if (write_varint(&p, end, phenomena) < 0)
+        return RF_REPORT_ERR_NO_SPACE;
+    for (i = 0; i <= RF_PHENOMENON_MAX; i++) {
+        if (by_phenomenon[i] == NULL)
+            continue;
+        if (write_varint(&p, end, zigzag_encode(to_fixed(i, by_phenomenon[i]->value.float_val))) < 0)
+            return RF_REPORT_ERR_NO_SPACE;
+    }
+
+    if (end - p < RF_REPORT_V2_CRC_LEN)
+        return RF_REPORT_ERR_NO_SPACE;
+    write_uint16(&p, crc16(buf, p - buf));
+
+    return p - buf;
+}
+
+// Encodes a v1 message, for receivers that do not know v2 yet. Returns
+// the length of the message or a negative error code.
+int rf_report_encode_msg_v1(uint16_t sensor_id, unsigned int n_observations,
+                            const struct rf_sensor_observation *observations,
+                            uint8_t *buf, unsigned int buf_size)
+{
+    uint8_t *p = buf;
     int len, i;
 
-    len = sizeof(struct rf_sensor_report) + n_observations * sizeof(struct rf_sensor_observation);
-    p = *buf_out = malloc(len);
-    *buf_len = (uint32_t) len;
+    if (n_observations > RF_REPORT_MAX_OBSERVATIONS)
+        return RF_REPORT_ERR_NO_SPACE;
+    len = RF_REPORT_LEN(n_observations);
+    if ((int) buf_size < len)
+        return RF_REPORT_ERR_NO_SPACE;
 
     *p++ = (RF_PROTOCOL_V1 << 4) | n_observations;
     *p++ = 0; // padding
@@ -67,84 +224,153 @@ void rf_report_encode_msg(uint16_t sensor_id, unsigned int n_observations,
 
     for (i = 0; i < (int) n_observations; i++) {
         const struct rf_sensor_observation *obs = observations + i;
-        uint32_t val;
 
         *p++ = obs->phenomenon;
         *p++ = obs->value_type << 4;
-        val = (uint32_t) obs->value.int_val;
-        write_uint32(&p, val);
+        write_uint32(&p, (uint32_t) obs->value.int_val);
     }
 
-    printf("encode: calculating crc for bytes: ");
-    for (i = 0; i < len - 4; i++)
-        printf("%02x ", (*buf_out)[i]);
-    printf("\n");
-    crc = cs_crc32(0, *buf_out, len - 4);
-    write_uint32(&p, crc);
-    assert((p - *buf_out) == len);
+    write_uint32(&p, crc32(buf, p - buf));
+
+    return len;
 }
 
-int rf_report_decode_msg(const uint8_t *buf, unsigned int buf_len,
-                         struct rf_sensor_report **out)
+static int decode_v1(const uint8_t *buf, unsigned int buf_len, struct rf_report_view *out)
 {
     const uint8_t *p;
-    struct rf_sensor_report *rep;
-    uint32_t msg_crc, crc;
-    int proto_ver, n_observations, msg_len, i;
+    int n_observations, msg_len;
 
-    if (buf_len < 1)
-        return -1;
-    p = buf;
-    proto_ver = *p >> 4;
-    if (proto_ver != RF_PROTOCOL_V1) {
-        LOG(LL_ERROR, ("invalid RF report protocol version: %d", proto_ver));
-    }
-    n_observations = *p++ & 0x0f;
-    msg_len = sizeof(struct rf_sensor_report) + n_observations * sizeof(struct rf_sensor_observation);
-    if ((int) buf_len < msg_len) {
-        LOG(LL_ERROR, ("incoming RF report message too short (%d bytes, need %d)", buf_len, msg_len));
-        return -1;
+    if (buf_len < RF_REPORT_LEN(0))
+        return RF_REPORT_ERR_TOO_SHORT;
+    n_observations = buf[0] & 0x0f;
+    msg_len = RF_REPORT_LEN(n_observations);
+    if ((int) buf_len < msg_len)
+        return RF_REPORT_ERR_TOO_SHORT;
+
+    p = buf + msg_len - RF_REPORT_CRC_LEN;
+    if (crc32(buf, p - buf) != read_uint32(&p))
+        return RF_REPORT_ERR_CRC;
+
+    p = buf + 2;
+    out->buf = buf;
+    out->proto_ver = RF_PROTOCOL_V1;
+    out->n_observations = n_observations;
+    out->sensor_id = read_uint16(&p);
+    out->phenomena = 0;
+    out->values = NULL;
+
+    return 0;
+}
+
+static int decode_v2(const uint8_t *buf, unsigned int buf_len, struct rf_report_view *out)
+{
+    const uint8_t *p = buf + 3, *end, *values;
+    uint32_t phenomena, val;
+
+    if (buf_len < 3 + 1 + RF_REPORT_V2_CRC_LEN)
+        return RF_REPORT_ERR_TOO_SHORT;
+    end = buf + buf_len - RF_REPORT_V2_CRC_LEN;
+    if (read_varint(&p, end, &phenomena) < 0)
+        return RF_REPORT_ERR_TOO_SHORT;
+    if (phenomena >> (RF_PHENOMENON_MAX + 1))
+        return RF_REPORT_ERR_INVALID;
+    values = p;
+    for (val = phenomena; val; val &= val - 1) {
+        uint32_t dummy;
+
+        if (read_varint(&p, end, &dummy) < 0)
+            return RF_REPORT_ERR_TOO_SHORT;
     }
-    rep = (struct rf_sensor_report *) malloc(msg_len);
-    rep->proto_ver = proto_ver;
-    rep->n_observations = n_observations;
-    p++; // padding
-    rep->sensor_id = read_uint16(&p);
-    for (i = 0; i < n_observations; i++) {
-        struct rf_sensor_observation *obs = rep->observations + i;
-
-        obs->phenomenon = *p++;
-        obs->value_type = *p++ >> 4;
-        obs->value.int_val = (int32_t) read_uint32(&p);
+
+    val = crc16(buf, p - buf);
+    if (val != read_uint16(&p))
+        return RF_REPORT_ERR_CRC;
+
+    p = buf + 1;
+    out->buf = buf;
+    out->proto_ver = RF_PROTOCOL_V2;
+    out->n_observations = __builtin_popcount(phenomena);
+    out->sensor_id = read_uint16(&p);
+    out->phenomena = phenomena;
+    out->values = values;
+
+    return 0;
+}
+
+// Checks the message in buf and fills in a view of it
+int rf_report_decode_msg(const uint8_t *buf, unsigned int buf_len,
+                         struct rf_report_view *out)
+{
+    if (buf_len < 1)
+        return RF_REPORT_ERR_TOO_SHORT;
+
+    switch (buf[0] >> 4) {
+    case RF_PROTOCOL_V1:
+        return decode_v1(buf, buf_len, out);
+    case RF_PROTOCOL_V2:
+        return decode_v2(buf, buf_len, out);
+    default:
+        return RF_REPORT_ERR_VERSION;
     }
+}
 
-    crc = cs_crc32(0, buf, p - buf);
-    printf("decode: calculating crc for bytes: ");
-    for (i = 0; i < p - buf; i++)
-        printf("%02x ", buf[i]);
-    printf("\n");
-    msg_crc = read_uint32(&p);
-    if (crc != msg_crc) {
-        LOG(LL_ERROR, ("CRC32 check failed (expected 0x%08x, got 0x%08x)", crc, msg_crc));
-        free(rep);
-        return -1;
+// Observations of v2 messages are returned as floats
+void rf_report_get_observation(const struct rf_report_view *report, int idx,
+                               struct rf_sensor_observation *out)
+{
+    const uint8_t *p;
+    uint32_t val = 0;
+    int phenomenon;
+
+    out->padding = 0;
+    if (report->proto_ver == RF_PROTOCOL_V1) {
+        p = report->buf + RF_REPORT_HEADER_LEN + idx * RF_REPORT_OBSERVATION_LEN;
+        out->phenomenon = *p++;
+        out->value_type = *p++ >> 4;
+        out->value.int_val = (int32_t) read_uint32(&p);
+        return;
     }
-    rep->crc = crc;
 
-    *out = rep;
+    // The message has been checked, so the varints are all there
+    p = report->values;
+    for (phenomenon = 0; phenomenon <= RF_PHENOMENON_MAX; phenomenon++) {
+        if (!(report->phenomena & (1 << phenomenon)))
+            continue;
+        read_varint(&p, p + 5, &val);
+        if (!idx--)
+            break;
+    }
+    out->phenomenon = phenomenon;
+    out->value_type = RF_VALUE_FLOAT;
+    out->value.float_val = from_fixed(phenomenon, zigzag_decode(val));
+}
 
-    return 0;       
+const char *rf_report_strerror(int err)
+{
+    switch (err) {
+    case RF_REPORT_ERR_NO_SPACE:
+        return "message does not fit";
+    case RF_REPORT_ERR_TOO_SHORT:
+        return "message too short";
+    case RF_REPORT_ERR_VERSION:
+        return "unsupported protocol version";
+    case RF_REPORT_ERR_CRC:
+        return "CRC check failed";
+    case RF_REPORT_ERR_INVALID:
+        return "invalid observation";
+    default:
+        return "unknown error";
+    }
 }
 
 
 
 void rfreport_test(void)
 {
-    struct rf_sensor_observation obs[2];
-    struct rf_sensor_report *out;
-    int i;
-    uint8_t *buf;
-    unsigned int buf_len;
+    struct rf_sensor_observation obs[2], out_obs;
+    struct rf_report_view out;
+    uint8_t buf[RF_REPORT_V2_MAX_LEN];
+    int i, len;
 
     obs[0].phenomenon = RF_PHENOMENON_TEMPERATURE;
     obs[0].value_type = RF_VALUE_FLOAT;
@@ -154,17 +380,17 @@ void rfreport_test(void)
     obs[1].value_type = RF_VALUE_FLOAT;
     obs[1].value.float_val = 78.9231;
 
-    buf_len = 0;
-    rf_report_encode_msg(0x1234, 2, obs, &buf, &buf_len);
+    len = rf_report_encode_msg(0x1234, 2, obs, buf, sizeof(buf));
 
-    for (i = 0; i < (int) buf_len; i++) {
+    for (i = 0; i < len; i++) {
         printf("%02x ", buf[i]);
     }
     printf("\n");
 
-    if (rf_report_decode_msg(buf, buf_len, &out) < 0)
+    if (rf_report_decode_msg(buf, len, &out) < 0)
         return;
-    printf("temp %f, hum %f\n", out->observations[0].value.float_val, out->observations[1].value.float_val);
-    free(out);
-    free(buf);
+    for (i = 0; i < out.n_observations; i++) {
+        rf_report_get_observation(&out, i, &out_obs);
+        printf("phenomenon %d: %f\n", out_obs.phenomenon, out_obs.value.float_val);
+    }
 }
@@ -1,15 +1,38 @@
 /*
- Protocol:
- 
+ Protocol v1:
+
  - Protocol version: 4 bits
  - Number of observations: 4 bits
- - Sensor ID: 32 bits
+ - Padding: 8 bits
+ - Sensor ID: 16 bits
  - Observations
    - Phenomenon type: 8 bits
    - Value type: 4 bits
-   - Padding: 28 bits
+   - Padding: 4 bits
    - Value: 32 bits
  - CRC32: 32 bits
+
+ Protocol v2:
+
+ - Protocol version: 4 bits
+ - Reserved: 4 bits
+ - Sensor ID: 16 bits
+ - Phenomena present: varint, bit N set for phenomenon N
+ - Values: one zigzag varint per phenomenon present, in phenomenon order
+ - CRC-16/CCITT: 16 bits
+
+ Varints hold 7 bits per byte, least significant group first, with the top
+ bit set on all but the last byte. v2 values are fixed point: every
+ phenomenon has its own resolution and zero point (see rfreport.c), so
+ typical readings take one or two bytes. A node with temperature,
+ humidity, pressure, soil moisture and battery voltage sends 16 bytes,
+ which leaves room for the RadioHead header in a 32-byte nRF24 payload.
+
+ All fixed size fields are big endian. Messages are encoded into and
+ decoded from the caller's buffers: decoding only checks the message and
+ returns a view that reads the observations straight from the received
+ bytes, so neither direction touches the heap. Both versions are decoded;
+ new messages are encoded as v2.
  */
 
 #ifndef __RFREPORT_H
@@ -20,12 +43,41 @@
 #define RF_PHENOMENON_TEMPERATURE       0
 #define RF_PHENOMENON_HUMIDITY          1
 #define RF_PHENOMENON_LUMINOSITY        2
+#define RF_PHENOMENON_PRESSURE          3
+#define RF_PHENOMENON_SOIL_MOISTURE     4
+#define RF_PHENOMENON_BATTERY_VOLTAGE   5
+#define RF_PHENOMENON_CO2_LEVEL         6
+#define RF_PHENOMENON_DISTANCE          7
+#define RF_PHENOMENON_AWAKE_TIME        8   // Of the previous cycle of a low-power node
 
-#define RF_PHENOMENON_MAX               2
+#define RF_PHENOMENON_MAX               8
 
 #define RF_VALUE_FLOAT                  0
 
 #define RF_PROTOCOL_V1                  1
+#define RF_PROTOCOL_V2                  2
+
+#define RF_REPORT_HEADER_LEN            4
+#define RF_REPORT_OBSERVATION_LEN       6
+#define RF_REPORT_CRC_LEN               4
+#define RF_REPORT_MAX_OBSERVATIONS      15
+#define RF_REPORT_LEN(n_observations)   (RF_REPORT_HEADER_LEN + \
+                                         (n_observations) * RF_REPORT_OBSERVATION_LEN + \
+                                         RF_REPORT_CRC_LEN)
+
+#define RF_REPORT_V2_CRC_LEN            2
+#define RF_REPORT_V2_MAX_LEN            (3 + 5 + (RF_PHENOMENON_MAX + 1) * 5 + RF_REPORT_V2_CRC_LEN)
+
+// Error codes
+#define RF_REPORT_ERR_NO_SPACE          -1  // Output buffer too small
+#define RF_REPORT_ERR_TOO_SHORT         -2
+#define RF_REPORT_ERR_VERSION           -3
+#define RF_REPORT_ERR_CRC               -4
+#define RF_REPORT_ERR_INVALID           -5  // Unknown or repeated phenomenon, bad value type or value
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 struct rf_sensor_observation {
     uint8_t phenomenon;
@@ -36,21 +88,34 @@ struct rf_sensor_observation {
     } value;
 } __attribute__((packed));
 
-struct rf_sensor_report {
-    int proto_ver:4;
-    int n_observations:4;
-    int padding:8;
+// A checked message. Only valid as long as the buffer it was decoded from.
+struct rf_report_view {
+    const uint8_t *buf;
+    uint8_t proto_ver;
+    uint8_t n_observations;
     uint16_t sensor_id;
-    uint32_t crc;
-    struct rf_sensor_observation observations[];
-} __attribute__((packed));
 
+    // v2 only
+    uint32_t phenomena;
+    const uint8_t *values;
+};
 
-void rf_report_encode_msg(uint16_t sensor_id, unsigned int n_observations,
-                          const struct rf_sensor_observation *observations,
-                          uint8_t **buf_out, unsigned int *buf_len);
+int rf_report_encode_msg(uint16_t sensor_id, unsigned int n_observations,
+                         const struct rf_sensor_observation *observations,
+                         uint8_t *buf, unsigned int buf_size);
+int rf_report_encode_msg_v1(uint16_t sensor_id, unsigned int n_observations,
+                            const struct rf_sensor_observation *observations,
+                            uint8_t *buf, unsigned int buf_size);
 
 int rf_report_decode_msg(const uint8_t *buf, unsigned int buf_len,
-                         struct rf_sensor_report **out);
+                         struct rf_report_view *out);
+void rf_report_get_observation(const struct rf_report_view *report, int idx,
+                               struct rf_sensor_observation *out);
+
+const char *rf_report_strerror(int err);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
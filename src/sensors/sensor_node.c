@@ -0,0 +1,193 @@
+#include "mgos.h"
+#include "radiohead.h"
+#include "rfreport.h"
+#include "sensors.h"
+#include "sensor_node.h"
+
+// RTC user memory survives deep sleep. rboot keeps its data at block 64.
+#define NODE_RTC_BLOCK          128
+#define NODE_RTC_MAGIC          0x52464e44
+// Shortest deep sleep, when a cycle took longer than the interval
+#define NODE_MIN_SLEEP_MS       1000
+
+struct node_rtc {
+    uint32_t magic;
+    uint32_t n_cycles;
+    uint32_t n_failed;          // Reports not acknowledged
+    uint32_t awake_ms;          // Of the previous cycle, 0 if unknown
+};
+
+static struct {
+    bool measuring;             // Inside sensors_measure_all()
+    bool sent;                  // The report has been handed to the radio
+    bool done;                  // Acknowledged or failed
+    bool sleeping;
+    int n_expected;             // Sensors that said they will report
+    int n_reported;
+    int32_t sensor_id;
+    unsigned int n_obs;
+    struct rf_sensor_observation obs[RF_PHENOMENON_MAX + 1];
+    mgos_timer_id measure_timer;
+    struct node_rtc rtc;
+} node;
+
+// The property names of sensors_report(), see sensors_handle_rf_report()
+static const struct {
+    const char *property_name;
+    uint8_t phenomenon;
+} phenomena[] = {
+    { "temperature",        RF_PHENOMENON_TEMPERATURE },
+    { "humidity",           RF_PHENOMENON_HUMIDITY },
+    { "luminosity",         RF_PHENOMENON_LUMINOSITY },
+    { "pressure",           RF_PHENOMENON_PRESSURE },
+    { "soil_moisture",      RF_PHENOMENON_SOIL_MOISTURE },
+    { "battery_voltage",    RF_PHENOMENON_BATTERY_VOLTAGE },
+    { "co2_level",          RF_PHENOMENON_CO2_LEVEL },
+    { "distance",           RF_PHENOMENON_DISTANCE },
+};
+
+static void node_add(int phenomenon, float val)
+{
+    unsigned int i;
+
+    // A report has one value per phenomenon: the first sensor wins
+    for (i = 0; i < node.n_obs; i++) {
+        if (node.obs[i].phenomenon == phenomenon)
+            return;
+    }
+    if (node.n_obs > RF_PHENOMENON_MAX)
+        return;
+    node.obs[node.n_obs].phenomenon = phenomenon;
+    node.obs[node.n_obs].value_type = RF_VALUE_FLOAT;
+    node.obs[node.n_obs].value.float_val = val;
+    node.n_obs++;
+}
+
+static void node_sleep(void *arg)
+{
+    uint32_t awake_ms = mgos_uptime() * 1000;
+    uint32_t interval_ms = mgos_sys_config_get_radiohead_node_interval() * 1000;
+    uint32_t sleep_ms;
+
+    if (node.sleeping)
+        return;
+    node.sleeping = true;
+
+    if (node.sent && !node.done)
+        node.rtc.n_failed++;    // No ACK by radiohead.node.max_awake_ms
+    node.rtc.n_cycles++;
+    node.rtc.awake_ms = awake_ms;
+    system_rtc_mem_write(NODE_RTC_BLOCK, &node.rtc, sizeof(node.rtc));
+
+    // Wake at a fixed interval, however long this cycle took
+    if (interval_ms > awake_ms + NODE_MIN_SLEEP_MS)
+        sleep_ms = interval_ms - awake_ms;
+    else
+        sleep_ms = NODE_MIN_SLEEP_MS;
+    LOG(LL_INFO, ("Node cycle %u awake %u ms (%u reports failed), sleeping %u ms",
+                  node.rtc.n_cycles, awake_ms, node.rtc.n_failed, sleep_ms));
+
+    radiohead_sleep();
+    sensors_power_off();
+    system_deep_sleep((uint64_t) sleep_ms * 1000);
+    (void) arg;
+}
+
+static void node_send(void *arg)
+{
+    uint8_t buf[RF_REPORT_V2_MAX_LEN];
+    int len;
+
+    if (node.sent)
+        return;
+    node.sent = true;
+    if (node.measure_timer != MGOS_INVALID_TIMER_ID)
+        mgos_clear_timer(node.measure_timer);
+    node.measure_timer = MGOS_INVALID_TIMER_ID;
+
+    if (node.n_reported < node.n_expected)
+        LOG(LL_WARN, ("%d of %d sensors did not report", node.n_expected - node.n_reported,
+                      node.n_expected));
+    if (node.rtc.awake_ms)
+        node_add(RF_PHENOMENON_AWAKE_TIME, node.rtc.awake_ms / 1000.0);
+    if (node.sensor_id < 0) {
+        LOG(LL_ERROR, ("No sensor ID for the report, set radiohead.node.sensor_id"));
+        node_sleep(NULL);
+        return;
+    }
+
+    len = rf_report_encode_msg(node.sensor_id, node.n_obs, node.obs, buf, sizeof(buf));
+    if (len < 0 || radiohead_send_sensor_report(buf, len) < 0) {
+        LOG(LL_ERROR, ("Unable to send the report of %d values", node.n_obs));
+        node.done = true;
+        node.rtc.n_failed++;
+        node_sleep(NULL);
+    }
+    (void) arg;
+}
+
+static void node_report(struct sensor *sensor, const struct sensor_measurement *values,
+                        int n_values, void *arg)
+{
+    unsigned int i;
+
+    for (; n_values > 0; n_values--, values++) {
+        for (i = 0; i < sizeof(phenomena) / sizeof(phenomena[0]); i++) {
+            if (strcmp(values->property_name, phenomena[i].property_name) == 0) {
+                node_add(phenomena[i].phenomenon, values->float_val);
+                break;
+            }
+        }
+    }
+    if (node.sensor_id < 0)
+        node.sensor_id = sensor->rh_sensor_id;
+    node.n_reported++;
+    if (!node.measuring && node.n_reported >= node.n_expected)
+        node_send(NULL);
+    (void) arg;
+}
+
+static void node_sent(bool acked, uint8_t retries, void *arg)
+{
+    node.done = true;
+    if (!acked)
+        node.rtc.n_failed++;
+    // Called from within the radio, so power it down from the loop
+    if (!mgos_invoke_cb(node_sleep, NULL, false))
+        node_sleep(NULL);
+    (void) retries;
+    (void) arg;
+}
+
+void sensor_node_init(void)
+{
+    if (!mgos_sys_config_get_radiohead_node_enable())
+        return;
+
+    if (!system_rtc_mem_read(NODE_RTC_BLOCK, &node.rtc, sizeof(node.rtc)) ||
+        node.rtc.magic != NODE_RTC_MAGIC) {
+        // Power on, not a wake from deep sleep
+        memset(&node.rtc, 0, sizeof(node.rtc));
+        node.rtc.magic = NODE_RTC_MAGIC;
+    }
+    node.sensor_id = mgos_sys_config_get_radiohead_node_sensor_id();
+    node.measure_timer = MGOS_INVALID_TIMER_ID;
+
+    // Whatever happens, do not drain the battery
+    mgos_set_timer(mgos_sys_config_get_radiohead_node_max_awake_ms(), 0, node_sleep, NULL);
+    if (!radiohead_is_initialized()) {
+        LOG(LL_ERROR, ("Sensor node needs RadioHead"));
+        return;
+    }
+
+    sensors_set_report_handler(node_report, NULL);
+    radiohead_set_sent_handler(node_sent, NULL);
+    node.measuring = true;
+    node.n_expected = sensors_measure_all();
+    node.measuring = false;
+    if (node.n_reported >= node.n_expected)
+        node_send(NULL);
+    else
+        node.measure_timer = mgos_set_timer(mgos_sys_config_get_radiohead_node_measure_timeout_ms(),
+                                            0, node_send, NULL);
+}
@@ -0,0 +1,32 @@
+/*
+ Low-power RF sensor node
+
+ With radiohead.node.enable, the device is a battery-powered probe that
+ spends its life in deep sleep. On every wake (a reset on the ESP8266)
+ it measures all its sensors at once, packs the readings into a single
+ RF report and sends it to radiohead.sensor_report_address. Once the
+ report has been acknowledged, or has failed, the radio and the sensors
+ are powered down and the device deep-sleeps until the next wake,
+ radiohead.node.interval seconds after this one.
+
+ Time awake sets the battery life, so it is measured on every cycle,
+ kept in RTC memory over the deep sleep and sent as the awake_time
+ phenomenon of the next report. It counts from the start of Mongoose OS,
+ not from the reset: the boot loader and the SDK startup come on top.
+ */
+
+#ifndef __SENSOR_NODE_H
+#define __SENSOR_NODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Starts the first cycle, if radiohead.node.enable is set
+void sensor_node_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,8 @@
 static struct sensor *sensors = NULL;
 static bool time_is_set = false;
 static bool mqtt_connected = false;
+static sensors_report_cb report_cb = NULL;
+static void *report_cb_arg;
 
 static struct sensor *get_sensor(int idx)
 {
@@ -176,7 +178,59 @@ void sensors_report(struct sensor *sensor, const struct sensor_measurement *valu
         LOG(LL_INFO, (fmt, val->property_name, val->float_val, val->unit));
     }
 
-    report_measurements(sensor, values, n_values, measurement_time);
+    if (report_cb != NULL)
+        report_cb(sensor, values, n_values, report_cb_arg);
+    else
+        report_measurements(sensor, values, n_values, measurement_time);
+}
+
+void sensors_set_report_handler(sensors_report_cb cb, void *arg)
+{
+    report_cb = cb;
+    report_cb_arg = arg;
+}
+
+int sensors_measure_all(void)
+{
+    struct sensor *sensor;
+    int n_reporting = 0, ms;
+
+    // Slow conversions run side by side, and are collected by timers
+    for (sensor = sensors; sensor != NULL; sensor = sensor->next) {
+        if (!sensor->enabled || sensor->start == NULL)
+            continue;
+        ms = sensor->start(sensor);
+        if (ms < 0)
+            continue;
+        mgos_set_timer(ms, 0, poll_sensor, sensor);
+        n_reporting++;
+    }
+    for (sensor = sensors; sensor != NULL; sensor = sensor->next) {
+        struct sensor_measurement values[10];
+        int n_values;
+
+        if (!sensor->enabled || sensor->start != NULL)
+            continue;
+        memset(values, 0, sizeof(values));
+        n_values = sensor->poll(sensor, values);
+        // 0: the sensor reports later by itself
+        if (n_values < 0)
+            continue;
+        n_reporting++;
+        if (n_values > 0)
+            sensors_report(sensor, values, n_values);
+    }
+    return n_reporting;
+}
+
+void sensors_power_off(void)
+{
+    struct sensor *sensor;
+
+    for (sensor = sensors; sensor != NULL; sensor = sensor->next) {
+        if (sensor->power_gpio >= 0)
+            mgos_gpio_write(sensor->power_gpio, 0);
+    }
 }
 
 static void init_sensor(struct sensor *sensor)
@@ -213,6 +267,7 @@ static void init_sensor(struct sensor *sensor)
         if (ds18b20_init(sensor) < 0)
             return;
         sensor->poll = ds18b20_poll;
+        sensor->start = ds18b20_start;
     } else if (strcmp(sensor->type, "gpio_ultrasound") == 0) {
         if (gpio_ultrasound_init(sensor) < 0)
             return;
@@ -226,7 +281,9 @@ static void init_sensor(struct sensor *sensor)
         return;
     }
     sensor->enabled = 1;
-    sensor->timer_id = mgos_set_timer(sensor->poll_delay, MGOS_TIMER_REPEAT, poll_sensor, sensor);
+    // A low-power node measures all sensors once per wake instead
+    if (!mgos_sys_config_get_radiohead_node_enable())
+        sensor->timer_id = mgos_set_timer(sensor->poll_delay, MGOS_TIMER_REPEAT, poll_sensor, sensor);
 }
 
 static void time_change_cb(int ev, void *evd, void *arg)
@@ -275,18 +332,18 @@ void sensors_init(void)
     mgos_event_add_handler(MGOS_EVENT_TIME_CHANGED, time_change_cb, NULL);
 }
 
-void sensors_handle_rf_report(const struct rf_sensor_report *report)
+void sensors_handle_rf_report(const struct rf_report_view *report)
 {
     struct sensor *sensor;
-    struct sensor_measurement vals[5];
+    struct sensor_measurement vals[RF_PHENOMENON_MAX + 1];
     double measurement_time;
-    int i, c;
+    int i, c, n_vals;
 
     for (sensor = sensors; sensor != NULL; sensor = sensor->next) {
         if (sensor->rh_sensor_id == report->sensor_id)
             break;
     }
-    if (sensor != NULL) {
+    if (sensor == NULL) {
         LOG(LL_WARN, ("RH sensor id 0x%04x not registered", report->sensor_id));
         return;
     }
@@ -296,12 +353,14 @@ void sensors_handle_rf_report(const struct rf_sensor_report *report)
                        report->sensor_id, c));
         c = sizeof(vals) / sizeof(vals[0]);
     }
+    n_vals = 0;
     for (i = 0; i < c; i++) {
-        const struct rf_sensor_observation *obs = report->observations + i;
+        struct rf_sensor_observation obs;
         const char *property_name = NULL;
         const char *unit = NULL;
 
-        switch (obs->phenomenon) {
+        rf_report_get_observation(report, i, &obs);
+        switch (obs.phenomenon) {
         case RF_PHENOMENON_TEMPERATURE:
             property_name = "temperature";
             unit = "C";
@@ -310,25 +369,54 @@ void sensors_handle_rf_report(const struct rf_sensor_report *report)
             property_name = "humidity";
             unit = "%";
             break;
+        case RF_PHENOMENON_LUMINOSITY:
+            property_name = "luminosity";
+            unit = "lx";
+            break;
+        case RF_PHENOMENON_PRESSURE:
+            property_name = "pressure";
+            unit = "hPa";
+            break;
+        case RF_PHENOMENON_SOIL_MOISTURE:
+            property_name = "soil_moisture";
+            unit = "%";
+            break;
+        case RF_PHENOMENON_BATTERY_VOLTAGE:
+            property_name = "battery_voltage";
+            unit = "V";
+            break;
+        case RF_PHENOMENON_CO2_LEVEL:
+            property_name = "co2_level";
+            unit = "ppm";
+            break;
+        case RF_PHENOMENON_DISTANCE:
+            property_name = "distance";
+            unit = "m";
+            break;
+        case RF_PHENOMENON_AWAKE_TIME:
+            property_name = "awake_time";
+            unit = "s";
+            break;
         default:
             LOG(LL_ERROR, ("Unable to handle phenomenon %d from sensor 0x%04x",
-                           obs->phenomenon, report->sensor_id));
+                           obs.phenomenon, report->sensor_id));
             break;
         }
         if (property_name == NULL)
             continue;
-        vals[i].property_name = property_name;
-        vals[i].unit = unit;
-        vals[i].type = SENSOR_FLOAT;
-        vals[i].float_val = obs->value.float_val;
+        vals[n_vals].property_name = property_name;
+        vals[n_vals].unit = unit;
+        vals[n_vals].type = SENSOR_FLOAT;
+        vals[n_vals].float_val = obs.value.float_val;
+        n_vals++;
     }
 
-    if (time_is_set && c)
+    if (time_is_set && n_vals)
         measurement_time = cs_time();
     else
         measurement_time = 0;
 
-    report_measurements(sensor, vals, c, measurement_time);    
+    report_measurements(sensor, vals, n_vals, measurement_time);    
 }
 
 
@@ -337,7 +425,7 @@ void sensors_shutdown(void)
     struct sensor *sensor;
 
     for (sensor = sensors; sensor != NULL; sensor = sensor->next) {
-        if (sensor->enabled)
+        if (sensor->enabled && sensor->timer_id)
             mgos_clear_timer(sensor->timer_id);
     }
 }
@@ -38,15 +38,27 @@ struct sensor {
     unsigned int timer_id;
     void *driver_data;
     int (*poll)(struct sensor *, struct sensor_measurement *);
+    // Optional: starts a slow measurement that poll() collects. Returns
+    // the milliseconds until poll() can be called, or < 0 on error.
+    int (*start)(struct sensor *);
     int (*shutdown)(struct sensor *);
 
     struct sensor *next;
 };
 
+typedef void (*sensors_report_cb)(struct sensor *sensor, const struct sensor_measurement *values,
+                                  int n_values, void *arg);
+
 void sensors_init(void);
 void sensors_report(struct sensor *sensor, const struct sensor_measurement *values, int n_values);
-void sensors_handle_rf_report(const struct rf_sensor_report *report);
+void sensors_handle_rf_report(const struct rf_report_view *report);
 void sensors_shutdown(void);
+// Measurements go to cb instead of MQTT
+void sensors_set_report_handler(sensors_report_cb cb, void *arg);
+// Measures every sensor once, starting the slow ones together. Returns
+// how many sensors will report, some of them maybe before this returns.
+int sensors_measure_all(void);
+void sensors_power_off(void);
 
 int bme280_init(struct sensor *sensor);
 int bme280_poll(struct sensor *sensor, struct sensor_measurement *out);
@@ -54,6 +66,7 @@ int dht_init(struct sensor *sensor);
 int dht_poll(struct sensor *sensor, struct sensor_measurement *out);
 int ds18b20_init(struct sensor *sensor);
 int ds18b20_poll(struct sensor *sensor, struct sensor_measurement *out);
+int ds18b20_start(struct sensor *sensor);
 int mh_z19_init(struct sensor *sensor);
 int mh_z19_poll(struct sensor *sensor, struct sensor_measurement *out);
 int gpio_ultrasound_init(struct sensor *sensor);
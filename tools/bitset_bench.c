@@ -0,0 +1,232 @@
+/*
+ Host micro-benchmarks of src/bitset/bitset.h against the byte-array
+ bitset it replaced, on the operations the 433 MHz decoders do. Every
+ benchmark also checks that both give the same result.
+
+ Build and run (from the repository root):
+
+   gcc -O2 -Isrc tools/bitset_bench.c -o bitset_bench && ./bitset_bench
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "bitset/bitset.h"
+
+#define ROUNDS  2000000
+
+// The previous implementation: bytes, one bit at a time
+struct old_bitset {
+    uint16_t max_bits;
+    uint16_t n_bits;
+    uint8_t data[];
+};
+
+static inline void old_bitset_append(struct old_bitset *bitset, bool value)
+{
+    int idx = bitset->n_bits;
+
+    if (value)
+        bitset->data[idx >> 3] |= 1 << (idx & 0x07);
+    else
+        bitset->data[idx >> 3] &= ~(1 << (idx & 0x07));
+    bitset->n_bits = idx + 1;
+}
+
+static inline struct old_bitset *old_bitset_init(void *buf, size_t buf_len)
+{
+    struct old_bitset *bitset = (struct old_bitset *) buf;
+
+    buf_len -= sizeof(struct old_bitset);
+    bitset->n_bits = 0;
+    bitset->max_bits = buf_len << 3;
+    memset(bitset->data, 0, buf_len);
+    return bitset;
+}
+
+static inline bool old_bitset_get(const struct old_bitset *bitset, int idx)
+{
+    return bitset->data[idx >> 3] & (1 << (idx & 0x07)) ? true : false;
+}
+
+static uint32_t sink;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double old_time, double new_time)
+{
+    printf("%-28s %7.1f ns  %7.1f ns  %5.1fx\n", name,
+           old_time * 1e9 / ROUNDS, new_time * 1e9 / ROUNDS, old_time / new_time);
+}
+
+// A 64-bit Manchester coded Nexa frame
+static const uint32_t frame[2] = { 0x9a6a5969, 0x6996a5a9 };
+
+static void bench_append(void)
+{
+    uint8_t old_buf[40] __attribute__((aligned(4)));
+    uint8_t new_buf[BITSET_BUF_SIZE(128)] __attribute__((aligned(4)));
+    struct old_bitset *o;
+    struct bitset *n;
+    double start, old_time, new_time;
+    int r, i;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        o = old_bitset_init(old_buf, sizeof(old_buf));
+        for (i = 0; i < 64; i++)
+            old_bitset_append(o, (frame[i / 32] >> (i % 32)) & 1);
+        sink += o->data[r & 7];
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        n = bitset_init(new_buf, sizeof(new_buf));
+        bitset_append_bits(n, frame[0], 32);
+        bitset_append_bits(n, frame[1], 32);
+        sink += n->data[r & 1];
+    }
+    new_time = now() - start;
+
+    for (i = 0; i < 64; i++)
+        assert(old_bitset_get(o, i) == bitset_get(n, i));
+    report("append 64 bits", old_time, new_time);
+}
+
+static void bench_manchester(void)
+{
+    uint8_t old_buf[40] __attribute__((aligned(4))), out_buf[40];
+    uint8_t new_buf[BITSET_BUF_SIZE(128)] __attribute__((aligned(4)));
+    struct old_bitset *o, *out;
+    struct bitset *n;
+    double start, old_time, new_time;
+    int r, i;
+
+    o = old_bitset_init(old_buf, sizeof(old_buf));
+    for (i = 0; i < 64; i++)
+        old_bitset_append(o, (frame[i / 32] >> (i % 32)) & 1);
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        out = old_bitset_init(out_buf, sizeof(out_buf));
+        for (i = 0; i < o->n_bits / 2; i++) {
+            bool bit = old_bitset_get(o, i * 2);
+
+            if (old_bitset_get(o, i * 2 + 1) != !bit)
+                break;
+            old_bitset_append(out, bit);
+        }
+        sink += out->data[r & 3];
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        n = bitset_init(new_buf, sizeof(new_buf));
+        bitset_append_bits(n, frame[0], 32);
+        bitset_append_bits(n, frame[1], 32);
+        if (bitset_manchester_decode(n, n) < 0)
+            break;
+        sink += n->data[0];
+    }
+    new_time = now() - start;
+
+    assert(out->n_bits == 32 && n->n_bits == 32);
+    for (i = 0; i < 32; i++)
+        assert(old_bitset_get(out, i) == bitset_get(n, i));
+    report("manchester decode 64 bits", old_time, new_time);
+}
+
+static void bench_field(void)
+{
+    uint8_t old_buf[40] __attribute__((aligned(4)));
+    uint8_t new_buf[BITSET_BUF_SIZE(128)] __attribute__((aligned(4)));
+    struct old_bitset *o;
+    struct bitset *n;
+    double start, old_time, new_time;
+    uint32_t old_id = 0, new_id = 0;
+    int r, i;
+
+    o = old_bitset_init(old_buf, sizeof(old_buf));
+    n = bitset_init(new_buf, sizeof(new_buf));
+    for (i = 0; i < 64; i++)
+        old_bitset_append(o, (frame[i / 32] >> (i % 32)) & 1);
+    bitset_append_bits(n, frame[0], 32);
+    bitset_append_bits(n, frame[1], 32);
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        old_id = 0;
+        for (i = 0; i < 26; i++)
+            old_id |= old_bitset_get(o, i + (r & 31)) ? (1 << i) : 0;
+        sink += old_id;
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        new_id = bitset_get_bits(n, r & 31, 26);
+        sink += new_id;
+    }
+    new_time = now() - start;
+
+    assert(old_id == new_id);
+    report("extract 26-bit field", old_time, new_time);
+}
+
+static void bench_distance(void)
+{
+    uint8_t old_buf[2][40] __attribute__((aligned(4)));
+    uint8_t new_buf[2][BITSET_BUF_SIZE(128)] __attribute__((aligned(4)));
+    struct old_bitset *o[2];
+    struct bitset *n[2];
+    double start, old_time, new_time;
+    int r, i, old_dist = 0, new_dist = 0;
+
+    for (int k = 0; k < 2; k++) {
+        o[k] = old_bitset_init(old_buf[k], sizeof(old_buf[k]));
+        n[k] = bitset_init(new_buf[k], sizeof(new_buf[k]));
+        for (i = 0; i < 128; i++) {
+            bool bit = ((frame[(i / 32) & 1] >> (i % 32)) & 1) ^ (k && i % 41 == 0);
+
+            old_bitset_append(o[k], bit);
+            bitset_append(n[k], bit);
+        }
+    }
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        old_dist = 0;
+        for (i = 0; i < o[0]->n_bits; i++)
+            old_dist += old_bitset_get(o[0], i) != old_bitset_get(o[1], i);
+        sink += old_dist;
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        new_dist = bitset_distance(n[0], n[1]);
+        sink += new_dist;
+    }
+    new_time = now() - start;
+
+    assert(old_dist == new_dist && new_dist == 4);
+    report("distance of 128-bit codes", old_time, new_time);
+}
+
+int main(void)
+{
+    printf("%-28s %10s  %10s  %6s\n", "", "bytes", "words", "");
+    bench_append();
+    bench_manchester();
+    bench_field();
+    bench_distance();
+    return sink == 0xdeadbeef;
+}
@@ -0,0 +1,324 @@
+/*
+ Replays 433 MHz pulse captures through the rcsw decoder on the host and
+ reports decoder throughput and decode statistics.
+
+ Build (from the repository root):
+
+   gcc -O2 -Isrc -c tools/rf433_replay.c src/rcsw/decoder.c src/rcsw/learner.c \
+       src/rcsw/dedup.c
+   g++ -O2 -Isrc src/rcsw/protocols.cpp rf433_replay.o decoder.o learner.o \
+       dedup.o -o rf433_replay
+
+ Usage:
+
+   rf433_replay [-n rounds] [-l] [-d window_ms] [-e proto:code]... capture.bin...
+
+ Captures are recorded on the device with rcsw.capture.file or
+ rcsw.capture.mqtt_topic (see src/rcsw/capture.h for the format). Codes
+ given with -e are the ones that were really transmitted while capturing
+ (as printed in the "codes" list, without spaces); every other decoded
+ frame is counted as a false positive. With -l, bursts that no protocol
+ matched are run through the protocol learner like on the device. With
+ -d, frames are also run through the repeat suppression, using the pulse
+ lengths as the clock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rcsw/decoder.h"
+#include "rcsw/capture.h"
+#include "rcsw/learner.h"
+#include "rcsw/dedup.h"
+
+#define MAX_EXPECTED    32
+#define MAX_CODES       256
+
+// Same as in rcsw.c
+#define MAX_BURST_PULSES    180
+#define MIN_PULSES          14
+
+struct code_stat {
+    const struct rf433_protocol *proto;
+    char code[RF433_MAX_CODE_BITS + 1];
+    unsigned int count;
+};
+
+struct replay_stats {
+    unsigned int frames;
+    unsigned int events;
+    unsigned int proto_frames[RF433_MAX_PROTOCOLS];
+    unsigned int false_positives;
+
+    int n_codes;
+    struct code_stat codes[MAX_CODES];
+};
+
+static const char *expected[MAX_EXPECTED];
+static int n_expected;
+
+static void code_to_str(char *out, const struct bitset *code)
+{
+    for (int i = 0; i < code->n_bits; i++)
+        *out++ = bitset_get(code, i) ? '1' : '0';
+    *out = '\0';
+}
+
+static bool is_expected(const struct rf433_protocol *proto, const char *code)
+{
+    int name_len = strlen(proto->name);
+
+    for (int i = 0; i < n_expected; i++) {
+        const char *e = expected[i];
+
+        if (strncmp(e, proto->name, name_len) == 0 && e[name_len] == ':' &&
+            strcmp(e + name_len + 1, code) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void frame_found(const struct rf433_frame *frame, void *arg)
+{
+    struct replay_stats *stats = (struct replay_stats *) arg;
+    char code[RF433_MAX_CODE_BITS + 1];
+    int i;
+
+    stats->frames++;
+    stats->proto_frames[frame->proto - rf433_protocols]++;
+
+    code_to_str(code, frame->code);
+    if (n_expected && !is_expected(frame->proto, code))
+        stats->false_positives++;
+
+    for (i = 0; i < stats->n_codes; i++) {
+        struct code_stat *cs = stats->codes + i;
+
+        if (cs->proto == frame->proto && strcmp(cs->code, code) == 0) {
+            cs->count++;
+            return;
+        }
+    }
+    if (stats->n_codes < MAX_CODES) {
+        struct code_stat *cs = stats->codes + stats->n_codes++;
+
+        cs->proto = frame->proto;
+        strcpy(cs->code, code);
+        cs->count = 1;
+    }
+}
+
+struct dedup_ctx {
+    struct rf433_dedup dedup;
+    uint32_t now_ms;
+};
+
+static void event_found(const struct rf433_frame *frame, int repeats, void *arg)
+{
+    struct replay_stats *stats = (struct replay_stats *) arg;
+
+    stats->events++;
+    (void) frame;
+    (void) repeats;
+}
+
+static void dedup_frame_found(const struct rf433_frame *frame, void *arg)
+{
+    struct dedup_ctx *ctx = (struct dedup_ctx *) arg;
+
+    rf433_dedup_add(&ctx->dedup, frame, ctx->now_ms);
+}
+
+// Runs the frames through the repeat suppression, with the sum of the
+// pulse lengths as the time they were received at
+static void dedup(struct dedup_ctx *ctx, const struct timing *pulses, int n_pulses)
+{
+    struct rf433_decoder dec;
+    uint64_t now_us = 0;
+
+    rf433_decoder_init(&dec, dedup_frame_found, ctx);
+    for (int i = 0; i < n_pulses; i++) {
+        now_us += pulses[i].time_us;
+        ctx->now_ms = now_us / 1000;
+        rf433_dedup_expire(&ctx->dedup, ctx->now_ms);
+        rf433_decoder_feed(&dec, pulses + i, 1);
+    }
+    rf433_dedup_flush(&ctx->dedup);
+}
+
+static struct timing *read_capture(const char *path, int *n_out)
+{
+    uint8_t *buf;
+    struct timing *pulses;
+    long len;
+    int hdr_len, n;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(len);
+    if (fread(buf, 1, len, fp) != (size_t) len) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(fp);
+        free(buf);
+        return NULL;
+    }
+    fclose(fp);
+
+    hdr_len = rf433_capture_check_header(buf, len);
+    if (hdr_len < 0) {
+        fprintf(stderr, "%s: unsupported capture format version %d\n", path, buf[5]);
+        free(buf);
+        return NULL;
+    }
+    n = (len - hdr_len) / RF433_CAPTURE_PULSE_LEN;
+    pulses = malloc(n * sizeof(*pulses));
+    for (int i = 0; i < n; i++)
+        rf433_capture_decode(buf + hdr_len + i * RF433_CAPTURE_PULSE_LEN, pulses + i);
+    free(buf);
+
+    *n_out = n;
+    return pulses;
+}
+
+// Splits the pulses into bursts at inter-frame gaps the way the receiver
+// does, and collects the bursts without a frame in them
+static void learn(struct rf433_learner *learner, const struct timing *pulses, int n_pulses)
+{
+    struct rf433_decoder dec;
+    uint32_t burst_frames = 0;
+    int i, n, start = 0;
+
+    rf433_decoder_init(&dec, NULL, NULL);
+    for (i = 0; i < n_pulses; i++) {
+        rf433_decoder_feed(&dec, pulses + i, 1);
+        if (pulses[i].state || pulses[i].time_us <= RF433_GAP_US)
+            continue;
+
+        n = i + 1 - start;
+        if (n > MAX_BURST_PULSES)
+            n = MAX_BURST_PULSES;
+        if (n >= MIN_PULSES && dec.n_frames == burst_frames)
+            rf433_learner_add_burst(learner, pulses + start, n);
+        burst_frames = dec.n_frames;
+        start = i + 1;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n rounds] [-l] [-d window_ms] [-e proto:code]... capture.bin...\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct rf433_decoder dec;
+    struct replay_stats stats;
+    struct rf433_learner learner;
+    struct rf433_learned_protocol learned;
+    struct dedup_ctx dedup_ctx;
+    struct timing *pulses;
+    uint32_t frames;
+    double start, elapsed, air_time;
+    int i, n_pulses, rounds = 1, window_ms = -1;
+    bool learning = false;
+
+    memset(&stats, 0, sizeof(stats));
+    rf433_learner_init(&learner);
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0)
+            learning = true;
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            window_ms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && n_expected < MAX_EXPECTED)
+            expected[n_expected++] = argv[++i];
+        else
+            usage(argv[0]);
+    }
+    if (i == argc || rounds < 1)
+        usage(argv[0]);
+    if (window_ms >= 0)
+        rf433_dedup_init(&dedup_ctx.dedup, window_ms, event_found, &stats);
+
+    for (; i < argc; i++) {
+        pulses = read_capture(argv[i], &n_pulses);
+        if (pulses == NULL)
+            return 1;
+
+        air_time = 0;
+        for (int p = 0; p < n_pulses; p++)
+            air_time += pulses[p].time_us / 1e6;
+
+        // Only the first round is counted, the rest are for timing.
+        rf433_decoder_init(&dec, frame_found, &stats);
+        rf433_decoder_feed(&dec, pulses, n_pulses);
+        dec.frame_cb = NULL;
+        frames = dec.n_frames;
+
+        start = now();
+        for (int r = 1; r < rounds; r++)
+            rf433_decoder_feed(&dec, pulses, n_pulses);
+        elapsed = now() - start;
+
+        if (learning)
+            learn(&learner, pulses, n_pulses);
+        if (window_ms >= 0)
+            dedup(&dedup_ctx, pulses, n_pulses);
+
+        printf("%s: %d pulses, %.1f s of air time\n", argv[i], n_pulses, air_time);
+        if (rounds > 1 && elapsed > 0)
+            printf("  %.0f pulses/s, %.0f frames/s\n",
+                   (double) n_pulses * (rounds - 1) / elapsed,
+                   (double) (dec.n_frames - frames) / elapsed);
+        free(pulses);
+    }
+
+    printf("frames: %u\n", stats.frames);
+    for (i = 0; i < rf433_n_protocols; i++) {
+        if (!stats.proto_frames[i])
+            continue;
+        printf("  %-16s %6u (%.1f%%)\n", rf433_protocols[i].name, stats.proto_frames[i],
+               100.0 * stats.proto_frames[i] / stats.frames);
+    }
+    if (window_ms >= 0)
+        printf("events: %u (%.1f frames each)\n", stats.events,
+               stats.events ? (double) stats.frames / stats.events : 0);
+    if (n_expected)
+        printf("false positives: %u (%.2f%%)\n", stats.false_positives,
+               stats.frames ? 100.0 * stats.false_positives / stats.frames : 0);
+    printf("codes:\n");
+    for (i = 0; i < stats.n_codes; i++)
+        printf("  %6u %s:%s\n", stats.codes[i].count, stats.codes[i].proto->name, stats.codes[i].code);
+
+    if (learning) {
+        char buf[100];
+
+        printf("unknown bursts: %u\n", (unsigned int) learner.n_bursts);
+        if (rf433_learner_propose(&learner, &learned, "learned") == 0) {
+            rf433_learner_format(&learned.proto, buf, sizeof(buf));
+            printf("learned protocol: %s\n", buf);
+        } else
+            printf("no protocol learned\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ Host benchmark of the rfreport codec against the previous implementation,
+ which allocated every message, printed a hex dump of it and computed the
+ CRC a bit at a time. The dumps go to /dev/null here, so the old numbers
+ are better than they were on a serial console. The v2 rows compare the
+ message size and speed of the compact format on a typical garden node.
+
+ Build and run (from the repository root):
+
+   gcc -O2 -Isrc/sensors tools/rfreport_bench.c src/sensors/rfreport.c -lm -o rfreport_bench
+   ./rfreport_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include "rfreport.h"
+
+#define ROUNDS  500000
+
+static FILE *dump;
+
+// The same as cs_crc32()
+static uint32_t old_crc32(uint32_t crc32, const uint8_t *buf, size_t len)
+{
+    crc32 = ~crc32;
+    while (len--) {
+        uint8_t b = *buf++;
+
+        for (int i = 0; i < 8; i++) {
+            if ((crc32 ^ b) & 1)
+                crc32 = (crc32 >> 1) ^ 0xedb88320;
+            else
+                crc32 >>= 1;
+            b >>= 1;
+        }
+    }
+    return ~crc32;
+}
+
+static void old_encode(uint16_t sensor_id, unsigned int n_observations,
+                       const struct rf_sensor_observation *observations,
+                       uint8_t **buf_out, unsigned int *buf_len)
+{
+    int len = RF_REPORT_LEN(n_observations), i;
+    uint8_t *p;
+    uint32_t val;
+
+    p = *buf_out = malloc(len);
+    *buf_len = len;
+    *p++ = (RF_PROTOCOL_V1 << 4) | n_observations;
+    *p++ = 0;
+    *p++ = sensor_id >> 8;
+    *p++ = sensor_id;
+    for (i = 0; i < (int) n_observations; i++) {
+        *p++ = observations[i].phenomenon;
+        *p++ = observations[i].value_type << 4;
+        val = observations[i].value.int_val;
+        *p++ = val >> 24; *p++ = val >> 16; *p++ = val >> 8; *p++ = val;
+    }
+    fprintf(dump, "encode: calculating crc for bytes: ");
+    for (i = 0; i < len - 4; i++)
+        fprintf(dump, "%02x ", (*buf_out)[i]);
+    fprintf(dump, "\n");
+    val = old_crc32(0, *buf_out, len - 4);
+    *p++ = val >> 24; *p++ = val >> 16; *p++ = val >> 8; *p++ = val;
+}
+
+struct old_report {
+    int n_observations;
+    uint16_t sensor_id;
+    struct rf_sensor_observation observations[];
+};
+
+static int old_decode(const uint8_t *buf, unsigned int buf_len, struct old_report **out)
+{
+    int n = buf[0] & 0x0f, len = RF_REPORT_LEN(n), i;
+    struct old_report *rep;
+    const uint8_t *p = buf + 4;
+
+    if ((int) buf_len < len)
+        return -1;
+    rep = malloc(sizeof(*rep) + n * sizeof(rep->observations[0]));
+    rep->n_observations = n;
+    rep->sensor_id = (buf[2] << 8) | buf[3];
+    for (i = 0; i < n; i++, p += 6) {
+        rep->observations[i].phenomenon = p[0];
+        rep->observations[i].value_type = p[1] >> 4;
+        rep->observations[i].value.int_val = (p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+    }
+    fprintf(dump, "decode: calculating crc for bytes: ");
+    for (i = 0; i < p - buf; i++)
+        fprintf(dump, "%02x ", buf[i]);
+    fprintf(dump, "\n");
+    if (old_crc32(0, buf, p - buf) != (uint32_t) ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3])) {
+        free(rep);
+        return -1;
+    }
+    *out = rep;
+    return 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    static const float node[5][2] = {
+        { RF_PHENOMENON_TEMPERATURE, 21.37 },
+        { RF_PHENOMENON_HUMIDITY, 64.2 },
+        { RF_PHENOMENON_PRESSURE, 1013.2 },
+        { RF_PHENOMENON_SOIL_MOISTURE, 38.5 },
+        { RF_PHENOMENON_BATTERY_VOLTAGE, 3.012 },
+    };
+    struct rf_sensor_observation obs[5], out_obs;
+    struct rf_report_view view;
+    struct old_report *rep;
+    uint8_t *old_buf, buf[RF_REPORT_V2_MAX_LEN];
+    unsigned int old_len;
+    double start, old_time, new_time, v2_time;
+    float sum = 0;
+    int r, i, len, v1_len, v2_len;
+
+    dump = fopen("/dev/null", "w");
+    for (i = 0; i < 3; i++) {
+        obs[i].phenomenon = i;
+        obs[i].value_type = RF_VALUE_FLOAT;
+        obs[i].value.float_val = 20.5 + i;
+    }
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        obs[0].value.float_val = r;
+        old_encode(0x1234, 3, obs, &old_buf, &old_len);
+        if (old_decode(old_buf, old_len, &rep) == 0) {
+            sum += rep->observations[0].value.float_val;
+            free(rep);
+        }
+        free(old_buf);
+    }
+    old_time = now() - start;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        obs[0].value.float_val = r;
+        len = rf_report_encode_msg_v1(0x1234, 3, obs, buf, sizeof(buf));
+        if (rf_report_decode_msg(buf, len, &view) == 0) {
+            rf_report_get_observation(&view, 0, &out_obs);
+            sum += out_obs.value.float_val;
+        }
+    }
+    new_time = now() - start;
+
+    // Both produce the same bytes
+    old_encode(0x1234, 3, obs, &old_buf, &old_len);
+    assert(old_len == (unsigned int) len && memcmp(old_buf, buf, len) == 0);
+    free(old_buf);
+
+    printf("encode + decode, 3 observations (%d bytes)\n", len);
+    printf("  before: %9.0f messages/s\n", ROUNDS / old_time);
+    printf("  after:  %9.0f messages/s (%.1fx)\n", ROUNDS / new_time, old_time / new_time);
+
+    for (i = 0; i < 5; i++) {
+        obs[i].phenomenon = node[i][0];
+        obs[i].value_type = RF_VALUE_FLOAT;
+        obs[i].value.float_val = node[i][1];
+    }
+    v1_len = rf_report_encode_msg_v1(0x1234, 5, obs, buf, sizeof(buf));
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        obs[0].value.float_val = 15 + (r & 1023) / 100.0;
+        v2_len = rf_report_encode_msg(0x1234, 5, obs, buf, sizeof(buf));
+        if (rf_report_decode_msg(buf, v2_len, &view) == 0) {
+            rf_report_get_observation(&view, 4, &out_obs);
+            sum += out_obs.value.float_val;
+        }
+    }
+    v2_time = now() - start;
+
+    // v2 values are rounded to the resolution of their phenomenon
+    obs[0].value.float_val = node[0][1];
+    v2_len = rf_report_encode_msg(0x1234, 5, obs, buf, sizeof(buf));
+    assert(rf_report_decode_msg(buf, v2_len, &view) == 0 && view.n_observations == 5);
+    for (i = 0; i < 5; i++) {
+        rf_report_get_observation(&view, i, &out_obs);
+        assert(out_obs.phenomenon == obs[i].phenomenon);
+        assert(fabsf(out_obs.value.float_val - obs[i].value.float_val) < 0.01);
+    }
+
+    printf("BME280 + soil moisture + battery node\n");
+    printf("  v1: %2d bytes\n", v1_len);
+    printf("  v2: %2d bytes, encode + decode + read %9.0f messages/s\n", v2_len, ROUNDS / v2_time);
+
+    return sum == 0;
+}
@@ -0,0 +1,264 @@
+/*
+ Bulk transfer benchmark of the reliable RadioHead managers on the
+ simulated radio (lib/radiohead/RH_Sim.h): one node sends a blob of
+ messages to another, the one after the other with RHReliableDatagram
+ sendtoAsync(), or pipelined with RHWindowedDatagram and windows of 1 to
+ 16 messages. Reports the goodput, the share of the bit rate it uses,
+ the frames sent and whether the messages arrived complete and in order.
+
+ Build and run (from the repository root):
+
+   g++ -O2 -DRH_PLATFORM=RH_PLATFORM_UNIX -Ilib/radiohead tools/rh_bulk_bench.cpp \
+       lib/radiohead/RH_Sim.cpp lib/radiohead/RHutil/simulator.cpp \
+       lib/radiohead/RHGenericDriver.cpp lib/radiohead/RHDatagram.cpp \
+       lib/radiohead/RHReliableDatagram.cpp lib/radiohead/RHWindowedDatagram.cpp \
+       -o rh_bulk_bench
+   ./rh_bulk_bench
+   ./rh_bulk_bench -b 250000 -l 0.1
+
+ Usage:
+
+   rh_bulk_bench [-k messages] [-l loss] [-d latency_us] [-b bit_rate] [-r retries]
+                 [-T timeout_ms] [-S step_us] [-s seed] [-W window]
+
+ Every message is as long as the manager allows. Every frame, data or
+ ack, is lost with probability loss. Without -W, runs stop-and-wait and
+ windows of 1, 2, 4, 8 and 16; -W 0 is stop-and-wait only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <RH_Sim.h>
+#include <RHReliableDatagram.h>
+#include <RHWindowedDatagram.h>
+
+#define SENDER_ADDRESS   1
+#define RECEIVER_ADDRESS 2
+// Give up on a transfer that takes longer, in simulated seconds
+#define MAX_SECONDS      3600
+
+struct config {
+    uint32_t messages;
+    float loss;
+    int latency;
+    int bit_rate;
+    int retries;
+    int timeout;
+    int step;
+    int seed;
+};
+
+struct result {
+    uint32_t acked;
+    uint32_t failed;
+    uint32_t received;
+    uint32_t out_of_order;
+    uint32_t frames;
+    uint64_t micros;
+};
+
+static void message_sent(bool acked, uint8_t retries, void *arg)
+{
+    struct result *r = (struct result *) arg;
+
+    if (acked)
+        r->acked++;
+    else
+        r->failed++;
+}
+
+// Messages carry their number, then filler
+static void fill(uint8_t *buf, uint8_t len, uint32_t seq)
+{
+    memset(buf, seq, len);
+    memcpy(buf, &seq, sizeof(seq));
+}
+
+static void received(struct result *r, uint32_t *expected, const uint8_t *buf, uint8_t len)
+{
+    uint32_t seq;
+
+    memcpy(&seq, buf, sizeof(seq));
+    // Failed messages leave gaps, but never go backwards
+    if (seq < *expected)
+        r->out_of_order++;
+    else
+        *expected = seq + 1;
+    r->received++;
+}
+
+// The simulated time only goes forward: each run starts where the last ended
+static uint64_t setup(RHSimMedium &medium, const struct config *c)
+{
+    randomSeed(c->seed);
+    medium.setSeed(c->seed);
+    medium.setLoss(c->loss);
+    medium.setLatency(c->latency);
+    return simMicros();
+}
+
+// RHReliableDatagram: a message is sent when the last one is acknowledged
+static struct result run_stop_and_wait(const struct config *c, uint8_t *len)
+{
+    RHSimMedium medium(2, c->bit_rate);
+    uint64_t start = setup(medium, c);
+    RH_Sim tx_driver(medium), rx_driver(medium);
+    RHReliableDatagram tx(tx_driver, SENDER_ADDRESS), rx(rx_driver, RECEIVER_ADDRESS);
+    struct result r;
+    uint8_t buf[RH_SIM_MAX_MESSAGE_LEN];
+    uint32_t next = 0, expected = 0;
+    uint64_t now, wake = 0;
+
+    memset(&r, 0, sizeof(r));
+    tx.init();
+    rx.init();
+    tx.setRetries(c->retries);
+    tx.setTimeout(c->timeout);
+    *len = tx_driver.maxMessageLength();
+
+    for (now = start; now < start + (uint64_t) MAX_SECONDS * 1000000; now += c->step) {
+        uint8_t rx_len = sizeof(buf);
+
+        medium.advanceTo(now);
+        while (rx.recvfromAck(buf, &rx_len)) {
+            received(&r, &expected, buf, rx_len);
+            rx_len = sizeof(buf);
+        }
+        // Collects the acks
+        rx_len = sizeof(buf);
+        while (tx.recvfromAck(buf, &rx_len))
+            rx_len = sizeof(buf);
+        if (wake && now >= wake) {
+            uint16_t ms = tx.pollAsync();
+
+            wake = ms ? now + ms * 1000 : 0;
+        }
+        if (!tx.asyncBusy()) {
+            if (next == c->messages)
+                break;
+            fill(buf, *len, next);
+            if (tx.sendtoAsync(buf, *len, RECEIVER_ADDRESS, message_sent, &r)) {
+                next++;
+                wake = now + c->step;
+            }
+        }
+    }
+    r.micros = now - start;
+    r.frames = medium.stats().transmitted;
+    return r;
+}
+
+static struct result run_windowed(const struct config *c, uint8_t window, uint8_t *len)
+{
+    RHSimMedium medium(2, c->bit_rate);
+    uint64_t start = setup(medium, c);
+    RH_Sim tx_driver(medium), rx_driver(medium);
+    RHWindowedDatagram tx(tx_driver, SENDER_ADDRESS), rx(rx_driver, RECEIVER_ADDRESS);
+    struct result r;
+    uint8_t buf[RH_WINDOWED_MAX_FRAME_LEN];
+    uint32_t next = 0, expected = 0;
+    uint64_t now;
+
+    memset(&r, 0, sizeof(r));
+    tx.init();
+    rx.init();
+    tx.setWindow(window);
+    tx.setRetries(c->retries);
+    tx.setTimeout(c->timeout);
+    *len = tx.maxMessageLength();
+
+    for (now = start; now < start + (uint64_t) MAX_SECONDS * 1000000; now += c->step) {
+        uint8_t rx_len = sizeof(buf);
+
+        medium.advanceTo(now);
+        while (rx.recvfromWindow(buf, &rx_len)) {
+            received(&r, &expected, buf, rx_len);
+            rx_len = sizeof(buf);
+        }
+        // Collects the acks
+        rx_len = sizeof(buf);
+        while (tx.recvfromWindow(buf, &rx_len))
+            rx_len = sizeof(buf);
+        while (next < c->messages && tx.windowFree()) {
+            fill(buf, *len, next);
+            tx.sendtoWindow(buf, *len, RECEIVER_ADDRESS, message_sent, &r);
+            next++;
+        }
+        // Every step, as an answer ends the wait before the time poll() returns
+        tx.poll();
+        if (r.acked + r.failed == c->messages)
+            break;
+    }
+    r.micros = now - start;
+    r.frames = medium.stats().transmitted;
+    return r;
+}
+
+static void print(const char *name, const struct config *c, const struct result *r, uint8_t len)
+{
+    double seconds = r->micros / 1e6;
+    double goodput = seconds > 0 ? (double) r->received * len / seconds : 0;
+
+    printf("%-14s %9.2f %9.1f %6.1f%% %8u %6u %6u %8u\n", name, seconds, goodput / 1000,
+           100.0 * goodput * 8 / c->bit_rate, r->frames, r->failed, c->messages - r->received,
+           r->out_of_order);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-k messages] [-l loss] [-d latency_us] [-b bit_rate] [-r retries]\n"
+            "       [-T timeout_ms] [-S step_us] [-s seed] [-W window]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct config c = { 2000, 0, 0, RH_SIM_DEFAULT_BIT_RATE, RH_DEFAULT_RETRIES, 50, 50, 1 };
+    static const uint8_t windows[] = { 1, 2, 4, 8, 16 };
+    int window = -1, opt;
+    struct result r;
+    uint8_t len;
+    char name[16];
+    unsigned int i;
+
+    while ((opt = getopt(argc, argv, "k:l:d:b:r:T:S:s:W:")) != -1) {
+        switch (opt) {
+        case 'k': c.messages = atoi(optarg); break;
+        case 'l': c.loss = atof(optarg); break;
+        case 'd': c.latency = atoi(optarg); break;
+        case 'b': c.bit_rate = atoi(optarg); break;
+        case 'r': c.retries = atoi(optarg); break;
+        case 'T': c.timeout = atoi(optarg); break;
+        case 'S': c.step = atoi(optarg); break;
+        case 's': c.seed = atoi(optarg); break;
+        case 'W': window = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (c.messages < 1 || c.loss < 0 || c.loss >= 1 || c.bit_rate < 1 || c.retries < 0
+        || c.retries > 255 || c.timeout < 1 || c.step < 1 || window < -1 || window > RH_WINDOWED_MAX_WINDOW)
+        usage(argv[0]);
+
+    printf("%u messages, %d bit/s, loss %.2f, latency %d us, %d retries, %d ms timeout\n",
+           c.messages, c.bit_rate, c.loss, c.latency, c.retries, c.timeout);
+    printf("%-14s %9s %9s %7s %8s %6s %6s %8s\n", "manager", "seconds", "KB/s", "link",
+           "frames", "failed", "lost", "reorder");
+
+    if (window <= 0) {
+        r = run_stop_and_wait(&c, &len);
+        print("stop-and-wait", &c, &r, len);
+    }
+    for (i = 0; i < sizeof(windows) && window != 0; i++) {
+        uint8_t w = window > 0 ? window : windows[i];
+
+        snprintf(name, sizeof(name), "window %u", w);
+        r = run_windowed(&c, w, &len);
+        print(name, &c, &r, len);
+        if (window > 0)
+            break;
+    }
+
+    return 0;
+}
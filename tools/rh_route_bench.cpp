@@ -0,0 +1,253 @@
+/*
+ Multi-hop routing with RHRouter on the simulated radio
+ (lib/radiohead/RH_Sim.h): nodes in a chain, each hearing only its
+ neighbours, send reports to the gateway at one end, like radiohead.cpp
+ does with radiohead.routing.enable. Exercises route discovery,
+ forwarding over every hop and the no-route messages of a relay that
+ loses its next hop.
+
+ Build and run (from the repository root):
+
+   g++ -O2 -DRH_PLATFORM=RH_PLATFORM_UNIX -Ilib/radiohead tools/rh_route_bench.cpp \
+       lib/radiohead/RH_Sim.cpp lib/radiohead/RHutil/simulator.cpp \
+       lib/radiohead/RHGenericDriver.cpp lib/radiohead/RHDatagram.cpp \
+       lib/radiohead/RHReliableDatagram.cpp lib/radiohead/RHRouter.cpp -o rh_route_bench
+   ./rh_route_bench -n 5 -t 100 -B 50
+   ./rh_route_bench -n 5 -t 100 -B 30 -R 60 -a
+
+ Usage:
+
+   rh_route_bench [-n nodes] [-t seconds] [-i interval_ms] [-l loss] [-b bit_rate]
+                  [-r retries] [-T timeout_ms] [-H max_hops] [-B break_s] [-R repair_s]
+                  [-k link] [-S step_us] [-a] [-s seed]
+
+ Node 0 is the gateway, node n-1 the far end of the chain. By default,
+ only the far end sends, every interval_ms with 10 % jitter; with -a,
+ every node does. A report still queued when the next one is due is
+ skipped. Every link between neighbours loses frames with probability
+ loss. At break_s seconds, the link between nodes k and k+1 (by default
+ the one in the middle) stops carrying anything, and at repair_s it
+ works again. The nodes run every step_us of simulated time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <RH_Sim.h>
+#include <RHRouter.h>
+
+#define GATEWAY_ADDRESS 0
+#define MAX_NODES       64
+
+struct report {
+    uint32_t seq;
+    uint64_t generated;     // Simulated microseconds
+};
+
+struct node {
+    RH_Sim *driver;
+    RHRouter *router;
+    bool sends;
+    uint64_t next_report;
+    uint32_t seq;
+    bool queued;            // A report waits in the router
+};
+
+static struct {
+    uint32_t generated;
+    uint32_t skipped;
+    uint32_t rejected;      // sendtoAsync() failed
+    uint32_t failed;        // No route found, or the first hop did not acknowledge
+    uint32_t delivered;
+    uint32_t duplicates;
+    uint32_t after_break;   // Delivered after the break, before the repair
+    uint32_t hops[MAX_NODES];
+} stats;
+
+static void report_sent(bool acked, uint8_t retries, void *arg)
+{
+    struct node *n = (struct node *) arg;
+
+    n->queued = false;
+    if (!acked)
+        stats.failed++;
+    (void) retries;
+}
+
+static void set_link(RHSimMedium &medium, struct node *nodes, int k, float loss)
+{
+    medium.setLinkLoss(nodes[k].driver->index(), nodes[k + 1].driver->index(), loss);
+    medium.setLinkLoss(nodes[k + 1].driver->index(), nodes[k].driver->index(), loss);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n nodes] [-t seconds] [-i interval_ms] [-l loss] [-b bit_rate]\n"
+            "       [-r retries] [-T timeout_ms] [-H max_hops] [-B break_s] [-R repair_s]\n"
+            "       [-k link] [-S step_us] [-a] [-s seed]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int n_nodes = 5, seconds = 100, interval = 1000, bit_rate = RH_SIM_DEFAULT_BIT_RATE;
+    int retries = 3, timeout = 50, max_hops = RH_ROUTER_DEFAULT_MAX_HOPS, step = 100, seed = 1;
+    int break_s = -1, repair_s = -1, link = -1;
+    float loss = 0;
+    bool all = false, broken = false;
+    uint32_t last_seq[MAX_NODES] = { 0 };
+    uint32_t forwarded = 0, dropped = 0, discoveries = 0;
+    int opt, i, j;
+
+    while ((opt = getopt(argc, argv, "n:t:i:l:b:r:T:H:B:R:k:S:as:")) != -1) {
+        switch (opt) {
+        case 'n': n_nodes = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'i': interval = atoi(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 'b': bit_rate = atoi(optarg); break;
+        case 'r': retries = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        case 'H': max_hops = atoi(optarg); break;
+        case 'B': break_s = atoi(optarg); break;
+        case 'R': repair_s = atoi(optarg); break;
+        case 'k': link = atoi(optarg); break;
+        case 'S': step = atoi(optarg); break;
+        case 'a': all = true; break;
+        case 's': seed = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (link < 0)
+        link = (n_nodes - 1) / 2;
+    if (n_nodes < 2 || n_nodes > MAX_NODES || seconds < 1 || interval < 1 || bit_rate < 1
+        || retries < 0 || timeout < 1 || max_hops < 1 || max_hops > 255 || step < 1
+        || link > n_nodes - 2 || (repair_s >= 0 && repair_s < break_s))
+        usage(argv[0]);
+
+    randomSeed(seed);
+    RHSimMedium medium(n_nodes, bit_rate);
+    medium.setSeed(seed);
+
+    struct node *nodes = new struct node[n_nodes];
+    for (i = 0; i < n_nodes; i++) {
+        struct node *n = &nodes[i];
+
+        n->driver = new RH_Sim(medium);
+        n->router = new RHRouter(*n->driver, GATEWAY_ADDRESS + i);
+        n->router->init();
+        n->router->setRetries(retries);
+        n->router->setTimeout(timeout);
+        n->router->setMaxHops(max_hops);
+        n->sends = i != 0 && (all || i == n_nodes - 1);
+        n->next_report = (uint64_t) random(interval * 1000);
+        n->seq = 0;
+        n->queued = false;
+    }
+    // Only neighbours hear each other
+    for (i = 0; i < n_nodes; i++)
+        for (j = 0; j < n_nodes; j++)
+            if (i != j)
+                medium.setLinkLoss(nodes[i].driver->index(), nodes[j].driver->index(),
+                                   abs(i - j) == 1 ? loss : 1.0);
+
+    uint64_t end = (uint64_t) seconds * 1000000;
+
+    for (uint64_t now = 0; now < end; now += step) {
+        uint8_t buf[RH_SIM_MAX_MESSAGE_LEN];
+        uint8_t len, source, hops;
+
+        medium.advanceTo(now);
+
+        if (!broken && break_s >= 0 && now >= (uint64_t) break_s * 1000000 &&
+            (repair_s < 0 || now < (uint64_t) repair_s * 1000000)) {
+            set_link(medium, nodes, link, 1.0);
+            broken = true;
+        } else if (broken && repair_s >= 0 && now >= (uint64_t) repair_s * 1000000) {
+            set_link(medium, nodes, link, loss);
+            broken = false;
+        }
+
+        for (i = 0; i < n_nodes; i++) {
+            struct node *n = &nodes[i];
+
+            // Relays, and the gateway collects the reports
+            len = sizeof(buf);
+            while (n->router->recvfromAck(buf, &len, &source, NULL, NULL, &hops)) {
+                struct report r;
+
+                if (i == 0 && len == sizeof(r) && source < n_nodes) {
+                    memcpy(&r, buf, sizeof(r));
+                    if (r.seq <= last_seq[source]) {
+                        stats.duplicates++;
+                    } else {
+                        last_seq[source] = r.seq;
+                        stats.delivered++;
+                        stats.hops[hops < MAX_NODES ? hops : MAX_NODES - 1]++;
+                        if (broken)
+                            stats.after_break++;
+                    }
+                }
+                len = sizeof(buf);
+            }
+            if (n->sends && now >= n->next_report) {
+                struct report r;
+
+                stats.generated++;
+                r.seq = ++n->seq;
+                r.generated = now;
+                if (n->queued) {
+                    stats.skipped++;
+                } else if (n->router->sendtoAsync((uint8_t *) &r, sizeof(r), GATEWAY_ADDRESS,
+                                                  report_sent, n) != RH_ROUTER_ERROR_NONE) {
+                    stats.rejected++;
+                } else {
+                    n->queued = true;
+                }
+                n->next_report += interval * 1000 * (900 + random(201)) / 1000;
+            }
+            // Calling it early does no harm
+            n->router->poll();
+        }
+    }
+
+    const RHSimMedium::Stats &m = medium.stats();
+
+    for (i = 0; i < n_nodes; i++) {
+        forwarded += nodes[i].router->forwarded();
+        dropped += nodes[i].router->dropped();
+        discoveries += nodes[i].router->discoveries();
+    }
+
+    printf("%d node chain, %d s simulated, report every %d ms from %s, %d bit/s, loss %.2f, "
+           "max %d hops\n", n_nodes, seconds, interval, all ? "every node" : "the far end",
+           bit_rate, loss, max_hops);
+    if (break_s >= 0) {
+        printf("link %d-%d broken at %d s", link, link + 1, break_s);
+        if (repair_s >= 0)
+            printf(", repaired at %d s", repair_s);
+        printf("\n");
+    }
+    printf("reports: %u generated, %u delivered (%.1f%%), %u skipped, %u rejected, "
+           "%u failed, %u duplicates\n",
+           stats.generated, stats.delivered,
+           stats.generated ? 100.0 * stats.delivered / stats.generated : 0.0,
+           stats.skipped, stats.rejected, stats.failed, stats.duplicates);
+    if (break_s >= 0)
+        printf("  %u delivered while the link was broken\n", stats.after_break);
+    printf("hops:\n");
+    for (i = 0; i < n_nodes - 1; i++)
+        if (stats.hops[i])
+            printf("  %2d: %7u\n", i + 1, stats.hops[i]);
+    printf("routers: %u forwarded, %u dropped, %u discoveries\n", forwarded, dropped, discoveries);
+    for (i = 0; i < n_nodes; i++)
+        printf("  node %2d: %6u forwarded, %6u dropped, %6u discoveries\n", i,
+               nodes[i].router->forwarded(), nodes[i].router->dropped(),
+               nodes[i].router->discoveries());
+    printf("medium: %u frames, %u received, %u lost, %u collided, %u missed while sending, "
+           "%u RX FIFO overflows\n", m.transmitted, m.delivered, m.lost, m.collided, m.missed,
+           m.overflowed);
+
+    return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ Fleet-scale benchmark of RHReliableDatagram on the simulated radio
+ (lib/radiohead/RH_Sim.h): up to 254 nodes send reports to one gateway
+ with sendtoAsync(), like radiohead.cpp does, over a shared medium with
+ loss, latency and collisions. Reports delivered reports/s, retries and
+ the latency from generating a report to the gateway receiving it.
+
+ With -m tdma, the gateway sends the beacons of src/rh_tdma.h and the
+ nodes send in their own slots, disciplining clocks that run off by up
+ to -p ppm, as radiohead.cpp does with radiohead.tdma.enable.
+
+ Build and run (from the repository root):
+
+   g++ -O2 -DRH_PLATFORM=RH_PLATFORM_UNIX -Ilib/radiohead -Isrc tools/rh_sim_bench.cpp \
+       src/rh_tdma.c lib/radiohead/RH_Sim.cpp lib/radiohead/RHutil/simulator.cpp \
+       lib/radiohead/RHGenericDriver.cpp lib/radiohead/RHDatagram.cpp \
+       lib/radiohead/RHReliableDatagram.cpp -o rh_sim_bench
+   ./rh_sim_bench -n 200
+   ./rh_sim_bench -n 250 -b 250000 -t 180 -w 60 -m tdma -L 3 -p 50
+
+ Usage:
+
+   rh_sim_bench [-n nodes] [-t seconds] [-w seconds] [-i interval_ms] [-l loss]
+                [-q spread] [-d latency_us] [-b bit_rate] [-r retries] [-T timeout_ms]
+                [-S step_us] [-c] [-s seed] [-m aloha|tdma] [-L slot_ms] [-p ppm]
+
+ Each node generates a report every interval_ms, with 10 % jitter. A
+ report still in flight when the next one is due is skipped, like on the
+ device. Every link loses frames with probability loss; with -q, the
+ links between each node and the gateway get an extra loss drawn from
+ 0..spread. -c disables collisions. The nodes and the gateway run every
+ step_us of simulated time. The reports generated in the first -w
+ seconds, while the nodes join, are not counted. In TDMA mode, each try
+ takes one slot, and the ack timeout is half a slot of slot_ms (-T is
+ ignored).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include <RH_Sim.h>
+#include <RHReliableDatagram.h>
+#include "rh_tdma.h"
+
+#define GATEWAY_ADDRESS 0
+#define MAX_NODES       254
+#define MAX_RETRIES     15
+
+struct report {
+    uint32_t seq;
+    uint64_t generated;     // Simulated microseconds
+};
+
+struct node {
+    RH_Sim *driver;
+    RHReliableDatagram *manager;
+    uint64_t next_report;
+    uint64_t wake;          // When pollAsync() wants to run, 0 if idle
+    uint32_t seq;
+
+    // TDMA
+    double drift;           // Of the local clock
+    struct rh_tdma_clock clock;
+    bool waiting;           // For the slot to send report
+    struct report report;
+    uint8_t tries;
+    uint8_t max_retries;
+};
+
+static struct {
+    uint64_t from;          // Reports generated before are not counted
+    uint32_t generated;
+    uint32_t skipped;
+    uint32_t acked;
+    uint32_t failed;
+    uint32_t delivered;
+    uint32_t duplicates;
+    uint32_t retries[MAX_RETRIES + 1];
+    std::vector<uint32_t> latency;      // Microseconds
+} stats;
+
+// Local clock of a node, in seconds
+static double local_time(const struct node *n, uint64_t now)
+{
+    return now / 1e6 * (1.0 + n->drift);
+}
+
+static void report_sent(bool acked, uint8_t retries, void *arg)
+{
+    struct node *n = (struct node *) arg;
+
+    // TDMA: one try per slot, and the retries in the next slots
+    if (n) {
+        if (!acked && n->tries < n->max_retries) {
+            n->tries++;
+            n->waiting = true;
+            return;
+        }
+        retries = n->tries;
+    }
+    if (simMicros() < stats.from)
+        return;
+    if (acked)
+        stats.acked++;
+    else
+        stats.failed++;
+    stats.retries[retries > MAX_RETRIES ? MAX_RETRIES : retries]++;
+}
+
+static double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    return v[(size_t) (p * (v.size() - 1))] / 1000.0;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n nodes] [-t seconds] [-w seconds] [-i interval_ms] [-l loss]\n"
+            "       [-q spread] [-d latency_us] [-b bit_rate] [-r retries] [-T timeout_ms]\n"
+            "       [-S step_us] [-c] [-s seed] [-m aloha|tdma] [-L slot_ms] [-p ppm]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int n_nodes = 100, seconds = 60, warmup = 0, interval = 1000, latency = 0, retries = 3;
+    int timeout = 200, step = 100, bit_rate = RH_SIM_DEFAULT_BIT_RATE, seed = 1;
+    int slot_ms = 10, max_ppm = 0;
+    float loss = 0, spread = 0;
+    bool collisions = true, tdma = false;
+    struct rh_tdma_schedule schedule;
+    double next_beacon = 0;
+    uint32_t n_beacons = 0;
+    uint32_t *last_seq;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "n:t:w:i:l:q:d:b:r:T:S:cs:m:L:p:")) != -1) {
+        switch (opt) {
+        case 'n': n_nodes = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'i': interval = atoi(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 'q': spread = atof(optarg); break;
+        case 'd': latency = atoi(optarg); break;
+        case 'b': bit_rate = atoi(optarg); break;
+        case 'r': retries = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        case 'S': step = atoi(optarg); break;
+        case 'c': collisions = false; break;
+        case 's': seed = atoi(optarg); break;
+        case 'm':
+            if (strcmp(optarg, "tdma") == 0)
+                tdma = true;
+            else if (strcmp(optarg, "aloha") != 0)
+                usage(argv[0]);
+            break;
+        case 'L': slot_ms = atoi(optarg); break;
+        case 'p': max_ppm = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (n_nodes < 1 || n_nodes > MAX_NODES || seconds < 1 || warmup < 0 || warmup >= seconds
+        || interval < 1 || step < 1
+        || bit_rate < 1 || retries < 0 || retries > MAX_RETRIES || slot_ms < 1 || slot_ms > 255 || max_ppm < 0)
+        usage(argv[0]);
+    if (tdma)
+        timeout = std::max(1, slot_ms / 2);
+
+    randomSeed(seed);
+    RHSimMedium medium(n_nodes + 1, bit_rate);
+    medium.setSeed(seed);
+    medium.setLoss(loss);
+    medium.setLatency(latency);
+    medium.setCollisions(collisions);
+
+    RH_Sim gateway_driver(medium);
+    RHReliableDatagram gateway(gateway_driver, GATEWAY_ADDRESS);
+    gateway.init();
+    rh_tdma_schedule_init(&schedule, slot_ms, RH_TDMA_MAX_SLOTS, 0);
+
+    struct node *nodes = new struct node[n_nodes];
+    for (i = 0; i < n_nodes; i++) {
+        struct node *n = &nodes[i];
+
+        n->driver = new RH_Sim(medium);
+        n->manager = new RHReliableDatagram(*n->driver, GATEWAY_ADDRESS + 1 + i);
+        n->manager->init();
+        n->manager->setRetries(tdma ? 0 : retries);
+        n->manager->setTimeout(timeout);
+        n->next_report = (uint64_t) random(interval * 1000);
+        n->wake = 0;
+        n->seq = 0;
+        n->drift = max_ppm ? (random(2 * max_ppm + 1) - max_ppm) / 1e6 : 0;
+        n->waiting = false;
+        n->max_retries = retries;
+        rh_tdma_clock_init(&n->clock);
+        if (spread > 0) {
+            float extra = spread * random(1000) / 1000;
+
+            medium.setLinkLoss(n->driver->index(), gateway_driver.index(), loss + extra);
+            medium.setLinkLoss(gateway_driver.index(), n->driver->index(), loss + extra);
+        }
+    }
+    last_seq = (uint32_t *) calloc(n_nodes + 1, sizeof(*last_seq));
+
+    uint64_t end = (uint64_t) seconds * 1000000;
+    stats.from = (uint64_t) warmup * 1000000;
+    double start = now_s();
+
+    for (uint64_t now = 0; now < end; now += step) {
+        uint8_t buf[RH_SIM_MAX_MESSAGE_LEN];
+        uint8_t len = sizeof(buf), from;
+
+        medium.advanceTo(now);
+
+        if (tdma && now / 1e6 >= next_beacon) {
+            struct rh_tdma_beacon b;
+
+            next_beacon = rh_tdma_next_beacon(&schedule, now / 1e6, &b);
+            len = rh_tdma_encode_beacon(&b, buf, sizeof(buf));
+            // Like send_broadcast() in radiohead.cpp
+            gateway.setHeaderId(b.superframe);
+            gateway.setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK);
+            gateway.sendto(buf, len, RH_BROADCAST_ADDRESS);
+            n_beacons++;
+            len = sizeof(buf);
+        }
+
+        while (gateway.recvfromAck(buf, &len, &from)) {
+            struct report r;
+
+            if (len == sizeof(r) && from > GATEWAY_ADDRESS && from <= n_nodes) {
+                if (tdma)
+                    rh_tdma_assign(&schedule, from);
+                memcpy(&r, buf, sizeof(r));
+                if (r.generated < stats.from) {
+                    last_seq[from] = std::max(last_seq[from], r.seq);
+                } else if (r.seq <= last_seq[from]) {
+                    stats.duplicates++;
+                } else {
+                    last_seq[from] = r.seq;
+                    stats.delivered++;
+                    stats.latency.push_back(now - r.generated);
+                }
+            }
+            len = sizeof(buf);
+        }
+
+        for (i = 0; i < n_nodes; i++) {
+            struct node *n = &nodes[i];
+
+            // Collects the acks, and the beacons
+            len = sizeof(buf);
+            while (n->manager->recvfromAck(buf, &len)) {
+                struct rh_tdma_beacon b;
+
+                // Like the IRQ time on the device, up to a step late
+                if (rh_tdma_decode_beacon(buf, len, &b) == 0)
+                    rh_tdma_clock_beacon(&n->clock, &b, n->manager->thisAddress(),
+                                         local_time(n, now - medium.airTime(len + RH_SIM_HEADER_LEN)));
+                len = sizeof(buf);
+            }
+            if (n->wake && now >= n->wake) {
+                uint16_t ms = n->manager->pollAsync();
+
+                n->wake = ms ? now + ms * 1000 : 0;
+            }
+            if (now >= n->next_report) {
+                struct report r;
+
+                if (now >= stats.from)
+                    stats.generated++;
+                r.seq = ++n->seq;
+                r.generated = now;
+                if (n->manager->asyncBusy() || n->waiting) {
+                    if (now >= stats.from)
+                        stats.skipped++;
+                } else {
+                    n->report = r;
+                    n->waiting = true;
+                    n->tries = 0;
+                }
+                n->next_report += interval * 1000 * (900 + random(201)) / 1000;
+            }
+            if (n->waiting) {
+                double local = local_time(n, now), slot_start, slot_end;
+
+                // Without sync or a slot, send at once like ALOHA
+                if (tdma && rh_tdma_clock_next_slot(&n->clock, local, &slot_start, &slot_end) &&
+                    slot_start > local)
+                    continue;
+                if (n->manager->sendtoAsync((uint8_t *) &n->report, sizeof(n->report),
+                                            GATEWAY_ADDRESS, report_sent, tdma ? n : NULL)) {
+                    n->wake = now + step;
+                    n->waiting = false;
+                }
+            }
+        }
+    }
+
+    double wall = now_s() - start;
+    const RHSimMedium::Stats &m = medium.stats();
+
+    std::sort(stats.latency.begin(), stats.latency.end());
+
+    printf("%d nodes, %d s simulated (%d s not counted), report every %d ms, %d bit/s, loss %.2f", n_nodes,
+           seconds, warmup, interval, bit_rate, loss);
+    if (spread > 0)
+        printf(" + 0..%.2f", spread);
+    printf(", latency %d us, collisions %s\n", latency, collisions ? "on" : "off");
+    if (tdma) {
+        uint32_t synced = 0, resyncs = 0;
+
+        for (i = 0; i < n_nodes; i++) {
+            if (rh_tdma_clock_synced(&nodes[i].clock, local_time(&nodes[i], end)))
+                synced++;
+            resyncs += nodes[i].clock.n_resyncs;
+        }
+        printf("TDMA: %d ms slots, %u slots (%.0f ms superframe), %u beacons, clocks off by up to "
+               "%d ppm, %u nodes in sync at the end, %u resyncs\n", slot_ms, schedule.n_slots,
+               rh_tdma_period(schedule.n_slots, schedule.slot_ms) * 1000, n_beacons, max_ppm,
+               synced, resyncs);
+    }
+    printf("reports: %u generated, %u delivered (%.1f%%), %u failed, %u skipped, %u duplicates\n",
+           stats.generated, stats.delivered,
+           stats.generated ? 100.0 * stats.delivered / stats.generated : 0.0,
+           stats.failed, stats.skipped, stats.duplicates);
+    printf("throughput: %.1f delivered reports/s\n", (double) stats.delivered / (seconds - warmup));
+
+    uint32_t sent = 0, total = 0;
+    for (i = 0; i <= MAX_RETRIES; i++) {
+        sent += stats.retries[i];
+        total += stats.retries[i] * i;
+    }
+    printf("retries: %.3f per report, gateway retransmissions %u\n",
+           sent ? (double) total / sent : 0.0, (unsigned int) gateway.retransmissions());
+    for (i = 0; i <= retries; i++)
+        printf("  %2d: %7u\n", i, stats.retries[i]);
+    printf("latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n",
+           percentile(stats.latency, 0.5), percentile(stats.latency, 0.9),
+           percentile(stats.latency, 0.99), percentile(stats.latency, 0.999),
+           percentile(stats.latency, 1.0));
+    printf("medium: %u frames, %u received, %u lost, %u collided, %u missed while sending, "
+           "%u RX FIFO overflows\n", m.transmitted, m.delivered, m.lost, m.collided, m.missed,
+           m.overflowed);
+    printf("wall time: %.2f s (%.0fx real time)\n", wall, seconds / wall);
+
+    return 0;
+}
@@ -0,0 +1,402 @@
+/*
+ Host side of the RF network sniffer (radiohead.sniffer.enable, see
+ src/rh_sniffer.h): connects to the device, writes the frames it
+ receives to a pcap file and prints a summary of the traffic between
+ every pair of nodes when done.
+
+ Build and run (from the repository root):
+
+   gcc -O2 -Isrc tools/rh_sniff.c -o rh_sniff
+   ./rh_sniff -o net.pcap -t 600 192.168.1.50
+   ./rh_sniff -r net.pcap
+
+ Usage:
+
+   rh_sniff [-o file.pcap] [-c frames] [-t seconds] [-q] host[:port]
+   rh_sniff -r file.pcap
+
+ Runs until -c frames or -t seconds, or Ctrl-C. -r reads an earlier
+ capture back for the summary only. -q leaves out the line per frame.
+
+ The pcap files use the link type USER0 (147). Every packet is a 4 byte
+ pseudo-header, the channel, the data rate (0: 2 Mbps, 1: 1 Mbps, 2: 250
+ kbps), the pipe and the flags of the record, then the frame as on the
+ air: to, from, ID and flags, and the payload. The timestamps are the
+ reception times on the device, moved to the host clock when connected.
+
+ In the summary, a frame is counted as a retransmission when the last
+ frame from the same node to the same address had the same ID and was
+ less than a second earlier. The air time is the share of the capture
+ the frames kept the channel busy, without the hardware ACKs the sniffer
+ does not see. Frames the device lost are reported as they happen, and
+ in the totals.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include "rh_sniffer.h"
+
+#define DEFAULT_PORT        "1968"
+#define LINKTYPE_USER0      147
+#define PSEUDO_HEADER_LEN   4
+#define RH_HEADER_LEN       4
+#define RETRANSMIT_WINDOW   1.0
+
+struct frame {
+    double time;                // Host clock, seconds
+    uint8_t channel;
+    uint8_t rate;
+    uint8_t pipe;
+    uint8_t flags;
+    uint8_t len;
+    uint8_t data[RH_SNIFFER_MAX_FRAME_LEN];
+};
+
+struct pair_stat {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t retransmissions;
+    double air_time;
+    double last_time;
+    int last_id;
+};
+
+struct summary {
+    uint32_t frames;
+    uint32_t short_frames;      // Without the RadioHead headers
+    uint32_t dropped;
+    uint32_t fifo_full;
+    double first_time;
+    double last_time;
+    struct pair_stat pairs[256][256];   // From, to
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    stop = 1;
+    (void) sig;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+    return ((uint64_t) get_be32(p) << 32) | get_be32(p + 4);
+}
+
+// Same as nrf24_air_time() in radiohead.cpp, for the whole frame
+static double air_time(const struct frame *f)
+{
+    static const double bps[] = { 2000000, 1000000, 250000 };
+
+    return (8 * (1 + 5 + f->len + 2) + 9) / bps[f->rate < 3 ? f->rate : 0];
+}
+
+static void summary_add(struct summary *s, const struct frame *f)
+{
+    struct pair_stat *p;
+
+    if (!s->frames++)
+        s->first_time = f->time;
+    s->last_time = f->time;
+    if (f->len < RH_HEADER_LEN) {
+        s->short_frames++;
+        return;
+    }
+    p = &s->pairs[f->data[1]][f->data[0]];
+    if (p->frames && p->last_id == f->data[2] && f->time - p->last_time < RETRANSMIT_WINDOW)
+        p->retransmissions++;
+    p->frames++;
+    p->bytes += f->len;
+    p->air_time += air_time(f);
+    p->last_time = f->time;
+    p->last_id = f->data[2];
+}
+
+static void summary_print(const struct summary *s)
+{
+    double duration = s->last_time - s->first_time;
+    const struct pair_stat *p;
+    int from, to;
+
+    printf("%u frames in %.1f s, %u too short, %u dropped on the device, RX FIFO full %u times\n",
+           s->frames, duration, s->short_frames, s->dropped, s->fifo_full);
+    printf("%5s %5s %8s %9s %8s %8s\n", "from", "to", "frames", "bytes", "air", "retrans");
+    for (from = 0; from < 256; from++) {
+        for (to = 0; to < 256; to++) {
+            p = &s->pairs[from][to];
+            if (!p->frames)
+                continue;
+            printf("%5d %5d %8u %9u %7.3f%% %8u\n", from, to, p->frames, p->bytes,
+                   duration > 0 ? 100 * p->air_time / duration : 0.0, p->retransmissions);
+        }
+    }
+}
+
+static void print_frame(const struct frame *f)
+{
+    int i;
+
+    printf("%.6f ch %u pipe %u", f->time, f->channel, f->pipe);
+    if (f->len >= RH_HEADER_LEN)
+        printf(" %3u -> %3u id %3u flags %02x:", f->data[1], f->data[0], f->data[2], f->data[3]);
+    else
+        printf(" short:");
+    for (i = f->len >= RH_HEADER_LEN ? RH_HEADER_LEN : 0; i < f->len; i++)
+        printf(" %02x", f->data[i]);
+    printf("\n");
+}
+
+// The pcap headers are in host byte order, as the magic tells the readers
+static void pcap_write_header(FILE *fp)
+{
+    uint32_t magic = 0xa1b2c3d4, snaplen = 65535, linktype = LINKTYPE_USER0;
+    uint16_t major = 2, minor = 4;
+    int32_t zone = 0;
+    uint32_t sigfigs = 0;
+
+    fwrite(&magic, 4, 1, fp);
+    fwrite(&major, 2, 1, fp);
+    fwrite(&minor, 2, 1, fp);
+    fwrite(&zone, 4, 1, fp);
+    fwrite(&sigfigs, 4, 1, fp);
+    fwrite(&snaplen, 4, 1, fp);
+    fwrite(&linktype, 4, 1, fp);
+}
+
+static void pcap_write_frame(FILE *fp, const struct frame *f)
+{
+    uint32_t rec[4];
+    uint8_t pseudo[PSEUDO_HEADER_LEN] = { f->channel, f->rate, f->pipe, f->flags };
+
+    rec[0] = (uint32_t) f->time;
+    rec[1] = (uint32_t) ((f->time - rec[0]) * 1e6);
+    rec[2] = rec[3] = PSEUDO_HEADER_LEN + f->len;
+    fwrite(rec, sizeof(rec), 1, fp);
+    fwrite(pseudo, sizeof(pseudo), 1, fp);
+    fwrite(f->data, f->len, 1, fp);
+}
+
+static int read_pcap(const char *file, struct summary *s)
+{
+    FILE *fp = fopen(file, "rb");
+    uint32_t header[6], rec[4];
+    uint8_t pseudo[PSEUDO_HEADER_LEN];
+    struct frame f;
+
+    if (fp == NULL) {
+        perror(file);
+        return -1;
+    }
+    if (fread(header, sizeof(header), 1, fp) != 1 || header[0] != 0xa1b2c3d4 ||
+        header[5] != LINKTYPE_USER0) {
+        fprintf(stderr, "%s: not a capture of rh_sniff\n", file);
+        fclose(fp);
+        return -1;
+    }
+    while (fread(rec, sizeof(rec), 1, fp) == 1) {
+        if (rec[2] < PSEUDO_HEADER_LEN || rec[2] > PSEUDO_HEADER_LEN + RH_SNIFFER_MAX_FRAME_LEN ||
+            fread(pseudo, sizeof(pseudo), 1, fp) != 1)
+            break;
+        f.time = rec[0] + rec[1] / 1e6;
+        f.channel = pseudo[0];
+        f.rate = pseudo[1];
+        f.pipe = pseudo[2];
+        f.flags = pseudo[3];
+        f.len = rec[2] - PSEUDO_HEADER_LEN;
+        if (fread(f.data, f.len, 1, fp) != 1 && f.len)
+            break;
+        summary_add(s, &f);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int connect_to(const char *target)
+{
+    char host[256];
+    const char *port = DEFAULT_PORT, *colon = strrchr(target, ':');
+    struct addrinfo hints, *res, *ai;
+    int fd = -1, err;
+
+    snprintf(host, sizeof(host), "%s", target);
+    if (colon != NULL) {
+        host[colon - target] = '\0';
+        port = colon + 1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(host, port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", target, gai_strerror(err));
+        return -1;
+    }
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        fprintf(stderr, "%s: unable to connect\n", target);
+    return fd;
+}
+
+// Returns 1 when all was read, 0 at the end of the stream or when
+// stopped, < 0 on errors
+static int read_full(int fd, uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR && !stop)
+            continue;
+        if (n < 0)
+            return stop ? 0 : -1;
+        if (n == 0)
+            return 0;
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static double host_time(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int sniff(int fd, FILE *out, long max_frames, int seconds, int quiet, struct summary *s)
+{
+    uint8_t header[RH_SNIFFER_HEADER_LEN], rec[2 + 255];
+    double offset;              // Host clock minus device uptime
+    struct frame f;
+    int ret;
+
+    if ((ret = read_full(fd, header, sizeof(header))) <= 0 ||
+        memcmp(header, RH_SNIFFER_MAGIC, 7) || header[7] != RH_SNIFFER_VERSION) {
+        fprintf(stderr, "No sniffer stream from the device\n");
+        return -1;
+    }
+    offset = host_time() - get_be64(header + 8) / 1e6;
+    if (seconds > 0)
+        alarm(seconds);
+
+    while (!stop && (max_frames <= 0 || s->frames < max_frames)) {
+        if ((ret = read_full(fd, rec, 2)) <= 0 || (ret = read_full(fd, rec + 2, rec[1])) <= 0)
+            break;
+        switch (rec[0]) {
+        case RH_SNIFFER_REC_FRAME:
+            if (rec[1] < 12 || rec[1] > 12 + RH_SNIFFER_MAX_FRAME_LEN)
+                continue;
+            f.time = offset + get_be64(rec + 2) / 1e6;
+            f.channel = rec[10];
+            f.rate = rec[11];
+            f.pipe = rec[12];
+            f.flags = rec[13];
+            f.len = rec[1] - 12;
+            memcpy(f.data, rec + 14, f.len);
+            summary_add(s, &f);
+            if (out != NULL)
+                pcap_write_frame(out, &f);
+            if (!quiet)
+                print_frame(&f);
+            break;
+        case RH_SNIFFER_REC_LOST:
+            if (rec[1] < 8)
+                continue;
+            s->dropped += get_be32(rec + 2);
+            s->fifo_full += get_be32(rec + 6);
+            fprintf(stderr, "Lost: %u frames dropped on the device, RX FIFO full %u times\n",
+                    get_be32(rec + 2), get_be32(rec + 6));
+            break;
+        }
+    }
+    if (ret < 0)
+        perror("read");
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-o file.pcap] [-c frames] [-t seconds] [-q] host[:port]\n"
+            "       %s -r file.pcap\n", prog, prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    static struct summary s;
+    const char *out_file = NULL, *in_file = NULL;
+    long max_frames = 0;
+    int seconds = 0, quiet = 0, fd, opt, ret;
+    struct sigaction sa;
+    FILE *out = NULL;
+
+    while ((opt = getopt(argc, argv, "o:c:t:qr:")) != -1) {
+        switch (opt) {
+        case 'o': out_file = optarg; break;
+        case 'c': max_frames = atol(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'q': quiet = 1; break;
+        case 'r': in_file = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (in_file != NULL) {
+        if (optind != argc || read_pcap(in_file, &s) < 0)
+            return 1;
+        summary_print(&s);
+        return 0;
+    }
+    if (optind != argc - 1 || max_frames < 0 || seconds < 0)
+        usage(argv[0]);
+
+    if (out_file != NULL) {
+        out = fopen(out_file, "wb");
+        if (out == NULL) {
+            perror(out_file);
+            return 1;
+        }
+        pcap_write_header(out);
+    }
+    fd = connect_to(argv[optind]);
+    if (fd < 0)
+        return 1;
+
+    // No SA_RESTART: the signals end the blocking read
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
+
+    ret = sniff(fd, out, max_frames, seconds, quiet, &s);
+    close(fd);
+    if (out != NULL)
+        fclose(out);
+    summary_print(&s);
+    return ret < 0 ? 1 : 0;
+}